@@ -0,0 +1,153 @@
+"""
+Precomputed point tables for the ed25519-fast signature backend
+(src/ed25519_fast.cpp).
+
+Ed25519 verification computes [S]B - [k]A. B is the curve's base point and A
+is the public key. Both are fixed at build time, so both get a table of
+(j + 1) * 256^i * P for i < 32, j < 8 (with P = -A for the key). Each entry is
+stored as (y + x, y - x, 2dxy) in the verifier's 10-limb field representation.
+Verification then needs only table additions and four doublings instead of a
+full double-scalar multiplication.
+
+Runs as a PlatformIO pre-script, writing ed25519_tables.h into the build
+directory for the PUBLIC_KEY_HEX in src/config.h (or a -DPUBLIC_KEY_HEX
+override), or standalone:
+
+    python3 ed25519_tables.py <public key hex> <output.h>
+"""
+
+import os
+import re
+import sys
+
+P = 2**255 - 19
+D = -121665 * pow(121666, P - 2, P) % P
+SQRT_M1 = pow(2, (P - 1) // 4, P)
+LIMB_OFFSETS = [0, 26, 51, 77, 102, 128, 153, 179, 204, 230]
+
+
+def inv(x):
+    return pow(x, P - 2, P)
+
+
+def recover_x(y, sign):
+    xx = (y * y - 1) * inv(D * y * y + 1) % P
+    x = pow(xx, (P + 3) // 8, P)
+    if (x * x - xx) % P != 0:
+        x = x * SQRT_M1 % P
+    if (x * x - xx) % P != 0:
+        raise ValueError("public key is not a curve point")
+    if x & 1 != sign:
+        x = P - x
+    return x
+
+
+def add(p1, p2):
+    x1, y1 = p1
+    x2, y2 = p2
+    t = D * x1 * x2 * y1 * y2 % P
+    x3 = (x1 * y2 + y1 * x2) * inv(1 + t) % P
+    y3 = (y1 * y2 + x1 * x2) * inv(1 - t) % P
+    return x3, y3
+
+
+def decode_point(data):
+    y = int.from_bytes(data, "little") & ((1 << 255) - 1)
+    if y >= P:
+        raise ValueError("public key y out of range")
+    return recover_x(y, data[31] >> 7), y
+
+
+def limbs(v):
+    return [(v >> off) & ((1 << (26 if i % 2 == 0 else 25)) - 1) for i, off in enumerate(LIMB_OFFSETS)]
+
+
+def table(point):
+    rows = []
+    row_base = point
+    for _ in range(32):
+        entries = []
+        q = row_base
+        for _ in range(8):
+            x, y = q
+            entries.append([limbs((y + x) % P), limbs((y - x) % P), limbs(2 * D * x * y % P)])
+            q = add(q, row_base)
+        rows.append(entries)
+        for _ in range(8):
+            row_base = add(row_base, row_base)
+    return rows
+
+
+def format_table(name, rows):
+    out = [f"static const int32_t {name}[32][8][3][10] PROGMEM = {{"]
+    for row in rows:
+        out.append("    {")
+        for entry in row:
+            fes = ", ".join("{" + ", ".join(str(v) for v in fe) + "}" for fe in entry)
+            out.append(f"        {{{fes}}},")
+        out.append("    },")
+    out.append("};")
+    return "\n".join(out)
+
+
+def generate(public_key_hex, path):
+    key = bytes.fromhex(public_key_hex)
+    if len(key) != 32:
+        raise ValueError("Ed25519 public key must be 32 bytes")
+
+    base_y = 4 * inv(5) % P
+    base = (recover_x(base_y, 0), base_y)
+    ax, ay = decode_point(key)
+    neg_key = ((P - ax) % P, ay)
+
+    text = "\n".join([
+        "// Generated by ed25519_tables.py, do not edit",
+        "#ifndef ED25519_TABLES_H",
+        "#define ED25519_TABLES_H",
+        "",
+        f'#define OTA_ED25519_TABLE_KEY "{public_key_hex.lower()}"',
+        "",
+        format_table("ED25519_BASE_TABLE", table(base)),
+        "",
+        format_table("ED25519_KEY_TABLE", table(neg_key)),
+        "",
+        "#endif // ED25519_TABLES_H",
+        "",
+    ])
+
+    # Leave an up-to-date header alone so it does not trigger a rebuild
+    if os.path.exists(path):
+        with open(path) as f:
+            if f.read() == text:
+                return
+    with open(path, "w") as f:
+        f.write(text)
+
+
+def configured_key(project_dir, defines):
+    for define in defines:
+        if isinstance(define, tuple) and define[0] == "PUBLIC_KEY_HEX":
+            return str(define[1]).strip('\\"')
+    with open(os.path.join(project_dir, "src", "config.h")) as f:
+        match = re.search(r'#define\s+PUBLIC_KEY_HEX\s+"([0-9a-fA-F]+)"', f.read())
+    if not match:
+        raise ValueError("PUBLIC_KEY_HEX not found in src/config.h")
+    return match.group(1)
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+except NameError:
+    env = None
+
+if env is not None:
+    out_dir = os.path.join(env.subst("$BUILD_DIR"), "generated")
+    os.makedirs(out_dir, exist_ok=True)
+    key_hex = configured_key(env.subst("$PROJECT_DIR"), env.get("CPPDEFINES", []))
+    generate(key_hex, os.path.join(out_dir, "ed25519_tables.h"))
+    env.Append(CPPPATH=[out_dir])
+elif __name__ == "__main__":
+    if len(sys.argv) != 3:
+        print(__doc__)
+        sys.exit(1)
+    generate(sys.argv[1], sys.argv[2])
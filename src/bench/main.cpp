@@ -0,0 +1,54 @@
+// Entry point of the benchmark envs. Runs OTABench once and prints one
+// ota/metrics-shaped JSON line per kernel:
+//
+//   pio run -e native_bench && .pio/build/native_bench/program > host.jsonl
+//   pio run -e esp12e_bench -t upload && pio device monitor | tee device.jsonl
+//
+// Compare two runs with tools/ota_bench_diff.py.
+#include <Arduino.h>
+#include "config.h"
+#include "ota_bench.h"
+
+class SerialPublisher : public OTAPublisher {
+public:
+    void loop() {}
+    bool publish(const char* topic, const char* payload) {
+        Serial.println(payload);
+        return true;
+    }
+    bool publish(const char* topic, const uint8_t* payload, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            Serial.printf("%02x", payload[i]);
+        }
+        Serial.println();
+        return true;
+    }
+};
+
+static bool runBench() {
+    SerialPublisher out;
+    OTABench bench(out);
+    bench.run();
+    return !bench.failed();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    Serial.begin(115200);
+    delay(100);
+    Serial.printf("\n[BENCH] Version %s, CPU %u MHz\n", FIRMWARE_VERSION, ESP.getCpuFreqMHz());
+    Serial.println(runBench() ? "[BENCH] Done" : "[BENCH] FAILED");
+}
+
+void loop() {
+    delay(1000);
+}
+
+#elif !defined(PIO_UNIT_TESTING)
+
+int main() {
+    return runBench() ? 0 : 1;
+}
+
+#endif
@@ -4,9 +4,12 @@
 // Firmware Configuration
 // FIRMWARE_VERSION is auto-generated by version_inject.py during build
 // FIRMWARE_ALGORITHM is auto-generated by version_inject.py during build
+#ifndef FIRMWARE_TLS
 #define FIRMWARE_TLS 1  // Set to 1 for HTTPS, 0 for HTTP
+#endif
 
-// OTA Server URLs
+// OTA Server URLs (the native env points them at a local server)
+#ifndef MANIFEST_URL
 #if FIRMWARE_TLS == 1
 #define MANIFEST_URL "https://ota.sinaungoding.com:8443/api/v1/firmware/manifest.json"
 #define FIRMWARE_URL "https://ota.sinaungoding.com:8443/api/v1/firmware/firmware-otaq.bin"
@@ -14,11 +17,16 @@
 #define MANIFEST_URL "http://broker.sinaungoding.com:8000/api/v1/firmware/manifest.json"
 #define FIRMWARE_URL "http://broker.sinaungoding.com:8000/api/v1/firmware/firmware-otaq.bin"
 #endif
+#endif
 
 // WiFi Configuration
 #define WIFI_SSID "Laatahdhob"
 #define WIFI_PASSWORD "janganmar4h"
 #define WIFI_CONNECT_TIMEOUT 30  // seconds
+#define WIFI_FAST_CONNECT_TIMEOUT 3000  // ms for the join on the cached BSSID/channel before falling back to a scan
+#ifndef WIFI_FAST_STATIC_IP
+#define WIFI_FAST_STATIC_IP 0  // Set to 1 to reuse the cached IP lease on a fast join (no DHCP) until its renewal time, 0 to always ask DHCP
+#endif
 
 // MQTT Configuration
 // TLS Note: When FIRMWARE_TLS=1, MQTT uses secure connection (MQTTS) with CA verification
@@ -45,24 +53,104 @@
 #define MQTT_TOPIC_OTA "device/002/ota/update"
 #define MQTT_TOPIC_METRICS "ota/metrics"
 #define MQTT_TOPIC_CPU "ota/cpu"
+#define MQTT_TOPIC_PROGRESS "ota/progress"
+#define MQTT_TOPIC_FW_REQUEST "device/002/ota/fw/request"
+#define MQTT_TOPIC_FW_CHUNK "device/002/ota/fw/chunk"
+#define MQTT_TOPIC_FW_ACK "device/002/ota/fw/ack"
+#define MQTT_TOPIC_CMD_UPDATE "device/002/cmd/update"  // any payload, same as "start" on MQTT_TOPIC_OTA
+#define MQTT_TOPIC_CMD_STATUS "device/002/cmd/status"  // answered on MQTT_TOPIC_STATUS
+#define MQTT_TOPIC_CMD_FLUSH "device/002/cmd/metrics-flush"  // publish queued ota/metrics records now
+#define MQTT_TOPIC_CMD_REBOOT "device/002/cmd/reboot"  // ignored while an update runs
+#define MQTT_TOPIC_STATUS "device/002/status"
+#define MQTT_TOPIC_TASKS "device/002/status/tasks"  // scheduler statistics, sent with each status reply
+#define MQTT_ROUTES_MAX 8  // topic filters MQTTHandler::route() can register
 #define MQTT_RECONNECT_INTERVAL 5000  // ms
 
+// MQTT outbox: publish() only queues, MQTTHandler::loop() sends. The rings
+// are static RAM, 2.5 KB by default: the normal ring holds one ota/metrics
+// batch (OTA_METRICS_BATCH_SIZE) next to the coalesced gauges and a task
+// report, the high ring a status reply or a firmware request with its ack.
+// What a longer broker outage needs is left to MQTT_OUTBOX_SPILL.
+#ifndef MQTT_OUTBOX_SIZE
+#define MQTT_OUTBOX_SIZE 2048  // bytes for normal messages, the oldest is dropped when full
+#endif
+#ifndef MQTT_OUTBOX_HIGH_SIZE
+#define MQTT_OUTBOX_HIGH_SIZE 512  // bytes for high priority messages (firmware requests, status replies)
+#endif
+#define MQTT_OUTBOX_BURST 4  // messages sent per loop()
+#define MQTT_OUTBOX_COALESCE 4  // queued gauge topics (ota/progress, ...) a newer message can replace
+#ifndef MQTT_OUTBOX_SPILL
+#define MQTT_OUTBOX_SPILL 0  // bytes of SPIFFS for messages that do not fit in RAM, 0 to drop them
+#endif
+#define MQTT_OUTBOX_SPILL_PATH "/mqtt.outbox"
+#define MQTT_FLUSH_TIMEOUT 2000  // ms spent sending the outbox before a restart
+
+// ota/metrics batching: stage records are kept in RAM and published together
+#ifndef OTA_METRICS_RING
+#define OTA_METRICS_RING 8  // stage records held between flushes, the oldest is dropped when full
+#endif
+#define OTA_METRICS_FIELDS 18  // most extra key/value fields one stage record takes
+#ifndef OTA_METRICS_FIELD_POOL
+#define OTA_METRICS_FIELD_POOL 48  // fields shared by the records held, 12 bytes each; the oldest records make room
+#endif
+#ifndef OTA_METRICS_BATCH_SIZE
+#define OTA_METRICS_BATCH_SIZE 1024  // bytes per published batch, reserved in the outbox while it is encoded
+#endif
+#define OTA_METRICS_FLUSH_INTERVAL 10000  // ms between flushes while an update runs; always flushed when it ends
+#ifndef OTA_METRICS_CBOR
+#define OTA_METRICS_CBOR 0  // Set to 1 to publish batches as CBOR instead of JSON
+#endif
+
+// Firmware over MQTT (manifest URLs "mqtt:<file>"), see ota_mqtt_transfer.h
+#define OTA_MQTT_CHUNK 1024  // data bytes per chunk message; with the header it must fit the MQTT packet buffer
+#define OTA_MQTT_WINDOW 4  // chunks in flight, the receive ring holds this many
+#define OTA_MQTT_RESPONSE_TIMEOUT 5000  // ms to wait for the first chunk of a request
+#define OTA_MQTT_RETRY 1000  // ms without data before the rest is re-requested
+
 // NTP Configuration
 #define NTP_SERVER1 "pool.ntp.org"
 #define NTP_SERVER2 "time.nist.gov"
 #define NTP_SERVER3 "time.google.com"
 #define NTP_TIMEZONE "JST-9"  // Change to "WIB-7" for Indonesia, "UTC0" for UTC
-#define NTP_SYNC_TIMEOUT 15  // seconds
+#define NTP_SYNC_TIMEOUT 15  // seconds after boot the boot timeline waits for SNTP before it is published without
+#define NTP_RTC_SAVE_INTERVAL 60000  // ms between copies of the synced clock to RTC memory (seed for the next restart)
 
 // OTA Configuration
+#ifndef OTA_CHECK_PERIODIC
+#define OTA_CHECK_PERIODIC 0  // Set to 1 to poll the manifest every OTA_CHECK_INTERVAL, 0 for MQTT trigger only
+#endif
 #define OTA_CHECK_INTERVAL 300000  // ms (5 minutes)
+#define OTA_CHECK_JITTER 30000  // ms of random delay added per check so a fleet does not poll in lockstep
+#define OTA_TICK_BUDGET 20  // ms of download, hashing and flashing per OTAUpdater::tick() before loop() gets control back
 #define OTA_DOWNLOAD_BUFFER 512  // bytes
+#define OTA_DELTA_COPY_SLICE 4096  // bytes a patch COPY rebuilds per tick(); a long one takes several ticks
+#ifndef OTA_ZERO_COPY
+#define OTA_ZERO_COPY 1  // Set to 1 to hash and flash straight from the network buffer (peekBuffer), 0 to always copy
+#endif
+#define OTA_ERASE_AHEAD 2  // flash sectors erased ahead of the write position while waiting for network data, 0 to erase on write
+#define OTA_STALL_TIMEOUT 10000  // ms without data before the connection is dropped
+#define OTA_STALL_THRESHOLD 250  // ms between two chunks counted as a stall in stream_chunks
+#define OTA_THROUGHPUT_WINDOW 1000  // ms over which the current download rate is measured
+#ifndef OTA_PROGRESS_INTERVAL
+#define OTA_PROGRESS_INTERVAL 0  // ms between ota/progress events while downloading, 0 to disable
+#endif
+#define OTA_RESUME_ATTEMPTS 5  // connections per update, each resuming with a Range request
+#define OTA_RESUME_BACKOFF 2000  // ms between reconnects
+#define OTA_JOURNAL_PATH "/ota.journal"  // SPIFFS progress journal for interrupted downloads
+#define OTA_JOURNAL_INTERVAL 16384  // bytes between journal checkpoints (multiple of 4096)
+#define OTA_VALIDATOR_PATH "/manifest.etag"  // SPIFFS copy of the last evaluated manifest's ETag/Last-Modified
+#define TLS_SESSION_CACHE_SIZE 3  // hosts with a resumable TLS session (OTA server, MQTT broker); beyond that the least recently connected host starts over
 
 // ED25519 Public Key (32 bytes = 64 hex characters, no spaces, no 0x prefix)
 // Format: Pure hex string "0bc12f3d..." NOT "0x0B, 0xC1, ..."
 // ba89c973ffb9836d7c3c9f0b6bc869455cdb6db33aa299c297fd1726f567abd9 -> private key
 #define PUBLIC_KEY_HEX "0bc12f3d718204686b669042d921c91db12f83340e80c4837892828051fafcd8"
 
+// ECDSA P-256 Public Key, used when FIRMWARE_ALGORITHM=ecdsa-p256
+// (65 bytes = 130 hex characters, uncompressed: 04 | X | Y)
+// 984b7acf121ce406c80dcba44baa866a5a35f14c3cc9162edc49cd176f35a078 -> private key
+#define ECDSA_PUBLIC_KEY_HEX "046bb26b21e9d717b91d7b0f54dbe2a56f0236bb5793ec96bb49bbe29817acaa218ede32d5ed4c4f1115ac9ab2f51e1bac9285e2d20ae2376a8de2f7fa59d20555"
+
 // TLS/SSL Certificates
 // CA certificates for MQTT and OTA are stored in certificates.h
 // Edit src/certificates.h to update CA certificates
@@ -70,4 +158,11 @@
 // Status Update Interval
 #define STATUS_UPDATE_INTERVAL 30000  // ms
 
+// Cooperative scheduler driving loop(), see task_scheduler.h
+#define SCHEDULER_TASKS_MAX 8  // tasks TaskScheduler::add() can register
+#define SCHEDULER_IDLE_SLICE 1  // ms slept at a time between checks for woken or ready tasks
+#define NET_SERVICE_INTERVAL 100  // ms between WiFi join / SNTP / boot timeline passes
+#define MQTT_SERVICE_INTERVAL 100  // ms between keepalive and reconnect passes; inbound messages run at once
+#define OTA_SERVICE_INTERVAL 1000  // ms between OTAUpdater::tick() calls while idle; every pass while an update runs
+
 #endif // CONFIG_H
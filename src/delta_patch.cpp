@@ -0,0 +1,178 @@
+#include "delta_patch.h"
+#include <string.h>
+
+// Chunk size for COPY reads from the base image (kept on the stack)
+#define DELTA_COPY_CHUNK 256
+
+DeltaPatch::DeltaPatch(ReadBaseFn readBase, WriteFn write, void* ctx)
+    : _readBase(readBase), _write(write), _ctx(ctx) {
+    reset();
+}
+
+void DeltaPatch::reset() {
+    _state = STATE_HEADER;
+    _headerLen = 0;
+    _varint = 0;
+    _varintShift = 0;
+    _copyDelta = 0;
+    _remaining = 0;
+    _copyOffset = 0;
+    _copyEnd = 0;
+    _baseSize = 0;
+    _targetSize = 0;
+    _produced = 0;
+    _error = nullptr;
+}
+
+bool DeltaPatch::feed(const uint8_t* data, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        if (_state == STATE_COPY_DATA && !pump(_remaining)) return false;
+        uint8_t b = data[i];
+        
+        switch (_state) {
+        case STATE_HEADER:
+            _header[_headerLen++] = b;
+            i++;
+            if (_headerLen == DELTA_HEADER_SIZE && !parseHeader()) return false;
+            break;
+        
+        case STATE_OP:
+            i++;
+            if (b == DELTA_OP_COPY) {
+                _state = STATE_COPY_OFFSET;
+            } else if (b == DELTA_OP_INSERT) {
+                _state = STATE_INSERT_LENGTH;
+            } else if (b == DELTA_OP_END) {
+                if (_produced != _targetSize) return fail("patch ended before target size");
+                _state = STATE_DONE;
+            } else {
+                return fail("unknown op");
+            }
+            break;
+        
+        case STATE_COPY_OFFSET: {
+            uint32_t zigzag;
+            i++;
+            if (!readVarint(b, zigzag)) break;
+            _copyDelta = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+            _state = STATE_COPY_LENGTH;
+            break;
+        }
+        
+        case STATE_COPY_LENGTH: {
+            uint32_t copyLen;
+            i++;
+            if (!readVarint(b, copyLen)) break;
+            if (!startCopy(_copyEnd + _copyDelta, copyLen)) return false;
+            break;
+        }
+        
+        case STATE_INSERT_LENGTH:
+            i++;
+            if (!readVarint(b, _remaining)) break;
+            _state = _remaining > 0 ? STATE_INSERT_DATA : STATE_OP;
+            break;
+        
+        case STATE_INSERT_DATA: {
+            size_t chunk = len - i;
+            if (chunk > _remaining) chunk = _remaining;
+            if (!emit(data + i, chunk)) return false;
+            i += chunk;
+            _remaining -= chunk;
+            if (_remaining == 0) _state = STATE_OP;
+            break;
+        }
+        
+        case STATE_COPY_DATA:
+            break;
+        
+        case STATE_DONE:
+            return fail("data after end of patch");
+        
+        case STATE_ERROR:
+            return false;
+        }
+        
+        if (_state == STATE_ERROR) return false;
+    }
+    return true;
+}
+
+size_t DeltaPatch::wanted() const {
+    switch (_state) {
+    case STATE_HEADER: return DELTA_HEADER_SIZE - _headerLen;
+    case STATE_INSERT_DATA: return _remaining;
+    case STATE_OP:
+    case STATE_COPY_OFFSET:
+    case STATE_COPY_LENGTH:
+    case STATE_INSERT_LENGTH: return 1;
+    default: return 0;
+    }
+}
+
+bool DeltaPatch::readVarint(uint8_t b, uint32_t& value) {
+    if (_varintShift > 28) {
+        fail("varint too long");
+        return false;
+    }
+    _varint |= (uint32_t)(b & 0x7F) << _varintShift;
+    _varintShift += 7;
+    if (b & 0x80) return false;
+    
+    value = _varint;
+    _varint = 0;
+    _varintShift = 0;
+    return true;
+}
+
+bool DeltaPatch::parseHeader() {
+    if (memcmp(_header, DELTA_MAGIC, 4) != 0) return fail("bad magic");
+    
+    _baseSize = _header[4] | (_header[5] << 8) | (_header[6] << 16) | ((uint32_t)_header[7] << 24);
+    _targetSize = _header[8] | (_header[9] << 8) | (_header[10] << 16) | ((uint32_t)_header[11] << 24);
+    if (_targetSize == 0) return fail("empty target");
+    
+    _state = STATE_OP;
+    return true;
+}
+
+bool DeltaPatch::startCopy(uint32_t offset, uint32_t len) {
+    if (offset > _baseSize || len > _baseSize - offset) return fail("copy outside base image");
+    
+    _copyOffset = offset;
+    _copyEnd = offset + len;
+    _remaining = len;
+    _state = len > 0 ? STATE_COPY_DATA : STATE_OP;
+    return true;
+}
+
+bool DeltaPatch::pump(size_t maxLen) {
+    if (_state != STATE_COPY_DATA) return _state != STATE_ERROR;
+    
+    uint8_t chunk[DELTA_COPY_CHUNK];
+    while (_remaining > 0 && maxLen > 0) {
+        size_t n = _remaining < maxLen ? _remaining : maxLen;
+        if (n > sizeof(chunk)) n = sizeof(chunk);
+        if (!_readBase(_ctx, _copyOffset, chunk, n)) return fail("base read failed");
+        if (!emit(chunk, n)) return false;
+        _copyOffset += n;
+        _remaining -= n;
+        maxLen -= n;
+    }
+    if (_remaining == 0) _state = STATE_OP;
+    return true;
+}
+
+bool DeltaPatch::emit(const uint8_t* data, size_t len) {
+    if (len > _targetSize - _produced) return fail("output exceeds target size");
+    if (!_write(_ctx, data, len)) return fail("output write failed");
+    _produced += len;
+    return true;
+}
+
+bool DeltaPatch::fail(const char* error) {
+    _error = error;
+    _state = STATE_ERROR;
+    return false;
+}
@@ -0,0 +1,92 @@
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Binary patch format shared by the device and tools/ota_delta.cpp.
+//
+//   header  "ODP1" | base_size (u32 LE) | target_size (u32 LE)
+//   ops     0x01 COPY    zigzag varint (src - end of previous copy), varint len
+//           0x02 INSERT  varint len, len literal bytes
+//           0x00 END
+//
+// Lengths are LEB128 varints. COPY reads from the base image, so a patch
+// only carries the bytes that actually changed.
+#define DELTA_MAGIC "ODP1"
+#define DELTA_HEADER_SIZE 12
+#define DELTA_OP_END 0x00
+#define DELTA_OP_COPY 0x01
+#define DELTA_OP_INSERT 0x02
+
+// Streaming patch applier. Patch bytes may arrive in chunks of any size;
+// output is produced in order through the write callback.
+//
+// A COPY can rebuild hundreds of KB from a few patch bytes, so feed() only
+// starts it: a caller on a time budget runs it with pump() in slices and
+// feeds no more than wanted() bytes at a time. Bytes fed while a COPY is
+// still pending finish it first, in one go.
+class DeltaPatch {
+public:
+    typedef bool (*ReadBaseFn)(void* ctx, uint32_t offset, uint8_t* out, size_t len);
+    typedef bool (*WriteFn)(void* ctx, const uint8_t* data, size_t len);
+    
+    DeltaPatch(ReadBaseFn readBase, WriteFn write, void* ctx);
+    
+    void reset();
+    bool feed(const uint8_t* data, size_t len);
+    
+    // Runs up to `maxLen` bytes of the pending COPY
+    bool pump(size_t maxLen);
+    bool copying() const { return _state == STATE_COPY_DATA; }
+    
+    // Patch bytes that can be fed before a COPY may be pending: the rest of
+    // the header or of an INSERT, 1 while parsing ops, 0 while copying
+    size_t wanted() const;
+    
+    bool headerParsed() const { return _state > STATE_HEADER; }
+    bool finished() const { return _state == STATE_DONE; }
+    uint32_t baseSize() const { return _baseSize; }
+    uint32_t targetSize() const { return _targetSize; }
+    uint32_t produced() const { return _produced; }
+    const char* error() const { return _error; }
+
+private:
+    enum State {
+        STATE_HEADER,
+        STATE_OP,
+        STATE_COPY_OFFSET,
+        STATE_COPY_LENGTH,
+        STATE_COPY_DATA,
+        STATE_INSERT_LENGTH,
+        STATE_INSERT_DATA,
+        STATE_DONE,
+        STATE_ERROR
+    };
+    
+    ReadBaseFn _readBase;
+    WriteFn _write;
+    void* _ctx;
+    
+    State _state;
+    uint8_t _header[DELTA_HEADER_SIZE];
+    size_t _headerLen;
+    uint32_t _varint;
+    uint8_t _varintShift;
+    int32_t _copyDelta;
+    uint32_t _remaining;        // of the INSERT or COPY in progress
+    uint32_t _copyOffset;       // next base byte of the COPY
+    uint32_t _copyEnd;
+    uint32_t _baseSize;
+    uint32_t _targetSize;
+    uint32_t _produced;
+    const char* _error;
+    
+    bool readVarint(uint8_t b, uint32_t& value);
+    bool parseHeader();
+    bool startCopy(uint32_t offset, uint32_t len);
+    bool emit(const uint8_t* data, size_t len);
+    bool fail(const char* error);
+};
+
+#endif // DELTA_PATCH_H
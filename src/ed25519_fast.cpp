@@ -0,0 +1,357 @@
+#include "ed25519_fast.h"
+#include "ota_signature.h"
+#include <Arduino.h>
+#include <bearssl/bearssl_hash.h>
+#include <string.h>
+
+// Generated into the build directory by ed25519_tables.py
+#include "ed25519_tables.h"
+
+static_assert(otaStrEqual(OTA_ED25519_TABLE_KEY, PUBLIC_KEY_HEX),
+              "ed25519_tables.h was generated for a different PUBLIC_KEY_HEX");
+
+// Field elements mod 2^255 - 19 in ten signed limbs of 26 and 25 bits
+// alternately (limb i sits at bit ceil(25.5 * i)), as in the ref10
+// reference code. Every operation returns carried limbs, which keeps the
+// 64-bit accumulators in fe_mul far from overflowing.
+typedef int32_t fe[10];
+
+static inline int limbBits(int i) {
+    return (i & 1) ? 25 : 26;
+}
+
+static void fe_carry(fe h, int64_t* t) {
+    for (int i = 0; i < 10; i++) {
+        int bits = limbBits(i);
+        int64_t carry = (t[i] + ((int64_t)1 << (bits - 1))) >> bits;
+        t[i] -= carry * ((int64_t)1 << bits);
+        if (i < 9) {
+            t[i + 1] += carry;
+        } else {
+            t[0] += carry * 19;
+        }
+    }
+    int64_t carry = (t[0] + ((int64_t)1 << 25)) >> 26;
+    t[0] -= carry * ((int64_t)1 << 26);
+    t[1] += carry;
+    
+    for (int i = 0; i < 10; i++) {
+        h[i] = (int32_t)t[i];
+    }
+}
+
+static void fe_copy(fe h, const fe f) {
+    memcpy(h, f, sizeof(fe));
+}
+
+static void fe_set(fe h, int32_t v) {
+    memset(h, 0, sizeof(fe));
+    h[0] = v;
+}
+
+static void fe_add(fe h, const fe f, const fe g) {
+    int64_t t[10];
+    for (int i = 0; i < 10; i++) {
+        t[i] = (int64_t)f[i] + g[i];
+    }
+    fe_carry(h, t);
+}
+
+static void fe_sub(fe h, const fe f, const fe g) {
+    int64_t t[10];
+    for (int i = 0; i < 10; i++) {
+        t[i] = (int64_t)f[i] - g[i];
+    }
+    fe_carry(h, t);
+}
+
+static void fe_neg(fe h, const fe f) {
+    for (int i = 0; i < 10; i++) {
+        h[i] = -f[i];
+    }
+}
+
+static void fe_mul(fe h, const fe f, const fe g) {
+    int64_t t[19] = {0};
+    for (int i = 0; i < 10; i++) {
+        for (int j = 0; j < 10; j++) {
+            int64_t m = (int64_t)f[i] * g[j];
+            // Two odd limbs sit half a bit further up than limb i + j
+            t[i + j] += (i & j & 1) ? 2 * m : m;
+        }
+    }
+    // 2^255 = 19 (mod p)
+    for (int k = 18; k >= 10; k--) {
+        t[k - 10] += 19 * t[k];
+    }
+    fe_carry(h, t);
+}
+
+static void fe_sq(fe h, const fe f) {
+    fe_mul(h, f, f);
+}
+
+static void fe_sqn(fe h, const fe f, int n) {
+    fe_sq(h, f);
+    for (int i = 1; i < n; i++) {
+        fe_sq(h, h);
+    }
+}
+
+// z^(p - 2), with the addition chain from ref10
+static void fe_invert(fe out, const fe z) {
+    fe t0, t1, t2, t3;
+    fe_sq(t0, z);
+    fe_sqn(t1, t0, 2);
+    fe_mul(t1, z, t1);
+    fe_mul(t0, t0, t1);
+    fe_sq(t2, t0);
+    fe_mul(t1, t1, t2);
+    fe_sqn(t2, t1, 5);
+    fe_mul(t1, t2, t1);
+    fe_sqn(t2, t1, 10);
+    fe_mul(t2, t2, t1);
+    fe_sqn(t3, t2, 20);
+    fe_mul(t2, t3, t2);
+    fe_sqn(t2, t2, 10);
+    fe_mul(t1, t2, t1);
+    fe_sqn(t2, t1, 50);
+    fe_mul(t2, t2, t1);
+    fe_sqn(t3, t2, 100);
+    fe_mul(t2, t3, t2);
+    fe_sqn(t2, t2, 50);
+    fe_mul(t1, t2, t1);
+    fe_sqn(t1, t1, 5);
+    fe_mul(out, t1, t0);
+}
+
+// Canonical little-endian encoding (fully reduced mod p)
+static void fe_tobytes(uint8_t* s, const fe f) {
+    int32_t h[10];
+    memcpy(h, f, sizeof(h));
+    
+    int32_t q = (19 * h[9] + ((int32_t)1 << 24)) >> 25;
+    for (int i = 0; i < 10; i++) {
+        q = (h[i] + q) >> limbBits(i);
+    }
+    h[0] += 19 * q;
+    for (int i = 0; i < 9; i++) {
+        int bits = limbBits(i);
+        int32_t carry = h[i] >> bits;
+        h[i + 1] += carry;
+        h[i] -= carry * ((int32_t)1 << bits);
+    }
+    h[9] &= ((int32_t)1 << 25) - 1;
+    
+    memset(s, 0, 32);
+    int offset = 0;
+    for (int i = 0; i < 10; i++) {
+        uint64_t v = (uint64_t)(uint32_t)h[i] << (offset & 7);
+        for (int k = offset >> 3; k < 32 && v; k++) {
+            s[k] |= (uint8_t)v;
+            v >>= 8;
+        }
+        offset += limbBits(i);
+    }
+}
+
+// Extended coordinates (X:Y:Z:T) with x = X/Z, y = Y/Z, xy = T/Z
+struct GeP3 { fe X, Y, Z, T; };
+// Projective (X:Y:Z), enough for doubling
+struct GeP2 { fe X, Y, Z; };
+// Completed ((X:Z), (Y:T)), the output of additions and doublings
+struct GeP1P1 { fe X, Y, Z, T; };
+// Table entry: (y + x, y - x, 2dxy) of an affine point
+struct GePrecomp { fe yplusx, yminusx, xy2d; };
+
+static void ge_p1p1_to_p2(GeP2& r, const GeP1P1& p) {
+    fe_mul(r.X, p.X, p.T);
+    fe_mul(r.Y, p.Y, p.Z);
+    fe_mul(r.Z, p.Z, p.T);
+}
+
+static void ge_p1p1_to_p3(GeP3& r, const GeP1P1& p) {
+    fe_mul(r.X, p.X, p.T);
+    fe_mul(r.Y, p.Y, p.Z);
+    fe_mul(r.Z, p.Z, p.T);
+    fe_mul(r.T, p.X, p.Y);
+}
+
+static void ge_p2_dbl(GeP1P1& r, const GeP2& p) {
+    fe t0;
+    fe_sq(r.X, p.X);
+    fe_sq(r.Z, p.Y);
+    fe_sq(r.T, p.Z);
+    fe_add(r.T, r.T, r.T);
+    fe_add(r.Y, p.X, p.Y);
+    fe_sq(t0, r.Y);
+    fe_add(r.Y, r.Z, r.X);
+    fe_sub(r.Z, r.Z, r.X);
+    fe_sub(r.X, t0, r.Y);
+    fe_sub(r.T, r.T, r.Z);
+}
+
+static void ge_madd(GeP1P1& r, const GeP3& p, const GePrecomp& q) {
+    fe t0;
+    fe_add(r.X, p.Y, p.X);
+    fe_sub(r.Y, p.Y, p.X);
+    fe_mul(r.Z, r.X, q.yplusx);
+    fe_mul(r.Y, r.Y, q.yminusx);
+    fe_mul(r.T, q.xy2d, p.T);
+    fe_add(t0, p.Z, p.Z);
+    fe_sub(r.X, r.Z, r.Y);
+    fe_add(r.Y, r.Z, r.Y);
+    fe_add(r.Z, t0, r.T);
+    fe_sub(r.T, t0, r.T);
+}
+
+static void ge_tobytes(uint8_t* s, const GeP3& p) {
+    fe recip, x, y;
+    uint8_t xBytes[32];
+    fe_invert(recip, p.Z);
+    fe_mul(x, p.X, recip);
+    fe_mul(y, p.Y, recip);
+    fe_tobytes(s, y);
+    fe_tobytes(xBytes, x);
+    s[31] ^= (xBytes[0] & 1) << 7;
+}
+
+// h += digit * 256^row * P, digit in [-8, 8], from the table for P
+static void addDigit(GeP3& h, const int32_t (*table)[8][3][10], int row, int8_t digit) {
+    if (digit == 0) return;
+    
+    GePrecomp entry;
+    int index = (digit < 0 ? -digit : digit) - 1;
+    memcpy_P(&entry, table[row][index], sizeof(entry));
+    if (digit < 0) {
+        // -(x, y) = (-x, y): swap y + x and y - x, negate 2dxy
+        fe tmp;
+        fe_copy(tmp, entry.yplusx);
+        fe_copy(entry.yplusx, entry.yminusx);
+        fe_copy(entry.yminusx, tmp);
+        fe_neg(entry.xy2d, entry.xy2d);
+    }
+    
+    GeP1P1 sum;
+    ge_madd(sum, h, entry);
+    ge_p1p1_to_p3(h, sum);
+}
+
+// Signed radix-16 digits in [-8, 8]; needs a[31] <= 127
+static void toRadix16(int8_t* e, const uint8_t* a) {
+    for (int i = 0; i < 32; i++) {
+        e[2 * i] = a[i] & 15;
+        e[2 * i + 1] = (a[i] >> 4) & 15;
+    }
+    int8_t carry = 0;
+    for (int i = 0; i < 63; i++) {
+        e[i] += carry;
+        carry = (e[i] + 8) >> 4;
+        e[i] -= carry * 16;
+    }
+    e[63] += carry;
+}
+
+// Group order L = 2^252 + 27742317777372353535851937790883648493
+static const uint8_t GROUP_ORDER[32] = {
+    0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
+};
+
+// Reduces a 512-bit little-endian number mod L (TweetNaCl's modL)
+static void reduceModL(uint8_t* r, const uint8_t* wide) {
+    int64_t x[64];
+    for (int i = 0; i < 64; i++) {
+        x[i] = wide[i];
+    }
+    
+    for (int i = 63; i >= 32; i--) {
+        int64_t carry = 0;
+        int j;
+        for (j = i - 32; j < i - 12; j++) {
+            x[j] += carry - 16 * x[i] * GROUP_ORDER[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+        x[j] += carry;
+        x[i] = 0;
+    }
+    
+    int64_t carry = 0;
+    for (int j = 0; j < 32; j++) {
+        x[j] += carry - (x[31] >> 4) * GROUP_ORDER[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+    for (int j = 0; j < 32; j++) {
+        x[j] -= carry * GROUP_ORDER[j];
+    }
+    for (int i = 0; i < 32; i++) {
+        x[i + 1] += x[i] >> 8;
+        r[i] = x[i] & 255;
+    }
+}
+
+// S must be below L, otherwise (R, S + L) would verify too
+static bool scalarIsCanonical(const uint8_t* s) {
+    for (int i = 31; i >= 0; i--) {
+        if (s[i] < GROUP_ORDER[i]) return true;
+        if (s[i] > GROUP_ORDER[i]) return false;
+    }
+    return false;
+}
+
+bool Ed25519Fast::verify(const uint8_t* signature, const void* message, size_t len) {
+    const uint8_t* R = signature;
+    const uint8_t* S = signature + 32;
+    if (!scalarIsCanonical(S)) {
+        return false;
+    }
+    
+    // k = SHA-512(R | A | M) mod L
+    uint8_t wide[64];
+    uint8_t k[32];
+    br_sha512_context ctx;
+    br_sha512_init(&ctx);
+    br_sha512_update(&ctx, R, 32);
+    br_sha512_update(&ctx, OTA_ED25519_KEY.bytes, 32);
+    br_sha512_update(&ctx, message, len);
+    br_sha512_out(&ctx, wide);
+    reduceModL(k, wide);
+    
+    int8_t sDigits[64];
+    int8_t kDigits[64];
+    toRadix16(sDigits, S);
+    toRadix16(kDigits, k);
+    
+    // [S]B + [k](-A): odd digits first, times 16, then the even digits
+    GeP3 h;
+    fe_set(h.X, 0);
+    fe_set(h.Y, 1);
+    fe_set(h.Z, 1);
+    fe_set(h.T, 0);
+    for (int i = 1; i < 64; i += 2) {
+        addDigit(h, ED25519_BASE_TABLE, i / 2, sDigits[i]);
+        addDigit(h, ED25519_KEY_TABLE, i / 2, kDigits[i]);
+    }
+    
+    GeP2 p2;
+    GeP1P1 p1;
+    fe_copy(p2.X, h.X);
+    fe_copy(p2.Y, h.Y);
+    fe_copy(p2.Z, h.Z);
+    for (int i = 0; i < 4; i++) {
+        ge_p2_dbl(p1, p2);
+        if (i < 3) ge_p1p1_to_p2(p2, p1);
+    }
+    ge_p1p1_to_p3(h, p1);
+    
+    for (int i = 0; i < 64; i += 2) {
+        addDigit(h, ED25519_BASE_TABLE, i / 2, sDigits[i]);
+        addDigit(h, ED25519_KEY_TABLE, i / 2, kDigits[i]);
+    }
+    
+    uint8_t check[32];
+    ge_tobytes(check, h);
+    return memcmp(check, R, 32) == 0;
+}
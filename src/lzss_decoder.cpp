@@ -0,0 +1,149 @@
+#include "lzss_decoder.h"
+#include <stdlib.h>
+#include <string.h>
+
+LzssDecoder::LzssDecoder(WriteFn write, void* ctx)
+    : _write(write), _ctx(ctx), _window(nullptr) {
+    reset();
+}
+
+LzssDecoder::~LzssDecoder() {
+    free(_window);
+}
+
+void LzssDecoder::reset() {
+    free(_window);
+    _window = nullptr;
+    _state = STATE_HEADER;
+    _headerLen = 0;
+    _windowBits = 0;
+    _lookaheadBits = 0;
+    _originalSize = 0;
+    _produced = 0;
+    _mask = 0;
+    _head = 0;
+    _pending = 0;
+    _index = 0;
+    _inByte = 0;
+    _inBits = 0;
+    _acc = 0;
+    _accBits = 0;
+    _error = nullptr;
+}
+
+bool LzssDecoder::feed(const uint8_t* data, size_t len) {
+    const uint8_t* end = data + len;
+    
+    while (_state == STATE_HEADER && data < end) {
+        _header[_headerLen++] = *data++;
+        if (_headerLen == LZSS_HEADER_SIZE && !parseHeader()) return false;
+    }
+    
+    uint16_t value;
+    while (_state != STATE_DONE && _state != STATE_ERROR) {
+        if (_state == STATE_TAG) {
+            if (!takeBits(data, end, 1, value)) break;
+            _state = value ? STATE_LITERAL : STATE_INDEX;
+        } else if (_state == STATE_LITERAL) {
+            if (!takeBits(data, end, 8, value)) break;
+            if (!put((uint8_t)value)) return false;
+            if (_state != STATE_DONE) _state = STATE_TAG;
+        } else if (_state == STATE_INDEX) {
+            if (!takeBits(data, end, _windowBits, value)) break;
+            _index = value;
+            _state = STATE_COUNT;
+        } else if (_state == STATE_COUNT) {
+            if (!takeBits(data, end, _lookaheadBits, value)) break;
+            
+            uint32_t distance = (uint32_t)_index + 1;
+            if (distance > _produced) return fail("reference before start of output");
+            
+            for (uint32_t i = 0; i <= value; i++) {
+                if (!put(_window[(_head - distance) & _mask])) return false;
+                if (_state == STATE_DONE) break;
+            }
+            if (_state != STATE_DONE) _state = STATE_TAG;
+        }
+    }
+    
+    if (_state == STATE_ERROR) return false;
+    return flush();
+}
+
+bool LzssDecoder::parseHeader() {
+    if (memcmp(_header, LZSS_MAGIC, 4) != 0) return fail("bad magic");
+    
+    _windowBits = _header[4];
+    _lookaheadBits = _header[5];
+    _originalSize = _header[8] | (_header[9] << 8) | (_header[10] << 16) | ((uint32_t)_header[11] << 24);
+    
+    if (_windowBits < LZSS_MIN_WINDOW_BITS || _windowBits > LZSS_MAX_WINDOW_BITS ||
+        _lookaheadBits < 1 || _lookaheadBits > LZSS_MAX_LOOKAHEAD_BITS || _lookaheadBits >= _windowBits) {
+        return fail("unsupported window");
+    }
+    if (_originalSize == 0) return fail("empty stream");
+    
+    _window = (uint8_t*)malloc((size_t)1 << _windowBits);
+    if (!_window) return fail("out of memory for window");
+    _mask = (uint16_t)((1u << _windowBits) - 1);
+    
+    _state = STATE_TAG;
+    return true;
+}
+
+bool LzssDecoder::takeBits(const uint8_t*& data, const uint8_t* end, uint8_t count, uint16_t& value) {
+    while (_accBits < count) {
+        if (_inBits == 0) {
+            if (data == end) return false;
+            _inByte = *data++;
+            _inBits = 8;
+        }
+        
+        // Move as many bits as both sides allow in one step
+        uint8_t take = count - _accBits;
+        if (take > _inBits) take = _inBits;
+        uint8_t bits = (_inByte >> (_inBits - take)) & ((1u << take) - 1);
+        _acc = (_acc << take) | bits;
+        _accBits += take;
+        _inBits -= take;
+    }
+    
+    value = _acc;
+    _acc = 0;
+    _accBits = 0;
+    return true;
+}
+
+bool LzssDecoder::put(uint8_t b) {
+    // Bytes leave through the window itself; flush before overwriting unsent ones
+    if (_pending > _mask && !flush()) return false;
+    
+    _window[_head] = b;
+    _head = (_head + 1) & _mask;
+    _pending++;
+    
+    if (++_produced == _originalSize) {
+        _state = STATE_DONE;
+    }
+    return true;
+}
+
+bool LzssDecoder::flush() {
+    if (_pending == 0) return true;
+    
+    uint16_t start = (_head - _pending) & _mask;
+    size_t first = (size_t)_mask + 1 - start;
+    if (first > _pending) first = _pending;
+    
+    if (!_write(_ctx, _window + start, first)) return fail("output write failed");
+    if (_pending > first && !_write(_ctx, _window, _pending - first)) return fail("output write failed");
+    
+    _pending = 0;
+    return true;
+}
+
+bool LzssDecoder::fail(const char* error) {
+    _error = error;
+    _state = STATE_ERROR;
+    return false;
+}
@@ -0,0 +1,79 @@
+#ifndef LZSS_DECODER_H
+#define LZSS_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// LZSS stream format shared by the device and tools/ota_compress.cpp.
+//
+//   header  "LZS1" | window_bits (u8) | lookahead_bits (u8) | 0 (u16) | original_size (u32 LE)
+//   body    MSB-first bitstream, heatshrink style:
+//           1 + 8 bits               literal byte
+//           0 + W bits + L bits      back-reference, distance-1 and length-1
+//
+// The decoder needs 2^window_bits bytes of RAM and nothing else.
+#define LZSS_MAGIC "LZS1"
+#define LZSS_HEADER_SIZE 12
+#define LZSS_MIN_WINDOW_BITS 4
+#define LZSS_MAX_WINDOW_BITS 12
+#define LZSS_MAX_LOOKAHEAD_BITS 8
+
+class LzssDecoder {
+public:
+    typedef bool (*WriteFn)(void* ctx, const uint8_t* data, size_t len);
+    
+    LzssDecoder(WriteFn write, void* ctx);
+    ~LzssDecoder();
+    
+    void reset();
+    bool feed(const uint8_t* data, size_t len);
+    
+    bool headerParsed() const { return _state > STATE_HEADER; }
+    bool finished() const { return _state == STATE_DONE; }
+    uint32_t originalSize() const { return _originalSize; }
+    uint32_t produced() const { return _produced; }
+    size_t windowSize() const { return _window ? _mask + 1 : 0; }
+    const char* error() const { return _error; }
+    
+private:
+    enum State {
+        STATE_HEADER,
+        STATE_TAG,
+        STATE_LITERAL,
+        STATE_INDEX,
+        STATE_COUNT,
+        STATE_DONE,
+        STATE_ERROR
+    };
+    
+    WriteFn _write;
+    void* _ctx;
+    
+    State _state;
+    uint8_t _header[LZSS_HEADER_SIZE];
+    size_t _headerLen;
+    uint8_t _windowBits;
+    uint8_t _lookaheadBits;
+    uint32_t _originalSize;
+    uint32_t _produced;
+    
+    uint8_t* _window;
+    uint16_t _mask;
+    uint16_t _head;
+    uint16_t _pending;
+    uint16_t _index;
+    
+    uint8_t _inByte;
+    uint8_t _inBits;
+    uint16_t _acc;
+    uint8_t _accBits;
+    const char* _error;
+    
+    bool parseHeader();
+    bool takeBits(const uint8_t*& data, const uint8_t* end, uint8_t count, uint16_t& value);
+    bool put(uint8_t b);
+    bool flush();
+    bool fail(const char* error);
+};
+
+#endif // LZSS_DECODER_H
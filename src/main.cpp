@@ -5,19 +5,213 @@
 #include "ntp_sync.h"
 #include "mqtt_handler.h"
 #include "ota_updater.h"
+#include "ota_clock.h"
+#include "task_scheduler.h"
 
 // Global objects
 WiFiManager wifiManager;
 NTPSync ntpSync;
 MQTTHandler mqttHandler;
 OTAUpdater otaUpdater;
+TaskScheduler scheduler;
 
-// OTA control flag
+// Task ids, registered in setup()
+int otaTask = -1;
+int statusTask = -1;
+int flushTask = -1;
+int rebootTask = -1;
+
+// Set by the update command, acted on by the OTA task
 volatile bool ota_flag = false;
 
-// OTA trigger callback
-void onOTATrigger() {
+// MQTT routes. The payload is a view of PubSubClient's buffer, valid only
+// during the call. Commands only wake their task, which runs on the next
+// scheduler pass.
+
+// OTA trigger: "start", or manifest.json itself, which is parsed before
+// PubSubClient reuses its buffer; the update starts on the next tick()
+void onOTATrigger(const char* topic, const uint8_t* payload, size_t length) {
+    if (length > 0 && payload[0] == '{') {
+        Serial.println("[MQTT] OTA update triggered with manifest");
+        otaUpdater.checkManifest(payload, length);
+        scheduler.wake(otaTask);
+    } else if (length == 5 && memcmp(payload, "start", 5) == 0) {
+        Serial.println("[MQTT] OTA update triggered!");
+        ota_flag = true;
+        scheduler.wake(otaTask);
+    } else {
+        Serial.printf("[MQTT] Unknown OTA trigger (%u bytes)\n", (unsigned)length);
+    }
+}
+
+void onFirmwareChunk(const char* topic, const uint8_t* payload, size_t length) {
+    otaUpdater.mqttTransfer().onChunk(payload, length);
+}
+
+void onUpdateCommand(const char* topic, const uint8_t* payload, size_t length) {
+    Serial.println("[MQTT] Command: update");
     ota_flag = true;
+    scheduler.wake(otaTask);
+}
+
+void onStatusCommand(const char* topic, const uint8_t* payload, size_t length) {
+    Serial.println("[MQTT] Command: status");
+    scheduler.wake(statusTask);
+}
+
+void onFlushCommand(const char* topic, const uint8_t* payload, size_t length) {
+    Serial.println("[MQTT] Command: metrics-flush");
+    scheduler.wake(flushTask);
+}
+
+void onRebootCommand(const char* topic, const uint8_t* payload, size_t length) {
+    Serial.println("[MQTT] Command: reboot");
+    scheduler.wake(rebootTask);
+}
+
+void publishStatus() {
+    const MQTTOutbox& outbox = mqttHandler.outbox();
+    char payload[448];
+    snprintf(payload, sizeof(payload),
+             "{\"version\":\"%s\",\"state\":\"%s\",\"progress\":%u,\"free_heap\":%u,\"uptime_ms\":%lu,\"rssi\":%d,"
+             "\"wifi_connect_ms\":%lu,\"wifi_fast\":%s,"
+             "\"outbox_depth\":%u,\"outbox_spill_bytes\":%u,\"outbox_sent\":%u,\"outbox_dropped\":%u,"
+             "\"outbox_coalesced\":%u,\"outbox_spilled\":%u,\"outbox_max_latency_ms\":%u,\"outbox_avg_latency_ms\":%u}",
+             FIRMWARE_VERSION, OTAUpdater::stateName(otaUpdater.state()), otaUpdater.progress(),
+             (unsigned)otaFreeHeap(), millis(), otaRssi(),
+             wifiManager.connectMs(), wifiManager.fastConnected() ? "true" : "false",
+             outbox.depth(), (unsigned)outbox.spillBacklog(), (unsigned)outbox.sent(), (unsigned)outbox.dropped(),
+             (unsigned)outbox.coalesced(), (unsigned)outbox.spilled(), (unsigned)outbox.maxLatencyMs(),
+             (unsigned)outbox.avgLatencyMs());
+    mqttHandler.publish(MQTT_TOPIC_STATUS, payload);
+}
+
+// Per-task run time and lateness (us) since the last report, on its own
+// topic: it does not fit the high priority ring with the status reply. Tasks
+// that do not fit one message go out in a further part ("part": 1, ...), and
+// the statistics are only reset once every part has been queued.
+void publishTasks() {
+    char payload[512];
+    char entry[160];
+    bool queued = true;
+    uint8_t part = 0;
+    int len = snprintf(payload, sizeof(payload), "{\"part\":0,\"slept_ms\":%u,\"tasks\":[",
+                       (unsigned)scheduler.sleptMs());
+    for (uint8_t i = 0; i < scheduler.count(); i++) {
+        const TaskStats& stats = scheduler.stats(i);
+        int n = snprintf(entry, sizeof(entry),
+                         "{\"name\":\"%s\",\"runs\":%u,\"run_avg_us\":%u,\"run_max_us\":%u,"
+                         "\"late_avg_us\":%u,\"late_max_us\":%u}",
+                         scheduler.name(i), (unsigned)stats.runs,
+                         (unsigned)(stats.runs ? stats.runTotalUs / stats.runs : 0), (unsigned)stats.runMaxUs,
+                         (unsigned)(stats.lateRuns ? stats.lateTotalUs / stats.lateRuns : 0),
+                         (unsigned)stats.lateMaxUs);
+        
+        // Room for the separator and the closing "]}"
+        if (len + 1 + n + 2 >= (int)sizeof(payload)) {
+            memcpy(payload + len, "]}", 3);
+            queued = mqttHandler.publish(MQTT_TOPIC_TASKS, payload) && queued;
+            len = snprintf(payload, sizeof(payload), "{\"part\":%u,\"tasks\":[", ++part);
+        } else if (payload[len - 1] != '[') {
+            payload[len++] = ',';
+        }
+        memcpy(payload + len, entry, n + 1);
+        len += n;
+    }
+    memcpy(payload + len, "]}", 3);
+    queued = mqttHandler.publish(MQTT_TOPIC_TASKS, payload) && queued;
+    
+    if (queued) {
+        scheduler.resetStats();
+    } else {
+        Serial.println("[APP] Task statistics not queued, kept for the next report");
+    }
+}
+
+// Records the boot phases as they complete. The timeline is published once
+// MQTT is up and SNTP has synced, or NTP_SYNC_TIMEOUT has passed without it.
+void trackBoot() {
+    static bool ready = false;
+    if (ready) return;
+    
+    if (wifiManager.joined()) {
+        otaUpdater.bootPhase(BOOT_WIFI, wifiManager.fastConnected() ? "fast" : "scan");
+    }
+    if (otaClockValid()) {
+        otaUpdater.bootPhase(BOOT_CLOCK, otaClockSourceName(otaClockSource()));
+    }
+    if (ntpSync.synced()) {
+        otaUpdater.bootPhase(BOOT_NTP);
+    }
+    if (mqttHandler.isConnected()) {
+        otaUpdater.bootPhase(BOOT_MQTT);
+    }
+    
+    if (otaUpdater.bootReached(BOOT_MQTT) &&
+        (otaUpdater.bootReached(BOOT_NTP) || millis() >= NTP_SYNC_TIMEOUT * 1000UL)) {
+        ready = true;
+        otaUpdater.bootReady();
+    }
+}
+
+// Tasks
+
+// WiFi join, SNTP and the boot timeline
+void netTask() {
+    wifiManager.loop();
+    ntpSync.loop();
+    trackBoot();
+}
+
+// Keepalive and reconnects on the period, messages as soon as they arrive
+void mqttTask() {
+    mqttHandler.loop();
+}
+
+bool mqttReady() {
+    return mqttHandler.pending();
+}
+
+// Check for OTA updates; the update itself runs a slice per tick() and keeps
+// the task ready until it ends. The periodic check is timed inside tick().
+void otaTaskRun() {
+    if (ota_flag) {
+        ota_flag = false;
+        otaUpdater.checkForUpdates();
+    }
+    otaUpdater.tick();
+}
+
+bool otaReady() {
+    return otaUpdater.busy();
+}
+
+void statusTaskRun() {
+    publishStatus();
+    publishTasks();
+}
+
+void flushTaskRun() {
+    otaUpdater.flushMetrics();
+}
+
+void rebootTaskRun() {
+    if (otaUpdater.busy()) {
+        Serial.println("[APP] Reboot ignored, an update is running");
+    } else {
+        Serial.println("[APP] Rebooting...");
+        mqttHandler.flush(MQTT_FLUSH_TIMEOUT);
+        ESP.restart();
+    }
+}
+
+void heartbeatTask() {
+    if (otaUpdater.busy()) {
+        Serial.printf("[APP] Running... (OTA %s, %u%%)\n",
+                      OTAUpdater::stateName(otaUpdater.state()), otaUpdater.progress());
+    } else {
+        Serial.println("[APP] Running...");
+    }
 }
 
 void setup() {
@@ -32,6 +226,9 @@ void setup() {
     Serial.println("TLS: Disabled (Insecure Connection)");
     #endif
     
+    // Pick up the timeline of the update that restarted into this image
+    otaUpdater.beginBoot();
+    
     // Initialize SPIFFS
     if (!SPIFFS.begin()) {
         Serial.println("Failed to mount SPIFFS, formatting...");
@@ -43,39 +240,40 @@ void setup() {
     SPIFFS.info(fs_info);
     Serial.printf("SPIFFS: total=%d, used=%d bytes\n", fs_info.totalBytes, fs_info.usedBytes);
     
-    // Connect to WiFi
-    wifiManager.connect();
-    
-    // Initialize NTP
-    ntpSync.initialize();
+    // Nothing below waits: the clock is seeded from RTC memory, WiFi joins,
+    // SNTP syncs and MQTT connects in the background, each as soon as it can
+    // (see trackBoot())
+    ntpSync.begin();
+    wifiManager.begin();
     
     // Setup MQTT
+#if FIRMWARE_TLS == 1
+    mqttHandler.setSessionCache(&otaUpdater.sessionCache());
+#endif
+    mqttHandler.route(MQTT_TOPIC_OTA, onOTATrigger);
+    mqttHandler.route(MQTT_TOPIC_FW_CHUNK, onFirmwareChunk, 0);  // lost chunks are re-requested
+    mqttHandler.route(MQTT_TOPIC_CMD_UPDATE, onUpdateCommand);
+    mqttHandler.route(MQTT_TOPIC_CMD_STATUS, onStatusCommand);
+    mqttHandler.route(MQTT_TOPIC_CMD_FLUSH, onFlushCommand);
+    mqttHandler.route(MQTT_TOPIC_CMD_REBOOT, onRebootCommand);
     mqttHandler.begin();
-    mqttHandler.setOTACallback(onOTATrigger);
     
     // Setup OTA with MQTT handler for monitoring
-    otaUpdater.setMQTTHandler(&mqttHandler);
+    otaUpdater.setPublisher(&mqttHandler);
+    
+    // Everything loop() does; the first pass runs every periodic task
+    scheduler.add("net", netTask, NET_SERVICE_INTERVAL);
+    scheduler.add("mqtt", mqttTask, MQTT_SERVICE_INTERVAL, mqttReady);
+    otaTask = scheduler.add("ota", otaTaskRun, OTA_SERVICE_INTERVAL, otaReady);
+    statusTask = scheduler.add("status", statusTaskRun, 0);
+    flushTask = scheduler.add("flush", flushTaskRun, 0);
+    rebootTask = scheduler.add("reboot", rebootTaskRun, 0);
+    scheduler.add("heartbeat", heartbeatTask, STATUS_UPDATE_INTERVAL);
     
     Serial.println("Setup complete. Waiting for MQTT trigger...");
 }
 
 void loop() {
-    // Keep MQTT connection alive
-    mqttHandler.loop();
-    
-    // Check for OTA updates
-    if (ota_flag) {
-        ota_flag = false;
-        otaUpdater.checkForUpdates();
-    }
-    
-    // Main application code here
-    delay(100);
-    
-    // Periodic status update
-    static unsigned long lastStatus = 0;
-    if (millis() - lastStatus > STATUS_UPDATE_INTERVAL) {
-        lastStatus = millis();
-        Serial.println("[APP] Running...");
-    }
+    // Runs what is due, then sleeps until the next deadline or event
+    scheduler.run();
 }
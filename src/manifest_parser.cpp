@@ -0,0 +1,415 @@
+#include "manifest_parser.h"
+#include <string.h>
+
+#define MANIFEST_MAX_DEPTH 8
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+ManifestParser::ManifestParser(FirmwareManifest& manifest) : _manifest(manifest) {
+    reset();
+}
+
+void ManifestParser::reset() {
+    memset(&_manifest, 0, sizeof(_manifest));
+    _state = STATE_START;
+    _field = FIELD_UNKNOWN;
+    _seen = 0;
+    _total = 0;
+    _keyLen = 0;
+    _keyOverflow = false;
+    _valueLen = 0;
+    _number = 0;
+    _unicode = 0;
+    _unicodeDigits = 0;
+    _depth = 0;
+    _literal = nullptr;
+    _error = nullptr;
+}
+
+bool ManifestParser::fail(const char* error) {
+    _state = STATE_ERROR;
+    _error = error;
+    return false;
+}
+
+bool ManifestParser::feed(const uint8_t* data, size_t len) {
+    if (_state == STATE_ERROR) return false;
+    
+    for (size_t i = 0; i < len; i++) {
+        if (++_total > MANIFEST_MAX_SIZE) {
+            return fail("manifest too large");
+        }
+        if (!step((char)data[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ManifestParser::step(char c) {
+    switch (_state) {
+        case STATE_START:
+            if (isSpace(c)) return true;
+            if (c != '{') return fail("expected object");
+            _state = STATE_KEY_OR_END;
+            return true;
+        
+        case STATE_KEY_OR_END:
+            if (c == '}') {
+                _state = STATE_DONE;
+                return true;
+            }
+            // fall through
+        case STATE_KEY_START:
+            if (isSpace(c)) return true;
+            if (c != '"') return fail("expected key");
+            _keyLen = 0;
+            _keyOverflow = false;
+            _state = STATE_KEY;
+            return true;
+        
+        case STATE_KEY:
+            if (c == '"') {
+                _key[_keyLen] = 0;
+                _field = lookupKey();
+                _state = STATE_COLON;
+                return true;
+            }
+            if ((uint8_t)c < 0x20) return fail("control character in key");
+            if (c == '\\') {
+                _state = STATE_KEY_ESCAPE;
+            } else if (_keyLen < sizeof(_key) - 1) {
+                _key[_keyLen++] = c;
+            } else {
+                _keyOverflow = true;
+            }
+            return true;
+        
+        case STATE_KEY_ESCAPE:
+            // None of the known keys needs escaping, so this one is skipped
+            _keyOverflow = true;
+            _state = STATE_KEY;
+            return true;
+        
+        case STATE_COLON:
+            if (isSpace(c)) return true;
+            if (c != ':') return fail("expected ':'");
+            _state = STATE_VALUE;
+            return true;
+        
+        case STATE_VALUE:
+            if (isSpace(c)) return true;
+            return beginValue(c);
+        
+        case STATE_STRING:
+            if (c == '"') return endString();
+            if ((uint8_t)c < 0x20) return fail("control character in string");
+            if (c == '\\') {
+                _state = STATE_STRING_ESCAPE;
+                return true;
+            }
+            return valueChar(c);
+        
+        case STATE_STRING_ESCAPE:
+            _state = STATE_STRING;
+            switch (c) {
+                case '"':
+                case '\\':
+                case '/': return valueChar(c);
+                case 'b': return valueChar('\b');
+                case 'f': return valueChar('\f');
+                case 'n': return valueChar('\n');
+                case 'r': return valueChar('\r');
+                case 't': return valueChar('\t');
+                case 'u':
+                    _unicode = 0;
+                    _unicodeDigits = 0;
+                    _state = STATE_STRING_UNICODE;
+                    return true;
+                default: return fail("invalid escape");
+            }
+        
+        case STATE_STRING_UNICODE: {
+            int n = hexNibble(c);
+            if (n < 0) return fail("invalid escape");
+            _unicode = (_unicode << 4) | n;
+            if (++_unicodeDigits < 4) return true;
+            _state = STATE_STRING;
+            
+            // Versions, URLs and hex are ASCII; other code points only matter in skipped keys
+            if (_field == FIELD_UNKNOWN) return true;
+            if (_unicode >= 0x80) return fail("non-ASCII value");
+            return valueChar((char)_unicode);
+        }
+        
+        case STATE_NUMBER:
+            if (isDigit(c) || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+                return numberChar(c);
+            }
+            if (_valueLen == 0) return fail("invalid number");
+            if (numberTarget()) {
+                *numberTarget() = _number;
+                _seen |= 1 << _field;
+            }
+            _state = STATE_COMMA_OR_END;
+            return step(c);
+        
+        case STATE_LITERAL:
+            if (_literal[_valueLen] == 0) {
+                _state = STATE_COMMA_OR_END;
+                return step(c);
+            }
+            if (c != _literal[_valueLen]) return fail("invalid literal");
+            _valueLen++;
+            return true;
+        
+        case STATE_NESTED:
+            if (c == '"') {
+                _state = STATE_NESTED_STRING;
+            } else if (c == '{' || c == '[') {
+                if (++_depth > MANIFEST_MAX_DEPTH) return fail("nesting too deep");
+            } else if (c == '}' || c == ']') {
+                if (--_depth == 0) _state = STATE_COMMA_OR_END;
+            }
+            return true;
+        
+        case STATE_NESTED_STRING:
+            if (c == '\\') {
+                _state = STATE_NESTED_ESCAPE;
+            } else if (c == '"') {
+                _state = STATE_NESTED;
+            }
+            return true;
+        
+        case STATE_NESTED_ESCAPE:
+            _state = STATE_NESTED_STRING;
+            return true;
+        
+        case STATE_COMMA_OR_END:
+            if (isSpace(c)) return true;
+            if (c == ',') {
+                _state = STATE_KEY_START;
+                return true;
+            }
+            if (c == '}') {
+                _state = STATE_DONE;
+                return true;
+            }
+            return fail("expected ',' or '}'");
+        
+        case STATE_DONE:
+            if (isSpace(c)) return true;
+            return fail("data after manifest");
+        
+        default:
+            return false;
+    }
+}
+
+bool ManifestParser::beginValue(char c) {
+    _valueLen = 0;
+    
+    if (c == '"') {
+        if (numberTarget()) return fail("expected number value");
+        _state = STATE_STRING;
+        return true;
+    }
+    if (_field != FIELD_UNKNOWN && !numberTarget()) {
+        return fail("expected string value");
+    }
+    
+    if (isDigit(c) || c == '-') {
+        _number = 0;
+        _state = STATE_NUMBER;
+        return numberChar(c);
+    }
+    if (numberTarget()) return fail("expected number value");
+    
+    if (c == 't' || c == 'f' || c == 'n') {
+        _literal = c == 't' ? "true" : c == 'f' ? "false" : "null";
+        _valueLen = 1;
+        _state = STATE_LITERAL;
+        return true;
+    }
+    if (c == '{' || c == '[') {
+        _depth = 1;
+        _state = STATE_NESTED;
+        return true;
+    }
+    return fail("unexpected character");
+}
+
+uint32_t* ManifestParser::numberTarget() {
+    switch (_field) {
+        case FIELD_SIZE: return &_manifest.size;
+        case FIELD_BASE_SIZE: return &_manifest.baseSize;
+        default: return nullptr;
+    }
+}
+
+bool ManifestParser::numberChar(char c) {
+    _valueLen++;
+    if (!numberTarget()) return true;
+    
+    if (!isDigit(c)) return fail("size must be an unsigned integer");
+    uint32_t digit = c - '0';
+    if (_number > (0xFFFFFFFFu - digit) / 10) return fail("size out of range");
+    _number = _number * 10 + digit;
+    return true;
+}
+
+bool ManifestParser::valueChar(char c) {
+    switch (_field) {
+        case FIELD_VERSION: return appendText(_manifest.version, sizeof(_manifest.version), c);
+        case FIELD_URL: return appendText(_manifest.url, sizeof(_manifest.url), c);
+        case FIELD_PATCH_URL: return appendText(_manifest.patchUrl, sizeof(_manifest.patchUrl), c);
+        case FIELD_COMPRESSION: return appendText(_manifest.compression, sizeof(_manifest.compression), c);
+        case FIELD_COMPRESSED_URL: return appendText(_manifest.compressedUrl, sizeof(_manifest.compressedUrl), c);
+        case FIELD_HASH: return appendHex(_manifest.hash, sizeof(_manifest.hash), c);
+        case FIELD_SIGNATURE: return appendHex(_manifest.signature, sizeof(_manifest.signature), c);
+        case FIELD_BASE_HASH: return appendHex(_manifest.baseHash, sizeof(_manifest.baseHash), c);
+        default: return true;
+    }
+}
+
+bool ManifestParser::appendText(char* out, size_t size, char c) {
+    if (_valueLen + 1 >= size) return fail("value too long");
+    out[_valueLen++] = c;
+    out[_valueLen] = 0;
+    return true;
+}
+
+bool ManifestParser::appendHex(uint8_t* out, size_t size, char c) {
+    int n = hexNibble(c);
+    if (n < 0) return fail("invalid hex digit");
+    if (_valueLen >= size * 2) return fail("hex value too long");
+    
+    if (_valueLen % 2 == 0) {
+        out[_valueLen / 2] = n << 4;
+    } else {
+        out[_valueLen / 2] |= n;
+    }
+    _valueLen++;
+    return true;
+}
+
+bool ManifestParser::endString() {
+    size_t expected = 0;
+    switch (_field) {
+        case FIELD_HASH: expected = sizeof(_manifest.hash) * 2; break;
+        case FIELD_SIGNATURE: expected = sizeof(_manifest.signature) * 2; break;
+        case FIELD_BASE_HASH: expected = sizeof(_manifest.baseHash) * 2; break;
+        default: break;
+    }
+    if (expected && _valueLen != expected) return fail("hex value too short");
+    
+    // A repeated key with an empty value must not keep the old one
+    if (_field == FIELD_VERSION) _manifest.version[_valueLen] = 0;
+    if (_field == FIELD_URL) _manifest.url[_valueLen] = 0;
+    if (_field == FIELD_PATCH_URL) _manifest.patchUrl[_valueLen] = 0;
+    if (_field == FIELD_COMPRESSION) _manifest.compression[_valueLen] = 0;
+    if (_field == FIELD_COMPRESSED_URL) _manifest.compressedUrl[_valueLen] = 0;
+    
+    _seen |= 1 << _field;
+    _state = STATE_COMMA_OR_END;
+    return true;
+}
+
+ManifestParser::Field ManifestParser::lookupKey() const {
+    static const struct {
+        const char* key;
+        Field field;
+    } keys[] = {
+        {"version", FIELD_VERSION},
+        {"hash", FIELD_HASH},
+        {"size", FIELD_SIZE},
+        {"url", FIELD_URL},
+        {"manifest_signature", FIELD_SIGNATURE},
+        {"base_hash", FIELD_BASE_HASH},
+        {"base_size", FIELD_BASE_SIZE},
+        {"patch_url", FIELD_PATCH_URL},
+        {"compression", FIELD_COMPRESSION},
+        {"compressed_url", FIELD_COMPRESSED_URL},
+    };
+    
+    if (_keyOverflow) return FIELD_UNKNOWN;
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if (strcmp(_key, keys[i].key) == 0) return keys[i].field;
+    }
+    return FIELD_UNKNOWN;
+}
+
+bool ManifestParser::finish() {
+    if (_state == STATE_ERROR) return false;
+    if (_state != STATE_DONE) return fail("manifest truncated");
+    
+    const uint16_t required = (1 << FIELD_VERSION) | (1 << FIELD_HASH) | (1 << FIELD_SIZE) |
+                              (1 << FIELD_URL) | (1 << FIELD_SIGNATURE);
+    if ((_seen & required) != required || _manifest.version[0] == 0 || _manifest.url[0] == 0) {
+        return fail("missing version, hash, size, url or manifest_signature");
+    }
+    
+    // Optional groups are all-or-nothing
+    const uint16_t delta = (1 << FIELD_BASE_HASH) | (1 << FIELD_BASE_SIZE) | (1 << FIELD_PATCH_URL);
+    if ((_seen & delta) != delta || _manifest.patchUrl[0] == 0) {
+        memset(_manifest.baseHash, 0, sizeof(_manifest.baseHash));
+        _manifest.baseSize = 0;
+        _manifest.patchUrl[0] = 0;
+    }
+    
+    const uint16_t compression = (1 << FIELD_COMPRESSION) | (1 << FIELD_COMPRESSED_URL);
+    if ((_seen & compression) != compression || _manifest.compressedUrl[0] == 0) {
+        _manifest.compression[0] = 0;
+        _manifest.compressedUrl[0] = 0;
+    }
+    return true;
+}
+
+int ManifestParser::hexToBytes(const char* hex, uint8_t* out, size_t maxLen) {
+    size_t len = strlen(hex);
+    if (len % 2 != 0 || len / 2 > maxLen) return -1;
+    
+    for (size_t i = 0; i < len / 2; i++) {
+        int hi = hexNibble(hex[i * 2]);
+        int lo = hexNibble(hex[i * 2 + 1]);
+        if (hi < 0 || lo < 0) return -1;
+        out[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return (int)(len / 2);
+}
+
+size_t ManifestParser::canonicalize(const FirmwareManifest& manifest, uint8_t* out, size_t outLen) {
+    size_t versionLen = strnlen(manifest.version, sizeof(manifest.version));
+    size_t urlLen = strnlen(manifest.url, sizeof(manifest.url));
+    size_t total = 5 + 1 + versionLen + sizeof(manifest.hash) + 4 + 1 + urlLen;
+    if (total > outLen) return 0;
+    
+    uint8_t* p = out;
+    memcpy(p, MANIFEST_CANONICAL_MAGIC, 5);
+    p += 5;
+    *p++ = (uint8_t)versionLen;
+    memcpy(p, manifest.version, versionLen);
+    p += versionLen;
+    memcpy(p, manifest.hash, sizeof(manifest.hash));
+    p += sizeof(manifest.hash);
+    for (int i = 0; i < 4; i++) {
+        *p++ = (uint8_t)(manifest.size >> (8 * i));
+    }
+    *p++ = (uint8_t)urlLen;
+    memcpy(p, manifest.url, urlLen);
+    p += urlLen;
+    return p - out;
+}
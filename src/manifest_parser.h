@@ -0,0 +1,128 @@
+#ifndef MANIFEST_PARSER_H
+#define MANIFEST_PARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Bytes accepted before a manifest is rejected as oversized
+#define MANIFEST_MAX_SIZE 2048
+
+#define MANIFEST_VERSION_LEN 48
+#define MANIFEST_URL_LEN 96
+#define MANIFEST_COMPRESSION_LEN 8
+
+// Bytes covered by manifest_signature, produced by the CI workflow:
+//
+//   "OTAM1" | len(version) u8 | version | hash (32) | size (u32 LE) | len(url) u8 | url
+//
+// The Ed25519 signature is over the SHA-256 of these bytes, the same way the
+// image signature is over the image hash.
+#define MANIFEST_CANONICAL_MAGIC "OTAM1"
+#define MANIFEST_CANONICAL_MAX (5 + 1 + MANIFEST_VERSION_LEN + 32 + 4 + 1 + MANIFEST_URL_LEN)
+
+// Fields of manifest.json in binary form. `signature` is manifest_signature,
+// which authenticates version, hash, size and url before anything is
+// downloaded. The delta fields are only set when
+// the release also ships a patch (see tools/ota_delta.cpp), the compression
+// fields when it ships a compressed copy of the image (see
+// tools/ota_compress.cpp). Empty strings mean "not present".
+struct FirmwareManifest {
+    char version[MANIFEST_VERSION_LEN];
+    uint8_t hash[32];
+    uint32_t size;
+    char url[MANIFEST_URL_LEN];
+    uint8_t signature[64];
+    uint8_t baseHash[32];
+    uint32_t baseSize;
+    char patchUrl[MANIFEST_URL_LEN];
+    char compression[MANIFEST_COMPRESSION_LEN];
+    char compressedUrl[MANIFEST_URL_LEN];
+};
+
+// Streaming JSON reader for manifest.json. Bytes may arrive in chunks of any
+// size straight from the socket; known keys are decoded in place into a
+// FirmwareManifest (hex straight to bytes), unknown keys are skipped, and
+// nothing is allocated. Oversized documents, overlong strings, wrong value
+// types and malformed hex are errors rather than truncations.
+class ManifestParser {
+public:
+    explicit ManifestParser(FirmwareManifest& manifest);
+    
+    void reset();
+    bool feed(const uint8_t* data, size_t len);
+    
+    // True once the closing brace was seen and version, hash, size, url and
+    // manifest_signature are present. Incomplete optional groups are cleared here.
+    bool finish();
+    
+    bool finished() const { return _state == STATE_DONE; }
+    const char* error() const { return _error; }
+    
+    static int hexToBytes(const char* hex, uint8_t* out, size_t maxLen);
+    static size_t canonicalize(const FirmwareManifest& manifest, uint8_t* out, size_t outLen);
+
+private:
+    enum State {
+        STATE_START,
+        STATE_KEY_OR_END,
+        STATE_KEY_START,
+        STATE_KEY,
+        STATE_KEY_ESCAPE,
+        STATE_COLON,
+        STATE_VALUE,
+        STATE_STRING,
+        STATE_STRING_ESCAPE,
+        STATE_STRING_UNICODE,
+        STATE_NUMBER,
+        STATE_LITERAL,
+        STATE_NESTED,
+        STATE_NESTED_STRING,
+        STATE_NESTED_ESCAPE,
+        STATE_COMMA_OR_END,
+        STATE_DONE,
+        STATE_ERROR
+    };
+    
+    enum Field {
+        FIELD_UNKNOWN,
+        FIELD_VERSION,
+        FIELD_HASH,
+        FIELD_SIZE,
+        FIELD_URL,
+        FIELD_SIGNATURE,
+        FIELD_BASE_HASH,
+        FIELD_BASE_SIZE,
+        FIELD_PATCH_URL,
+        FIELD_COMPRESSION,
+        FIELD_COMPRESSED_URL
+    };
+    
+    FirmwareManifest& _manifest;
+    State _state;
+    Field _field;
+    uint16_t _seen;           // bit per Field present in the document
+    size_t _total;
+    char _key[24];
+    uint8_t _keyLen;
+    bool _keyOverflow;
+    size_t _valueLen;
+    uint32_t _number;
+    uint16_t _unicode;
+    uint8_t _unicodeDigits;
+    uint8_t _depth;
+    const char* _literal;     // "true", "false" or "null" being matched
+    const char* _error;
+    
+    bool step(char c);
+    bool beginValue(char c);
+    bool valueChar(char c);
+    bool appendText(char* out, size_t size, char c);
+    bool appendHex(uint8_t* out, size_t size, char c);
+    bool endString();
+    bool numberChar(char c);
+    uint32_t* numberTarget();
+    Field lookupKey() const;
+    bool fail(const char* error);
+};
+
+#endif // MANIFEST_PARSER_H
@@ -1,15 +1,42 @@
 #include "mqtt_handler.h"
 #include "config.h"
 #include "certificates.h"
+#include "ota_mqtt_transfer.h"
 
 MQTTHandler* MQTTHandler::_instance = nullptr;
 
+// How the outbox queues each topic; anything else is normal priority
+struct TopicPolicy {
+    const char* topic;
+    MQTTOutbox::Priority priority;
+    bool coalesce;              // only the latest queued message matters
+};
+
+static const TopicPolicy topicPolicies[] = {
+    {MQTT_TOPIC_FW_REQUEST, MQTTOutbox::PRIORITY_HIGH, true},
+    {MQTT_TOPIC_FW_ACK, MQTTOutbox::PRIORITY_HIGH, true},
+    {MQTT_TOPIC_STATUS, MQTTOutbox::PRIORITY_HIGH, true},
+    {MQTT_TOPIC_PROGRESS, MQTTOutbox::PRIORITY_NORMAL, true},
+    {MQTT_TOPIC_CPU, MQTTOutbox::PRIORITY_NORMAL, true},
+};
+
+static_assert(OTA_METRICS_BATCH_SIZE + 64 <= MQTT_OUTBOX_SIZE, "A metrics batch must fit in the outbox");
+
+static const TopicPolicy* policyOf(const char* topic) {
+    for (const TopicPolicy& policy : topicPolicies) {
+        if (strcmp(policy.topic, topic) == 0) return &policy;
+    }
+    return nullptr;
+}
+
 MQTTHandler::MQTTHandler() : _mqttClient(_espClient) {
     _instance = this;
-    _otaCallback = nullptr;
     _lastAttempt = 0;
-    
+    _linkUp = false;
+
 #if FIRMWARE_TLS == 1
+    _sessions = nullptr;
+    
     // Configure TLS buffer sizes (reduce memory usage)
     _espClient.setBufferSizes(512, 512);
     
@@ -25,6 +52,17 @@ MQTTHandler::MQTTHandler() : _mqttClient(_espClient) {
 void MQTTHandler::begin() {
     _mqttClient.setServer(MQTT_SERVER, MQTT_PORT);
     _mqttClient.setCallback(messageCallback);
+    
+    // Batched ota/metrics and firmware chunks need more than PubSubClient's
+    // 256-byte default; the buffer holds one whole packet with its topic
+#if OTA_MQTT_CHUNK + OTA_MQTT_CHUNK_HEADER > OTA_METRICS_BATCH_SIZE
+    _mqttClient.setBufferSize(OTA_MQTT_CHUNK + OTA_MQTT_CHUNK_HEADER + 64);
+#else
+    _mqttClient.setBufferSize(OTA_METRICS_BATCH_SIZE + 64);
+#endif
+#if MQTT_OUTBOX_SPILL > 0
+    _outbox.enableSpill(MQTT_OUTBOX_SPILL_PATH, MQTT_OUTBOX_SPILL);
+#endif
 #if FIRMWARE_TLS == 1
     Serial.printf("[MQTT] Configured MQTTS: %s:%d (Fingerprint)\n", MQTT_SERVER, MQTT_PORT);
 #else
@@ -37,67 +75,120 @@ void MQTTHandler::loop() {
         reconnect();
     }
     _mqttClient.loop();
+    
+    // A few messages per call, so a backlog does not hold up loop()
+    if (_mqttClient.connected()) {
+        _outbox.drain(sendQueued, this, MQTT_OUTBOX_BURST);
+    }
 }
 
-bool MQTTHandler::isConnected() {
-    return _mqttClient.connected();
+bool MQTTHandler::sendQueued(void* ctx, const char* topic, const uint8_t* payload, size_t len) {
+    return ((MQTTHandler*)ctx)->_mqttClient.publish(topic, payload, len, false);
 }
 
-void MQTTHandler::publish(const char* topic, const char* payload) {
-    // Try to reconnect if disconnected
-    if (!_mqttClient.connected()) {
-        reconnect();
+void MQTTHandler::flush(uint32_t timeoutMs) {
+    unsigned long start = millis();
+    while (!_outbox.empty() && _mqttClient.connected() && millis() - start < timeoutMs) {
+        loop();
+        yield();
     }
-    
-    // Publish with retry (3 attempts)
-    if (_mqttClient.connected()) {
-        for (int i = 0; i < 3; i++) {
-            if (_mqttClient.publish(topic, payload, false)) {
-                // Success
-                return;
-            }
-            // Failed, wait and retry
-            delay(100);
-            yield();
-        }
-        Serial.printf("[MQTT] Failed to publish to %s after 3 attempts\n", topic);
-    } else {
-        Serial.printf("[MQTT] Not connected, cannot publish to %s\n", topic);
+    if (!_outbox.empty()) {
+        Serial.printf("[MQTT] %u messages not sent\n", _outbox.depth());
     }
 }
 
-void MQTTHandler::setOTACallback(void (*callback)()) {
-    _otaCallback = callback;
+bool MQTTHandler::isConnected() {
+    return _mqttClient.connected();
 }
 
+bool MQTTHandler::pending() {
+    return _mqttClient.connected() && (_espClient.available() > 0 || !_outbox.empty());
+}
+
+bool MQTTHandler::publish(const char* topic, const char* payload) {
+    return publish(topic, (const uint8_t*)payload, strlen(payload));
+}
+
+// Only queues: the message goes out from loop() once connected
+bool MQTTHandler::publish(const char* topic, const uint8_t* payload, size_t len) {
+    const TopicPolicy* policy = policyOf(topic);
+    return _outbox.push(topic, payload, len, policy ? policy->priority : MQTTOutbox::PRIORITY_NORMAL,
+                        policy && policy->coalesce);
+}
+
+// Room in the outbox itself, so ota/metrics batches need no buffer of their own
+uint8_t* MQTTHandler::reserve(const char* topic, size_t len) {
+    const TopicPolicy* policy = policyOf(topic);
+    return _outbox.reserve(topic, len, policy ? policy->priority : MQTTOutbox::PRIORITY_NORMAL);
+}
+
+bool MQTTHandler::commit(size_t used) {
+    return _outbox.commit(used);
+}
+
+bool MQTTHandler::route(const char* filter, MQTTRouteHandler handler, uint8_t qos) {
+    return _router.add(filter, handler, qos);
+}
+
+#if FIRMWARE_TLS == 1
+void MQTTHandler::setSessionCache(TLSSessionCache* cache) {
+    // Reconnects after a broker drop resume instead of a full handshake
+    _sessions = cache;
+}
+#endif
+
 void MQTTHandler::reconnect() {
     unsigned long now = millis();
     
-    // Try to reconnect every MQTT_RECONNECT_INTERVAL
-    if (now - _lastAttempt < MQTT_RECONNECT_INTERVAL) {
+    // Nothing to try without a link, which does not count as an attempt.
+    // The fingerprint check needs no clock, so this does not wait for SNTP.
+    bool linkUp = WiFi.status() == WL_CONNECTED;
+    bool linkCameUp = linkUp && !_linkUp;
+    _linkUp = linkUp;
+    if (!linkUp) {
         return;
     }
-    _lastAttempt = now;
     
-    if (WiFi.status() != WL_CONNECTED) {
+    // The first attempt goes out as soon as the link is up, retries every
+    // MQTT_RECONNECT_INTERVAL
+    if (!linkCameUp && now - _lastAttempt < MQTT_RECONNECT_INTERVAL) {
         return;
     }
+    _lastAttempt = now;
     
     Serial.print("[MQTT] Connecting...");
     
     // Create client ID
-    String clientId = "ESP8266-";
-    clientId += String(ESP.getChipId(), HEX);
-    
+    char clientId[24];
+    snprintf(clientId, sizeof(clientId), "ESP8266-%x", (unsigned)ESP.getChipId());
+
+#if FIRMWARE_TLS == 1
+    // Looked up per attempt like OTATransport::connect(): the broker's slot
+    // may have gone to another host since the last one
+    BearSSL::Session* session = _sessions ? _sessions->get(MQTT_SERVER, MQTT_PORT) : nullptr;
+    TLSSessionCache::Offer offer = {};
+    if (session) {
+        offer = TLSSessionCache::offer(*session);
+        _espClient.setSession(session);
+    }
+#endif
+
     // Attempt to connect
-    if (_mqttClient.connect(clientId.c_str(), MQTT_USER, MQTT_PASS)) {
+    if (_mqttClient.connect(clientId, MQTT_USER, MQTT_PASS)) {
         Serial.println(" Connected!");
-        
-        // Subscribe to OTA topic
-        if (_mqttClient.subscribe(MQTT_TOPIC_OTA, 1)) {
-            Serial.printf("[MQTT] Subscribed to: %s\n", MQTT_TOPIC_OTA);
-        } else {
-            Serial.println("[MQTT] Subscription failed!");
+#if FIRMWARE_TLS == 1
+        Serial.printf("[MQTT] TLS handshake: %s, %lu ms\n",
+                      session && TLSSessionCache::resumed(offer, *session) ? "resumed" : "full",
+                      millis() - now);
+#endif
+
+        // Subscribe to every routed topic
+        for (uint8_t i = 0; i < _router.count(); i++) {
+            if (_mqttClient.subscribe(_router.filter(i), _router.qos(i))) {
+                Serial.printf("[MQTT] Subscribed to: %s\n", _router.filter(i));
+            } else {
+                Serial.printf("[MQTT] Subscription to %s failed!\n", _router.filter(i));
+            }
         }
     } else {
         Serial.printf(" Failed, rc=%d\n", _mqttClient.state());
@@ -105,19 +196,9 @@ void MQTTHandler::reconnect() {
 }
 
 void MQTTHandler::messageCallback(char* topic, byte* payload, unsigned int length) {
-    Serial.printf("[MQTT] Message arrived [%s]: ", topic);
-    
-    String message;
-    for (unsigned int i = 0; i < length; i++) {
-        message += (char)payload[i];
-    }
-    Serial.println(message);
-    
-    // Check if OTA update trigger
-    if (String(topic) == MQTT_TOPIC_OTA && message == "start") {
-        Serial.println("[MQTT] OTA update triggered!");
-        if (_instance && _instance->_otaCallback) {
-            _instance->_otaCallback();
-        }
+    // Topic and payload are handed to the routes in place, nothing is copied;
+    // the routes log what they act on
+    if (!_instance || _instance->_router.dispatch(topic, payload, length) == 0) {
+        Serial.printf("[MQTT] No route for [%s], %u bytes\n", topic, length);
     }
 }
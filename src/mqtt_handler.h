@@ -5,31 +5,50 @@
 #include <PubSubClient.h>
 #include <ESP8266WiFi.h>
 #include "config.h"
+#include "ota_platform.h"
+#include "mqtt_router.h"
+#include "mqtt_outbox.h"
 
 #if FIRMWARE_TLS == 1
 #include <WiFiClientSecure.h>
+#include "tls_session_cache.h"
 #endif
 
-class MQTTHandler {
+class MQTTHandler : public OTAPublisher {
 public:
     MQTTHandler();
     void begin();
     void loop();
     bool isConnected();
-    void publish(const char* topic, const char* payload);
-    void setOTACallback(void (*callback)());
+    bool pending();  // bytes from the broker or queued messages, loop() has work now
+    bool publish(const char* topic, const char* payload);
+    bool publish(const char* topic, const uint8_t* payload, size_t len);
+    uint8_t* reserve(const char* topic, size_t len);
+    bool commit(size_t used);
+    void flush(uint32_t timeoutMs);
+    const MQTTOutbox& outbox() const { return _outbox; }
     
+    // Register before begin(): every route is subscribed on each (re)connect
+    bool route(const char* filter, MQTTRouteHandler handler, uint8_t qos = 1);
+#if FIRMWARE_TLS == 1
+    void setSessionCache(TLSSessionCache* cache);
+#endif
+
 private:
 #if FIRMWARE_TLS == 1
     WiFiClientSecure _espClient;
+    TLSSessionCache* _sessions;
 #else
     WiFiClient _espClient;
 #endif
     PubSubClient _mqttClient;
-    void (*_otaCallback)();
+    MQTTRouter _router;
+    MQTTOutbox _outbox;
     unsigned long _lastAttempt;
+    bool _linkUp;
     
     void reconnect();
+    static bool sendQueued(void* ctx, const char* topic, const uint8_t* payload, size_t len);
     static void messageCallback(char* topic, byte* payload, unsigned int length);
     static MQTTHandler* _instance;
 };
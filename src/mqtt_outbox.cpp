@@ -0,0 +1,309 @@
+#include "mqtt_outbox.h"
+#include <string.h>
+#include "ota_platform.h"
+
+#define FLAG_DEAD 0x01      // replaced by a newer message of its topic
+#define FLAG_PAD 0x02       // rest of the ring up to the end is unused
+#define FLAG_SPILLED 0x04   // came back from the SPIFFS log
+
+// Header, topic with its terminator, payload, padded to keep headers aligned
+size_t MQTTOutbox::recordSize(size_t topicLen, size_t payloadLen) {
+    return (sizeof(Header) + topicLen + 1 + payloadLen + 3) & ~(size_t)3;
+}
+
+const char* MQTTOutbox::topicOf(const Header* header) {
+    return (const char*)(header + 1);
+}
+
+const uint8_t* MQTTOutbox::payloadOf(const Header* header) {
+    return (const uint8_t*)(header + 1) + header->topicLen + 1;
+}
+
+MQTTOutbox::Ring::Ring(uint8_t* buffer, size_t size)
+    : _buffer(buffer), _size(size), _head(0), _tail(0), _used(0) {
+}
+
+uint8_t* MQTTOutbox::Ring::reserve(size_t len) {
+    if (_used == 0) {
+        _head = 0;
+        _tail = 0;
+    }
+    
+    bool wrapped = _tail < _head || (_tail == _head && _used > 0);
+    if (!wrapped && _size - _tail < len) {
+        // Does not fit before the end: pad it out and start over at 0
+        if (len > _head) return nullptr;
+        if (_size - _tail >= sizeof(Header)) {
+            ((Header*)(_buffer + _tail))->flags = FLAG_PAD;
+        }
+        _used += _size - _tail;
+        _tail = 0;
+    } else if (wrapped && _head - _tail < len) {
+        return nullptr;
+    }
+    
+    uint8_t* p = _buffer + _tail;
+    _tail += len;
+    _used += len;
+    if (_tail == _size) _tail = 0;
+    return p;
+}
+
+void MQTTOutbox::Ring::shrink(uint8_t* record, size_t from, size_t to) {
+    _used -= from - to;
+    _tail = (record - _buffer) + to;
+    if (_tail == _size) _tail = 0;
+}
+
+MQTTOutbox::Header* MQTTOutbox::Ring::front() {
+    while (_used > 0) {
+        size_t left = _size - _head;
+        if (left >= sizeof(Header) && !(((Header*)(_buffer + _head))->flags & FLAG_PAD)) {
+            return (Header*)(_buffer + _head);
+        }
+        // Padding, or a remainder too short for a header
+        _used -= left;
+        _head = 0;
+    }
+    return nullptr;
+}
+
+void MQTTOutbox::Ring::pop() {
+    Header* header = front();
+    if (!header) return;
+    
+    size_t len = recordSize(header->topicLen, header->payloadLen);
+    _head += len;
+    _used -= len;
+    if (_head == _size) _head = 0;
+}
+
+MQTTOutbox::MQTTOutbox()
+    : _normal(_normalBuffer, sizeof(_normalBuffer)), _high(_highBuffer, sizeof(_highBuffer)), _seq(0), _depth(0),
+      _reserved(nullptr), _reservedRing(nullptr), _spillPath(nullptr), _spillMax(0), _spillSize(0), _spillRead(0) {
+    memset(_slots, 0, sizeof(_slots));
+    resetStats();
+}
+
+void MQTTOutbox::enableSpill(const char* path, uint32_t maxBytes) {
+    _spillPath = path;
+    _spillMax = maxBytes;
+    _spillSize = otaStorageSize(path);
+    _spillRead = 0;
+    if (_spillSize > 0) {
+        Serial.printf("[OUTBOX] %u bytes of messages left in %s\n", (unsigned)_spillSize, path);
+    }
+}
+
+// A record for the message with its header and topic filled in, made room
+// for by evicting the oldest messages; nullptr when it is too large
+MQTTOutbox::Header* MQTTOutbox::claim(const char* topic, size_t len, Priority priority, bool coalesce) {
+    size_t topicLen = strlen(topic);
+    Ring& ring = priority == PRIORITY_HIGH ? _high : _normal;
+    size_t ringSize = priority == PRIORITY_HIGH ? sizeof(_highBuffer) : sizeof(_normalBuffer);
+    size_t need = recordSize(topicLen, len);
+    if (topicLen > 0xFF || len > 0xFFFF || need > ringSize) {
+        Serial.printf("[OUTBOX] %u byte message to %s does not fit, dropped\n", (unsigned)len, topic);
+        _dropped++;
+        return nullptr;
+    }
+    
+    if (coalesce) {
+        supersede(topic);
+    }
+    
+    uint8_t* p;
+    while (!(p = ring.reserve(need))) {
+        evict(ring);
+    }
+    
+    Header* header = (Header*)p;
+    header->payloadLen = len;
+    header->flags = 0;
+    header->topicLen = topicLen;
+    header->seq = _seq++;
+    header->enqueuedMs = otaMillis();
+    memcpy(p + sizeof(Header), topic, topicLen + 1);
+    return header;
+}
+
+bool MQTTOutbox::push(const char* topic, const uint8_t* payload, size_t len, Priority priority, bool coalesce) {
+    Header* header = claim(topic, len, priority, coalesce);
+    if (!header) return false;
+    
+    memcpy((uint8_t*)payloadOf(header), payload, len);
+    _depth++;
+    
+    if (coalesce) {
+        remember(header);
+    }
+    return true;
+}
+
+uint8_t* MQTTOutbox::reserve(const char* topic, size_t len, Priority priority) {
+    _reserved = claim(topic, len, priority, false);
+    if (!_reserved) return nullptr;
+    
+    // drain() skips it until commit()
+    _reserved->flags = FLAG_DEAD;
+    _reservedRing = priority == PRIORITY_HIGH ? &_high : &_normal;
+    return (uint8_t*)payloadOf(_reserved);
+}
+
+bool MQTTOutbox::commit(size_t used) {
+    Header* header = _reserved;
+    if (!header || used > header->payloadLen) return false;
+    _reserved = nullptr;
+    
+    // Given up, the record stays behind empty and dead
+    size_t from = recordSize(header->topicLen, header->payloadLen);
+    _reservedRing->shrink((uint8_t*)header, from, recordSize(header->topicLen, used));
+    header->payloadLen = used;
+    if (used == 0) return false;
+    
+    header->flags = 0;
+    _depth++;
+    return true;
+}
+
+uint8_t MQTTOutbox::drain(Sender send, void* ctx, uint8_t maxMessages) {
+    uint8_t sent = 0;
+    while (sent < maxMessages) {
+        Ring* ring = &_high;
+        Header* header = _high.front();
+        if (!header) {
+            ring = &_normal;
+            header = _normal.front();
+        }
+        if (!header) {
+            if (reload()) continue;
+            break;
+        }
+        
+        if (!(header->flags & FLAG_DEAD)) {
+            // Left in place when the client is busy, tried again next time
+            if (!send(ctx, topicOf(header), payloadOf(header), header->payloadLen)) {
+                break;
+            }
+            if (!(header->flags & FLAG_SPILLED)) {
+                uint32_t latency = otaMillis() - header->enqueuedMs;
+                _maxLatencyMs = max(_maxLatencyMs, latency);
+                _latencySumMs += latency;
+                _latencyCount++;
+            }
+            _sent++;
+            _depth--;
+            sent++;
+        }
+        forget(header);
+        ring->pop();
+    }
+    return sent;
+}
+
+void MQTTOutbox::resetStats() {
+    _sent = 0;
+    _dropped = 0;
+    _coalesced = 0;
+    _spilled = 0;
+    _maxLatencyMs = 0;
+    _latencySumMs = 0;
+    _latencyCount = 0;
+}
+
+// Only MQTT_OUTBOX_COALESCE topics are tracked, so this is a short scan
+void MQTTOutbox::supersede(const char* topic) {
+    for (uint8_t i = 0; i < MQTT_OUTBOX_COALESCE; i++) {
+        CoalesceSlot& slot = _slots[i];
+        if (slot.header && strcmp(topicOf(slot.header), topic) == 0) {
+            slot.header->flags |= FLAG_DEAD;
+            slot.header = nullptr;
+            _depth--;
+            _coalesced++;
+            return;
+        }
+    }
+}
+
+void MQTTOutbox::remember(Header* header) {
+    for (uint8_t i = 0; i < MQTT_OUTBOX_COALESCE; i++) {
+        if (!_slots[i].header) {
+            _slots[i].header = header;
+            _slots[i].seq = header->seq;
+            return;
+        }
+    }
+}
+
+void MQTTOutbox::forget(const Header* header) {
+    for (uint8_t i = 0; i < MQTT_OUTBOX_COALESCE; i++) {
+        if (_slots[i].header == header && _slots[i].seq == header->seq) {
+            _slots[i].header = nullptr;
+        }
+    }
+}
+
+// Makes room in a full ring by giving up its oldest message
+void MQTTOutbox::evict(Ring& ring) {
+    Header* header = ring.front();
+    if (!header) return;
+    
+    if (!(header->flags & FLAG_DEAD)) {
+        if (spill(header)) {
+            _spilled++;
+        } else {
+            _dropped++;
+        }
+        _depth--;
+    }
+    forget(header);
+    ring.pop();
+}
+
+bool MQTTOutbox::spill(const Header* header) {
+    if (!_spillPath) return false;
+    
+    size_t len = sizeof(Header) + header->topicLen + 1 + header->payloadLen;
+    if (_spillSize + len > _spillMax || !otaStorageAppend(_spillPath, header, len)) {
+        return false;
+    }
+    _spillSize += len;
+    return true;
+}
+
+// Moves the next spilled message back into the (empty) normal ring
+bool MQTTOutbox::reload() {
+    if (!_spillPath || _spillRead >= _spillSize) return false;
+    
+    Header header = {};
+    size_t need = 0;
+    uint8_t* p = nullptr;
+    if (otaStorageReadAt(_spillPath, _spillRead, &header, sizeof(header))) {
+        need = recordSize(header.topicLen, header.payloadLen);
+        p = need <= sizeof(_normalBuffer) ? _normal.reserve(need) : nullptr;
+    }
+    size_t rest = header.topicLen + 1 + header.payloadLen;
+    if (!p || !otaStorageReadAt(_spillPath, _spillRead + sizeof(header), p + sizeof(header), rest)) {
+        Serial.printf("[OUTBOX] %s is unreadable, discarded\n", _spillPath);
+        if (p) {
+            ((Header*)p)->flags = FLAG_DEAD;
+            ((Header*)p)->topicLen = 0;
+            ((Header*)p)->payloadLen = need - sizeof(Header) - 1;
+        }
+        _dropped++;
+        _spillRead = _spillSize;
+    } else {
+        header.flags = FLAG_SPILLED;
+        header.seq = _seq++;
+        memcpy(p, &header, sizeof(header));
+        _spillRead += sizeof(header) + rest;
+        _depth++;
+    }
+    
+    if (_spillRead >= _spillSize) {
+        otaStorageRemove(_spillPath);
+        _spillSize = 0;
+        _spillRead = 0;
+    }
+    return true;
+}
@@ -0,0 +1,129 @@
+#ifndef MQTT_OUTBOX_H
+#define MQTT_OUTBOX_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Messages waiting for the MQTT connection. push() copies the message into
+// a RAM ring and returns; drain() hands queued messages to the client as it
+// accepts them, high priority first. Nothing blocks and nothing is lost
+// while the broker is unreachable, up to what the rings hold:
+//
+// - a full ring makes room by dropping its oldest messages, or with
+//   enableSpill() by moving them to a SPIFFS log that is sent once RAM is
+//   empty (so they can arrive after newer messages)
+// - a coalescing push replaces the queued message of the same topic, for
+//   gauges like ota/progress where only the latest value matters
+//
+// Records are stored contiguously (a record that would wrap starts over
+// at the beginning of the ring), so drain() sends straight from the ring.
+class MQTTOutbox {
+public:
+    enum Priority : uint8_t {
+        PRIORITY_NORMAL,
+        PRIORITY_HIGH
+    };
+    
+    // Returns false when the client cannot take the message now
+    typedef bool (*Sender)(void* ctx, const char* topic, const uint8_t* payload, size_t len);
+    
+    MQTTOutbox();
+    
+    // Messages the rings drop go to `path` instead, up to `maxBytes`; a log
+    // left over from before a restart is sent too
+    void enableSpill(const char* path, uint32_t maxBytes);
+    
+    bool push(const char* topic, const uint8_t* payload, size_t len,
+              Priority priority = PRIORITY_NORMAL, bool coalesce = false);
+    
+    // push() in two steps, for a payload encoded in place: reserve() returns
+    // room for up to `len` bytes (nullptr when that can never fit), commit()
+    // queues the first `used` of them and gives the rest back to the ring.
+    // Nothing else may be pushed in between.
+    uint8_t* reserve(const char* topic, size_t len, Priority priority = PRIORITY_NORMAL);
+    bool commit(size_t used);
+    
+    // Sends up to `maxMessages`; returns how many went out
+    uint8_t drain(Sender send, void* ctx, uint8_t maxMessages);
+    
+    bool empty() const { return _depth == 0 && spillBacklog() == 0; }
+    
+    // Counters, since the last resetStats() apart from depth
+    uint16_t depth() const { return _depth; }  // messages in RAM
+    uint32_t spillBacklog() const { return _spillSize - _spillRead; }  // bytes in the SPIFFS log
+    uint32_t sent() const { return _sent; }
+    uint32_t dropped() const { return _dropped; }
+    uint32_t coalesced() const { return _coalesced; }
+    uint32_t spilled() const { return _spilled; }
+    uint32_t maxLatencyMs() const { return _maxLatencyMs; }  // push to send
+    uint32_t avgLatencyMs() const { return _latencyCount ? _latencySumMs / _latencyCount : 0; }
+    void resetStats();
+
+private:
+    struct Header {
+        uint16_t payloadLen;
+        uint8_t flags;
+        uint8_t topicLen;       // without the terminator
+        uint32_t seq;
+        uint32_t enqueuedMs;
+    };
+    
+    class Ring {
+    public:
+        Ring(uint8_t* buffer, size_t size);
+        
+        uint8_t* reserve(size_t len);  // contiguous space at the tail, or nullptr
+        void shrink(uint8_t* record, size_t from, size_t to);  // of the last reserve()
+        Header* front();               // oldest record, nullptr when empty
+        void pop();
+    
+    private:
+        uint8_t* _buffer;
+        size_t _size;
+        size_t _head;
+        size_t _tail;
+        size_t _used;                  // records plus wrap padding
+    };
+    
+    struct CoalesceSlot {
+        Header* header;         // queued record of a coalescing topic, nullptr if free
+        uint32_t seq;
+    };
+    
+    alignas(4) uint8_t _normalBuffer[MQTT_OUTBOX_SIZE];
+    alignas(4) uint8_t _highBuffer[MQTT_OUTBOX_HIGH_SIZE];
+    Ring _normal;
+    Ring _high;
+    CoalesceSlot _slots[MQTT_OUTBOX_COALESCE];
+    uint32_t _seq;
+    uint16_t _depth;
+    Header* _reserved;          // between reserve() and commit()
+    Ring* _reservedRing;
+    
+    const char* _spillPath;
+    uint32_t _spillMax;
+    uint32_t _spillSize;
+    uint32_t _spillRead;
+    
+    uint32_t _sent;
+    uint32_t _dropped;
+    uint32_t _coalesced;
+    uint32_t _spilled;
+    uint32_t _maxLatencyMs;
+    uint32_t _latencySumMs;
+    uint32_t _latencyCount;
+    
+    static size_t recordSize(size_t topicLen, size_t payloadLen);
+    static const char* topicOf(const Header* header);
+    static const uint8_t* payloadOf(const Header* header);
+    
+    Header* claim(const char* topic, size_t len, Priority priority, bool coalesce);
+    void supersede(const char* topic);
+    void remember(Header* header);
+    void forget(const Header* header);
+    void evict(Ring& ring);
+    bool spill(const Header* header);
+    bool reload();
+};
+
+#endif // MQTT_OUTBOX_H
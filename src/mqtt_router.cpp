@@ -0,0 +1,81 @@
+#include "mqtt_router.h"
+#include <string.h>
+
+MQTTRouter::MQTTRouter() : _count(0) {
+}
+
+bool MQTTRouter::add(const char* filter, MQTTRouteHandler handler, uint8_t qos) {
+    if (!handler || !validFilter(filter)) {
+        Serial.printf("[MQTT] Invalid route '%s'\n", filter ? filter : "");
+        return false;
+    }
+    if (_count == MQTT_ROUTES_MAX) {
+        Serial.printf("[MQTT] Route table full, '%s' not added\n", filter);
+        return false;
+    }
+    
+    Route& route = _routes[_count++];
+    route.filter = filter;
+    route.handler = handler;
+    route.qos = qos > 1 ? 1 : qos;  // PubSubClient subscribes at QoS 0 or 1
+    return true;
+}
+
+uint8_t MQTTRouter::dispatch(const char* topic, const uint8_t* payload, size_t length) const {
+    uint8_t handled = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+        if (matches(_routes[i].filter, topic)) {
+            _routes[i].handler(topic, payload, length);
+            handled++;
+        }
+    }
+    return handled;
+}
+
+// "+" and "#" only as whole levels, "#" only as the last one
+bool MQTTRouter::validFilter(const char* filter) {
+    if (!filter || !filter[0]) return false;
+    
+    for (const char* p = filter; *p; p++) {
+        if (*p != '+' && *p != '#') continue;
+        bool levelStart = p == filter || p[-1] == '/';
+        bool levelEnd = p[1] == '\0' || p[1] == '/';
+        if (!levelStart || !levelEnd || (*p == '#' && p[1] != '\0')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Walks both strings one level at a time; `filter` is assumed valid
+bool MQTTRouter::matches(const char* filter, const char* topic) {
+    if (topic[0] == '$' && (filter[0] == '+' || filter[0] == '#')) {
+        return false;
+    }
+    
+    while (*filter) {
+        if (*filter == '#') {
+            return true;
+        }
+        
+        if (*filter == '+') {
+            while (*topic && *topic != '/') topic++;
+            filter++;
+        } else {
+            while (*filter && *filter != '/') {
+                if (*filter++ != *topic++) return false;
+            }
+        }
+        
+        if (*filter != '/') {
+            return *topic == '\0';
+        }
+        if (*topic != '/') {
+            // "sport/#" also matches "sport" itself
+            return *topic == '\0' && strcmp(filter, "/#") == 0;
+        }
+        filter++;
+        topic++;
+    }
+    return *topic == '\0';
+}
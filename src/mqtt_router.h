@@ -0,0 +1,46 @@
+#ifndef MQTT_ROUTER_H
+#define MQTT_ROUTER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Handlers get a view of PubSubClient's packet buffer: it is only valid
+// during the call and is overwritten by the next publish, so copy what has
+// to outlive either.
+typedef void (*MQTTRouteHandler)(const char* topic, const uint8_t* payload, size_t length);
+
+// Topic filters registered at startup, matched against every inbound
+// message without copying topic or payload. Filters follow MQTT: "+" is
+// exactly one level, a trailing "#" is the parent and everything below it,
+// and neither matches topics starting with '$'. Every matching route is
+// called, in registration order.
+class MQTTRouter {
+public:
+    MQTTRouter();
+    
+    // `filter` is not copied, so it must be a literal. Fails when the table
+    // (MQTT_ROUTES_MAX) is full or the filter is malformed.
+    bool add(const char* filter, MQTTRouteHandler handler, uint8_t qos = 1);
+    
+    // Returns how many routes took the message
+    uint8_t dispatch(const char* topic, const uint8_t* payload, size_t length) const;
+    
+    uint8_t count() const { return _count; }
+    const char* filter(uint8_t i) const { return _routes[i].filter; }
+    uint8_t qos(uint8_t i) const { return _routes[i].qos; }
+    
+    static bool matches(const char* filter, const char* topic);
+    static bool validFilter(const char* filter);
+
+private:
+    struct Route {
+        const char* filter;
+        MQTTRouteHandler handler;
+        uint8_t qos;
+    };
+    
+    Route _routes[MQTT_ROUTES_MAX];
+    uint8_t _count;
+};
+
+#endif // MQTT_ROUTER_H
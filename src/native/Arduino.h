@@ -0,0 +1,39 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// The few Arduino core names the OTA modules use besides ota_platform.h:
+// Serial logging, min/max, random(), the flash sector size and PROGMEM
+// (which is plain memory here).
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+
+#define FLASH_SECTOR_SIZE 4096
+
+#define PROGMEM
+#define memcpy_P memcpy
+
+class NativeSerial {
+public:
+    void begin(unsigned long) {}
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    size_t print(const char* s);
+    size_t println(const char* s = "");
+};
+
+extern NativeSerial Serial;
+
+long random(long howbig);
+
+#endif // NATIVE_ARDUINO_H
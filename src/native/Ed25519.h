@@ -0,0 +1,25 @@
+#ifndef NATIVE_ED25519_H
+#define NATIVE_ED25519_H
+
+// rweather/Crypto's Ed25519::verify() on top of OpenSSL
+
+#include <stdint.h>
+#include <stddef.h>
+#include <openssl/evp.h>
+
+class Ed25519 {
+public:
+    static bool verify(const uint8_t* signature, const uint8_t* publicKey, const void* message, size_t len) {
+        EVP_PKEY* key = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr, publicKey, 32);
+        if (!key) return false;
+        
+        EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+        bool ok = ctx && EVP_DigestVerifyInit(ctx, nullptr, nullptr, nullptr, key) == 1 &&
+                  EVP_DigestVerify(ctx, signature, 64, (const unsigned char*)message, len) == 1;
+        EVP_MD_CTX_free(ctx);
+        EVP_PKEY_free(key);
+        return ok;
+    }
+};
+
+#endif // NATIVE_ED25519_H
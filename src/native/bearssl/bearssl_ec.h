@@ -0,0 +1,64 @@
+#ifndef NATIVE_BEARSSL_EC_H
+#define NATIVE_BEARSSL_EC_H
+
+// BearSSL's raw ECDSA verification on top of OpenSSL, P-256 only
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <openssl/bn.h>
+#include <openssl/ecdsa.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#define BR_EC_secp256r1 23
+
+typedef struct {
+    int curve;
+    unsigned char* q;
+    size_t qlen;
+} br_ec_public_key;
+
+typedef struct {
+    int unused;
+} br_ec_impl;
+
+static const br_ec_impl br_ec_p256_m15 = {0};
+
+static inline uint32_t br_ecdsa_i15_vrfy_raw(const br_ec_impl* impl, const void* hash, size_t hash_len,
+                                             const br_ec_public_key* pk, const void* sig, size_t sig_len) {
+    (void)impl;
+    if (pk->curve != BR_EC_secp256r1 || sig_len != 64) return 0;
+    
+    // SubjectPublicKeyInfo for an uncompressed P-256 point
+    static const unsigned char spkiHeader[] = {
+        0x30, 0x59, 0x30, 0x13, 0x06, 0x07, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x02, 0x01, 0x06, 0x08, 0x2a,
+        0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07, 0x03, 0x42, 0x00
+    };
+    if (pk->qlen != 65) return 0;
+    unsigned char spki[sizeof(spkiHeader) + 65];
+    memcpy(spki, spkiHeader, sizeof(spkiHeader));
+    memcpy(spki + sizeof(spkiHeader), pk->q, 65);
+    const unsigned char* p = spki;
+    EVP_PKEY* key = d2i_PUBKEY(nullptr, &p, sizeof(spki));
+    
+    // OpenSSL takes the signature DER-encoded
+    const unsigned char* raw = (const unsigned char*)sig;
+    ECDSA_SIG* s = ECDSA_SIG_new();
+    unsigned char* der = nullptr;
+    int derLen = -1;
+    if (s && ECDSA_SIG_set0(s, BN_bin2bn(raw, 32, nullptr), BN_bin2bn(raw + 32, 32, nullptr)) == 1) {
+        derLen = i2d_ECDSA_SIG(s, &der);
+    }
+    
+    EVP_PKEY_CTX* ctx = key ? EVP_PKEY_CTX_new(key, nullptr) : nullptr;
+    uint32_t ok = ctx && derLen > 0 && EVP_PKEY_verify_init(ctx) == 1 &&
+                  EVP_PKEY_verify(ctx, der, derLen, (const unsigned char*)hash, hash_len) == 1;
+    EVP_PKEY_CTX_free(ctx);
+    OPENSSL_free(der);
+    ECDSA_SIG_free(s);
+    EVP_PKEY_free(key);
+    return ok;
+}
+
+#endif // NATIVE_BEARSSL_EC_H
@@ -0,0 +1,83 @@
+#ifndef NATIVE_BEARSSL_HASH_H
+#define NATIVE_BEARSSL_HASH_H
+
+// BearSSL's SHA-256 API on top of OpenSSL, including the state export and
+// import that OTAJournal relies on, and the SHA-512 calls Ed25519Fast uses.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// The SHA256_* calls are deprecated in OpenSSL 3, but EVP does not expose
+// the midstate
+#ifndef OPENSSL_SUPPRESS_DEPRECATED
+#define OPENSSL_SUPPRESS_DEPRECATED
+#endif
+#include <openssl/sha.h>
+
+#define br_sha256_SIZE 32
+
+typedef struct {
+    SHA256_CTX ctx;
+} br_sha256_context;
+
+static inline void br_sha256_init(br_sha256_context* cc) {
+    SHA256_Init(&cc->ctx);
+}
+
+static inline void br_sha256_update(br_sha256_context* cc, const void* data, size_t len) {
+    SHA256_Update(&cc->ctx, data, len);
+}
+
+// Like BearSSL, leaves the context usable for further updates
+static inline void br_sha256_out(const br_sha256_context* cc, void* out) {
+    SHA256_CTX copy = cc->ctx;
+    SHA256_Final((unsigned char*)out, &copy);
+}
+
+// Only meaningful on a 64-byte block boundary, as in BearSSL
+static inline uint64_t br_sha256_state(const br_sha256_context* cc, void* out) {
+    uint8_t* p = (uint8_t*)out;
+    for (int i = 0; i < 8; i++) {
+        uint32_t v = cc->ctx.h[i];
+        p[i * 4] = v >> 24;
+        p[i * 4 + 1] = v >> 16;
+        p[i * 4 + 2] = v >> 8;
+        p[i * 4 + 3] = v;
+    }
+    return ((((uint64_t)cc->ctx.Nh << 32) | cc->ctx.Nl) >> 3);
+}
+
+static inline void br_sha256_set_state(br_sha256_context* cc, const void* stb, uint64_t count) {
+    const uint8_t* p = (const uint8_t*)stb;
+    memset(&cc->ctx, 0, sizeof(cc->ctx));
+    for (int i = 0; i < 8; i++) {
+        cc->ctx.h[i] = ((uint32_t)p[i * 4] << 24) | ((uint32_t)p[i * 4 + 1] << 16) |
+                       ((uint32_t)p[i * 4 + 2] << 8) | p[i * 4 + 3];
+    }
+    uint64_t bits = count << 3;
+    cc->ctx.Nl = (uint32_t)bits;
+    cc->ctx.Nh = (uint32_t)(bits >> 32);
+    cc->ctx.md_len = SHA256_DIGEST_LENGTH;
+}
+
+#define br_sha512_SIZE 64
+
+typedef struct {
+    SHA512_CTX ctx;
+} br_sha512_context;
+
+static inline void br_sha512_init(br_sha512_context* cc) {
+    SHA512_Init(&cc->ctx);
+}
+
+static inline void br_sha512_update(br_sha512_context* cc, const void* data, size_t len) {
+    SHA512_Update(&cc->ctx, data, len);
+}
+
+static inline void br_sha512_out(const br_sha512_context* cc, void* out) {
+    SHA512_CTX copy = cc->ctx;
+    SHA512_Final((unsigned char*)out, &copy);
+}
+
+#endif // NATIVE_BEARSSL_HASH_H
@@ -0,0 +1,199 @@
+// Entry point of the native env: one checkForUpdates() against MANIFEST_URL
+// on a Linux host, ticked until the updater is idle again, with ota/metrics
+// printed instead of published.
+//
+//   .pio/build/native/program [running.bin]
+//
+// With OTA_NATIVE_MANIFEST=<file> the file is handed over as the payload of
+// an MQTT trigger (checkManifest()) instead.
+//
+// "mqtt:<file>" downloads are answered in-process from OTA_NATIVE_MQTT_DIR,
+// one chunk per publisher loop(), the way a broker would deliver them.
+// OTA_NATIVE_MQTT_DROP=<n> loses the n-th chunk sent, to exercise recovery.
+//
+// running.bin is placed at flash address 0 as the image being updated, which
+// delta updates need. The process exits 0 once an update was committed and
+// the emulated restart copied it over the running image, 1 otherwise.
+#ifndef PIO_UNIT_TESTING
+
+#include <Arduino.h>
+#include "config.h"
+#include "ota_platform.h"
+#include "ota_clock.h"
+#include "ota_updater.h"
+
+class StdoutPublisher : public OTAPublisher {
+public:
+    StdoutPublisher() : _updater(nullptr), _file(nullptr), _offset(0), _limit(0), _total(0), _chunk(0),
+                        _sent(0), _drop(0) {}
+    
+    ~StdoutPublisher() {
+        if (_file) fclose(_file);
+    }
+    
+    void serveFirmware(OTAUpdater* updater) {
+        _updater = updater;
+        const char* drop = getenv("OTA_NATIVE_MQTT_DROP");
+        _drop = drop ? atoi(drop) : 0;
+    }
+    
+    void loop() {
+        if (!_file || _offset >= _limit || _offset >= _total) return;
+        
+        uint8_t payload[OTA_MQTT_CHUNK_HEADER + OTA_MQTT_CHUNK];
+        size_t len = min((size_t)_chunk, (size_t)(min(_limit, _total) - _offset));
+        fseek(_file, _offset, SEEK_SET);
+        len = fread(payload + OTA_MQTT_CHUNK_HEADER, 1, len, _file);
+        writeHeader(payload, _offset, _total);
+        _offset += len;
+        if (++_sent == _drop) {
+            Serial.printf("[NATIVE] Dropping chunk %u\n", _sent);
+            return;
+        }
+        _updater->mqttTransfer().onChunk(payload, OTA_MQTT_CHUNK_HEADER + len);
+    }
+    
+    bool publish(const char* topic, const char* payload) {
+        if (_updater && strcmp(topic, MQTT_TOPIC_FW_REQUEST) == 0) {
+            fileRequest(payload);
+            return true;
+        }
+        if (_updater && strcmp(topic, MQTT_TOPIC_FW_ACK) == 0) {
+            _limit = strtoul(payload, nullptr, 10);
+            return true;
+        }
+        Serial.printf("[PUBLISH] %s %s\n", topic, payload);
+        return true;
+    }
+    bool publish(const char* topic, const uint8_t* payload, size_t len) {
+        Serial.printf("[PUBLISH] %s %u bytes: ", topic, (unsigned)len);
+        for (size_t i = 0; i < len; i++) {
+            Serial.printf("%02x", payload[i]);
+        }
+        Serial.println();
+        return true;
+    }
+
+private:
+    OTAUpdater* _updater;
+    FILE* _file;
+    uint32_t _offset;
+    uint32_t _limit;
+    uint32_t _total;
+    uint32_t _chunk;
+    uint32_t _sent;
+    uint32_t _drop;
+    
+    static void writeHeader(uint8_t* out, uint32_t offset, uint32_t total) {
+        for (int i = 0; i < 4; i++) {
+            out[i] = offset >> (8 * i);
+            out[4 + i] = total >> (8 * i);
+        }
+    }
+    
+    static uint32_t jsonNumber(const char* json, const char* key) {
+        const char* p = strstr(json, key);
+        return p ? strtoul(p + strlen(key), nullptr, 10) : 0;
+    }
+    
+    // {"file":"..","offset":N,"limit":L,"chunk":C} restarts the stream
+    void fileRequest(const char* json) {
+        Serial.printf("[NATIVE] Firmware request %s\n", json);
+        char name[64] = "";
+        const char* file = strstr(json, "\"file\":\"");
+        if (file) {
+            sscanf(file + 8, "%63[^\"]", name);
+        }
+        
+        if (_file) fclose(_file);
+        char path[256];
+        const char* dir = getenv("OTA_NATIVE_MQTT_DIR");
+        snprintf(path, sizeof(path), "%s/%s", dir ? dir : ".", name);
+        _file = fopen(path, "rb");
+        _offset = jsonNumber(json, "\"offset\":");
+        _limit = jsonNumber(json, "\"limit\":");
+        _chunk = min(jsonNumber(json, "\"chunk\":"), (uint32_t)OTA_MQTT_CHUNK);
+        
+        if (!_file) {
+            uint8_t missing[OTA_MQTT_CHUNK_HEADER];
+            writeHeader(missing, 0, 0);
+            _updater->mqttTransfer().onChunk(missing, sizeof(missing));
+            return;
+        }
+        fseek(_file, 0, SEEK_END);
+        _total = ftell(_file);
+    }
+};
+
+static bool loadRunningImage(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        Serial.printf("[NATIVE] Cannot open %s\n", path);
+        return false;
+    }
+    
+    uint8_t buffer[FLASH_SECTOR_SIZE];
+    uint32_t size = 0;
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        // Same padding as a real flash write of the tail
+        size_t writeLen = (n + 3) & ~3;
+        memset(buffer + n, 0xFF, writeLen - n);
+        if (!otaFlashErase(size / FLASH_SECTOR_SIZE) || !otaFlashWrite(size, buffer, writeLen)) {
+            fclose(f);
+            return false;
+        }
+        size += n;
+    }
+    fclose(f);
+    
+    Serial.printf("[NATIVE] Running image %s: %u bytes\n", path, size);
+    return otaStorageWrite("sketch.size", &size, sizeof(size));
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    srandom(time(nullptr));
+    
+    Serial.println("=== OTA Firmware Updater (native) ===");
+    Serial.printf("Current Version    : %s\n", FIRMWARE_VERSION);
+    Serial.printf("Manifest           : %s\n", MANIFEST_URL);
+    
+    if (argc > 1 && !loadRunningImage(argv[1])) {
+        return 2;
+    }
+    
+    StdoutPublisher publisher;
+    OTAUpdater updater;
+    updater.setPublisher(&publisher);
+    publisher.serveFirmware(&updater);
+    
+    // The host is online and its clock synced from the start, so the boot
+    // phases take no time
+    otaClockSynced();
+    updater.beginBoot();
+    updater.bootPhase(BOOT_WIFI);
+    updater.bootPhase(BOOT_CLOCK, otaClockSourceName(otaClockSource()));
+    updater.bootPhase(BOOT_NTP);
+    updater.bootPhase(BOOT_MQTT);
+    updater.bootReady();
+    const char* inlineManifest = getenv("OTA_NATIVE_MANIFEST");
+    if (inlineManifest && inlineManifest[0]) {
+        uint8_t payload[MANIFEST_MAX_SIZE + 1];
+        FILE* f = fopen(inlineManifest, "rb");
+        size_t len = f ? fread(payload, 1, sizeof(payload), f) : 0;
+        if (f) fclose(f);
+        updater.checkManifest(payload, len);
+    } else {
+        updater.checkForUpdates();
+    }
+    while (updater.busy()) {
+        updater.tick();
+    }
+    updater.tick();  // flushes the records of a trigger that was turned down
+    
+    // otaRestart() exits after a committed update
+    return 1;
+}
+
+#endif // PIO_UNIT_TESTING
@@ -0,0 +1,256 @@
+#include "ota_platform.h"
+#include <Arduino.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Emulated device state lives in OTA_NATIVE_DIR (default ./ota-native):
+//   flash.bin   - flash from address 0 up to the end of the OTA slot
+//   sketch.size - size of the image currently "running" at address 0
+//   rtc.bin     - retained records, the RTC user memory of the device
+//   <path>      - storage records, e.g. ota.journal
+#define NATIVE_SLOT_END 0x200000  // 1 MB sketch + 1 MB OTA slot
+
+NativeSerial Serial;
+
+static uint32_t scheduledCopyAddress;
+static uint32_t scheduledCopySize;
+
+size_t NativeSerial::printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vprintf(format, args);
+    va_end(args);
+    return n > 0 ? n : 0;
+}
+
+size_t NativeSerial::print(const char* s) {
+    return fputs(s, stdout) >= 0 ? strlen(s) : 0;
+}
+
+size_t NativeSerial::println(const char* s) {
+    return print(s) + print("\n");
+}
+
+long random(long howbig) {
+    return howbig > 0 ? ::random() % howbig : 0;
+}
+
+static const char* nativeDir() {
+    const char* dir = getenv("OTA_NATIVE_DIR");
+    return dir && dir[0] ? dir : "ota-native";
+}
+
+static void nativePath(const char* name, char* out, size_t outLen) {
+    while (*name == '/') name++;
+    snprintf(out, outLen, "%s/%s", nativeDir(), name);
+}
+
+static int openFlash() {
+    char path[256];
+    mkdir(nativeDir(), 0755);
+    nativePath("flash.bin", path, sizeof(path));
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd >= 0) {
+        ftruncate(fd, NATIVE_SLOT_END);
+    }
+    return fd;
+}
+
+// Counts from process start, like millis() from boot on the device
+static uint64_t monotonicUs() {
+    static uint64_t startUs = 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    if (startUs == 0) startUs = now;
+    return now - startUs;
+}
+
+uint32_t otaMillis() {
+    return (uint32_t)(monotonicUs() / 1000);
+}
+
+uint32_t otaMicros() {
+    return (uint32_t)monotonicUs();
+}
+
+void otaDelay(uint32_t ms) {
+    usleep(ms * 1000);
+}
+
+void otaYield() {
+    sched_yield();
+}
+
+void otaHeapStats(OTAHeapStats& stats) {
+    // glibc has no largest-free-block figure; report free arena bytes for both
+    struct mallinfo2 info = mallinfo2();
+    stats.freeHeap = (uint32_t)info.fordblks;
+    stats.maxBlock = (uint32_t)info.fordblks;
+    stats.fragmentation = 0;
+}
+
+uint32_t otaFreeHeap() {
+    return (uint32_t)mallinfo2().fordblks;
+}
+
+bool otaNetworkUp() {
+    return true;
+}
+
+int otaRssi() {
+    return 0;
+}
+
+bool otaStorageRead(const char* name, void* data, size_t len) {
+    char path[256];
+    nativePath(name, path, sizeof(path));
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    
+    size_t n = fread(data, 1, len, f);
+    fclose(f);
+    return n == len;
+}
+
+bool otaStorageWrite(const char* name, const void* data, size_t len) {
+    char path[256];
+    mkdir(nativeDir(), 0755);
+    nativePath(name, path, sizeof(path));
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    
+    size_t n = fwrite(data, 1, len, f);
+    return fclose(f) == 0 && n == len;
+}
+
+void otaStorageRemove(const char* name) {
+    char path[256];
+    nativePath(name, path, sizeof(path));
+    unlink(path);
+}
+
+bool otaStorageAppend(const char* name, const void* data, size_t len) {
+    char path[256];
+    mkdir(nativeDir(), 0755);
+    nativePath(name, path, sizeof(path));
+    FILE* f = fopen(path, "ab");
+    if (!f) return false;
+    
+    size_t n = fwrite(data, 1, len, f);
+    return fclose(f) == 0 && n == len;
+}
+
+bool otaStorageReadAt(const char* name, uint32_t offset, void* data, size_t len) {
+    char path[256];
+    nativePath(name, path, sizeof(path));
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    
+    bool ok = fseek(f, offset, SEEK_SET) == 0 && fread(data, 1, len, f) == len;
+    fclose(f);
+    return ok;
+}
+
+uint32_t otaStorageSize(const char* name) {
+    char path[256];
+    struct stat st;
+    nativePath(name, path, sizeof(path));
+    return stat(path, &st) == 0 ? st.st_size : 0;
+}
+
+// Read and written in place, so each region keeps its offset in the file
+bool otaRetainedRead(OTARetainedRegion region, void* data, size_t len) {
+    const OTARetainedSpan& span = otaRetainedLayout[region];
+    return len <= span.size && otaStorageReadAt("rtc.bin", span.offset, data, len);
+}
+
+bool otaRetainedWrite(OTARetainedRegion region, const void* data, size_t len) {
+    const OTARetainedSpan& span = otaRetainedLayout[region];
+    if (len > span.size) return false;
+    
+    char path[256];
+    nativePath("rtc.bin", path, sizeof(path));
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+    
+    bool ok = pwrite(fd, data, len, span.offset) == (ssize_t)len;
+    close(fd);
+    return ok;
+}
+
+uint32_t otaSketchSize() {
+    uint32_t size = 0;
+    otaStorageRead("sketch.size", &size, sizeof(size));
+    return size;
+}
+
+uint32_t otaSlotEnd() {
+    return NATIVE_SLOT_END;
+}
+
+bool otaFlashErase(uint32_t sector) {
+    uint8_t erased[FLASH_SECTOR_SIZE];
+    memset(erased, 0xFF, sizeof(erased));
+    return otaFlashWrite(sector * FLASH_SECTOR_SIZE, erased, sizeof(erased));
+}
+
+bool otaFlashWrite(uint32_t address, const uint8_t* data, size_t len) {
+    if (address % 4 != 0 || len % 4 != 0 || address + len > NATIVE_SLOT_END) {
+        return false;
+    }
+    int fd = openFlash();
+    if (fd < 0) return false;
+    
+    bool ok = pwrite(fd, data, len, address) == (ssize_t)len;
+    close(fd);
+    return ok;
+}
+
+bool otaFlashRead(uint32_t address, uint8_t* data, size_t len) {
+    if (address + len > NATIVE_SLOT_END) {
+        return false;
+    }
+    int fd = openFlash();
+    if (fd < 0) return false;
+    
+    bool ok = pread(fd, data, len, address) == (ssize_t)len;
+    close(fd);
+    return ok;
+}
+
+bool otaAdaptImageHeader(uint8_t*, size_t len) {
+    // The host flash file has no mode or chip size to match
+    return len >= 4;
+}
+
+bool otaScheduleCopy(uint32_t address, uint32_t size) {
+    scheduledCopyAddress = address;
+    scheduledCopySize = size;
+    return true;
+}
+
+void otaRestart() {
+    // Do what eboot does on the next boot, then end the process
+    if (scheduledCopySize > 0) {
+        uint8_t buffer[FLASH_SECTOR_SIZE];
+        for (uint32_t offset = 0; offset < scheduledCopySize; offset += sizeof(buffer)) {
+            if (!otaFlashRead(scheduledCopyAddress + offset, buffer, sizeof(buffer)) ||
+                !otaFlashWrite(offset, buffer, sizeof(buffer))) {
+                Serial.println("[PLATFORM] Boot copy failed");
+                exit(2);
+            }
+        }
+        otaStorageWrite("sketch.size", &scheduledCopySize, sizeof(scheduledCopySize));
+        Serial.printf("[PLATFORM] Copied %u bytes from 0x%06x to 0x000000\n",
+                      scheduledCopySize, scheduledCopyAddress);
+    }
+    Serial.println("[PLATFORM] Restart");
+    fflush(stdout);
+    exit(0);
+}
@@ -0,0 +1,170 @@
+#include "ota_transport.h"
+#include "ota_platform.h"
+#include <Arduino.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+OTATransport::OTATransport() : _fd(-1), _timeout(1000), _eof(false), _rxStart(0), _rxEnd(0), _resumed(false) {
+}
+
+OTATransport::~OTATransport() {
+    stop();
+}
+
+bool OTATransport::connect(const char* host, uint16_t port) {
+    stop();
+    _resumed = false;
+    
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    
+    struct addrinfo* result;
+    if (getaddrinfo(host, service, &hints, &result) != 0) {
+        Serial.printf("[NET] Cannot resolve %s\n", host);
+        return false;
+    }
+    
+    for (struct addrinfo* ai = result; ai && _fd < 0; ai = ai->ai_next) {
+        _fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (_fd < 0) continue;
+        if (::connect(_fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(_fd);
+            _fd = -1;
+        }
+    }
+    freeaddrinfo(result);
+    if (_fd < 0) return false;
+    
+    int one = 1;
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    _eof = false;
+    return true;
+}
+
+bool OTATransport::connected() {
+    if (_rxEnd > _rxStart) return true;
+    if (_fd < 0 || _eof) return false;
+    
+    // A readable socket with nothing to read was closed by the peer
+    uint8_t c;
+    ssize_t n = recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        _eof = true;
+        return false;
+    }
+    return true;
+}
+
+int OTATransport::available() {
+    if (_rxEnd > _rxStart) return _rxEnd - _rxStart;
+    if (_fd < 0) return 0;
+    
+    int n = 0;
+    if (ioctl(_fd, FIONREAD, &n) != 0) return 0;
+    if (n == 0) {
+        // The download loops poll available(); wait briefly instead of spinning
+        struct pollfd pfd = {_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 1) > 0 && ioctl(_fd, FIONREAD, &n) != 0) return 0;
+    }
+    return n;
+}
+
+int OTATransport::read(uint8_t* buffer, size_t len) {
+    if (_rxEnd > _rxStart) {
+        size_t n = min(len, _rxEnd - _rxStart);
+        memcpy(buffer, _rx + _rxStart, n);
+        peekConsume(n);
+        return n;
+    }
+    if (_fd < 0) return -1;
+    
+    ssize_t n = recv(_fd, buffer, len, MSG_DONTWAIT);
+    if (n == 0) _eof = true;
+    return n > 0 ? (int)n : -1;
+}
+
+size_t OTATransport::write(const uint8_t* data, size_t len) {
+    if (_fd < 0) return 0;
+    
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = send(_fd, data + sent, len - sent, MSG_NOSIGNAL);
+        if (n <= 0) break;
+        sent += n;
+    }
+    return sent;
+}
+
+void OTATransport::stop() {
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+    _eof = false;
+    _rxStart = _rxEnd = 0;
+}
+
+int OTATransport::readLine(char* line, size_t maxLen) {
+    size_t n = 0;
+    while (true) {
+        char c;
+        if (_rxEnd > _rxStart) {
+            c = _rx[_rxStart];
+            peekConsume(1);
+        } else {
+            if (_fd < 0) return -1;
+            struct pollfd pfd = {_fd, POLLIN, 0};
+            if (poll(&pfd, 1, _timeout) <= 0) return -1;
+            
+            ssize_t r = recv(_fd, &c, 1, 0);
+            if (r <= 0) {
+                _eof = true;
+                return -1;
+            }
+        }
+        if (c == '\n') return n;
+        if (n < maxLen) line[n++] = c;
+    }
+}
+
+void OTATransport::setTimeout(uint32_t ms) {
+    _timeout = ms;
+}
+
+// The socket API has no view into kernel buffers, so peeking receives into
+// _rx; the OTA code paths are the same as on the device
+bool OTATransport::hasPeek() {
+    return true;
+}
+
+size_t OTATransport::peekAvailable() {
+    if (_rxEnd == _rxStart && available() > 0) {
+        ssize_t n = recv(_fd, _rx, sizeof(_rx), MSG_DONTWAIT);
+        if (n == 0) _eof = true;
+        _rxStart = 0;
+        _rxEnd = n > 0 ? n : 0;
+    }
+    return _rxEnd - _rxStart;
+}
+
+const uint8_t* OTATransport::peekBuffer() {
+    return _rx + _rxStart;
+}
+
+void OTATransport::peekConsume(size_t len) {
+    _rxStart += min(len, _rxEnd - _rxStart);
+    if (_rxStart == _rxEnd) {
+        _rxStart = _rxEnd = 0;
+    }
+}
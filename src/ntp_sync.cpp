@@ -1,48 +1,71 @@
 #include "ntp_sync.h"
 #include "config.h"
+#include "ota_clock.h"
+#include "ota_platform.h"
 #include <time.h>
 #include <sys/time.h>
 #include <coredecls.h>
 
+#define NTP_CLOCK_MAGIC 0x4E545031  // "NTP1"
+
+static_assert(sizeof(NTPClockRecord) <= otaRetainedLayout[RETAINED_CLOCK].size, "Clock record does not fit its RTC region");
+
 NTPSync::NTPSync() {
-    _timeout = NTP_SYNC_TIMEOUT;
+    _synced = false;
+    _announced = false;
+    _lastSave = 0;
 }
 
-bool NTPSync::initialize() {
+void NTPSync::begin() {
     Serial.println("[NTP] Initializing SNTP...");
     
-    // Configure NTP servers
+    // A restart seeds the clock with the time saved before it, which is off
+    // by the time the device was down: close enough for certificate checks
+    NTPClockRecord record;
+    if (otaRetainedRead(RETAINED_CLOCK, &record, sizeof(record)) &&
+        record.magic == NTP_CLOCK_MAGIC &&
+        record.check == otaRecordChecksum(&record, offsetof(NTPClockRecord, check))) {
+        otaClockSeed(record.epoch, CLOCK_RTC);
+    }
+    
+    // Called from the SNTP client once it has set the clock; the seed above
+    // calls it too, with fromSntp false
+    settimeofday_cb([this](bool fromSntp) {
+        if (fromSntp) _synced = true;
+    });
+    
+    // Configure NTP servers; SNTP starts once WiFi is up
     configTime(9 * 3600, 0, NTP_SERVER1, NTP_SERVER2, NTP_SERVER3);
     
     // Set timezone
     setenv("TZ", NTP_TIMEZONE, 1);
     tzset();
-    
-    // Wait for time to be set
-    Serial.print("[NTP] Waiting for time sync");
-    time_t now = time(nullptr);
-    int retry = 0;
-    while (now < 8 * 3600 * 2 && retry < _timeout) {
-        delay(1000);
-        Serial.print(".");
-        now = time(nullptr);
-        retry++;
+}
+
+void NTPSync::loop() {
+    if (_synced && !_announced) {
+        _announced = true;
+        otaClockSynced();
+        Serial.printf("[NTP] System time synced: %s\n", getCurrentTime().c_str());
+        save();
     }
-    Serial.println();
     
-    if (now > 8 * 3600 * 2) {
-        struct tm timeinfo;
-        localtime_r(&now, &timeinfo);
-        char timeStr[64];
-        strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", &timeinfo);
-        Serial.printf("[NTP] System time synced: %s\n", timeStr);
-        return true;
-    } else {
-        Serial.println("[NTP] Failed to sync time, continuing anyway...");
-        return false;
+    // A seeded clock is only saved back once a server confirmed it, so it
+    // does not fall further behind with every restart
+    if (otaClockSource() >= CLOCK_HTTP_DATE && millis() - _lastSave >= NTP_RTC_SAVE_INTERVAL) {
+        save();
     }
 }
 
+void NTPSync::save() {
+    NTPClockRecord record;
+    record.magic = NTP_CLOCK_MAGIC;
+    record.epoch = time(nullptr);
+    record.check = otaRecordChecksum(&record, offsetof(NTPClockRecord, check));
+    otaRetainedWrite(RETAINED_CLOCK, &record, sizeof(record));
+    _lastSave = millis();
+}
+
 String NTPSync::getCurrentTime() {
     time_t now = time(nullptr);
     struct tm timeinfo;
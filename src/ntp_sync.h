@@ -3,14 +3,29 @@
 
 #include <Arduino.h>
 
+// The last synced wall clock, kept in RTC memory (RETAINED_CLOCK) so a
+// restart can seed the clock before SNTP answers. Survives a restart but
+// not a power cycle.
+struct NTPClockRecord {
+    uint32_t magic;
+    uint32_t epoch;
+    uint32_t check;
+};
+
 class NTPSync {
 public:
     NTPSync();
-    bool initialize();
+    void begin();   // seeds the clock from RTC memory and starts SNTP, never blocks
+    void loop();    // notices the sync and keeps the RTC copy of the clock fresh
+    bool synced() const { return _synced; }
     String getCurrentTime();
-    
+
 private:
-    int _timeout;
+    void save();
+    
+    volatile bool _synced;
+    bool _announced;
+    unsigned long _lastSave;
 };
 
 #endif // NTP_SYNC_H
@@ -0,0 +1,215 @@
+#include "ota_bench.h"
+#include "ota_metrics.h"
+#include "manifest_parser.h"
+#include "ota_signature.h"
+#include "config.h"
+#include <Arduino.h>
+#include <bearssl/bearssl_hash.h>
+
+// SHA-256("ota-bench") signed with the development keys noted in config.h.
+// Fixed here so a changed key does not break the benchmark; only
+// ed25519-fast, whose tables are built for PUBLIC_KEY_HEX, needs the
+// development key configured.
+static const char BENCH_PUBLIC_KEY[] = "0bc12f3d718204686b669042d921c91db12f83340e80c4837892828051fafcd8";
+static const char BENCH_HASH[] = "f389648919ffe2cf8c293cc03c4cb529c9a2545d73ee0f806ce283b02b212b32";
+static const char BENCH_SIGNATURE[] =
+    "074d9cacd6f559324b059b98180d42b950d8ca77a920b47e66a993833c68d4aa"
+    "bcbba401ec00755dd76daeb8e591afe7964637140fe5bec3fdc09ad22fc59b06";
+static const char BENCH_ECDSA_PUBLIC_KEY[] =
+    "046bb26b21e9d717b91d7b0f54dbe2a56f0236bb5793ec96bb49bbe29817acaa21"
+    "8ede32d5ed4c4f1115ac9ab2f51e1bac9285e2d20ae2376a8de2f7fa59d20555";
+static const char BENCH_ECDSA_SIGNATURE[] =
+    "0240d3d34e72faeaa2c0f6f4856b1519f78ed114291ce88e2dcdb0c4ab4a078e"
+    "04ed60648489a3371dd99e5cde8834941984833ebe87e308564d8ca5f171f93c";
+
+#define BENCH_HEX_ROUNDS 1000
+
+OTABench::OTABench(OTAPublisher& out) : _out(out), _failed(false) {
+}
+
+void OTABench::run() {
+    static const size_t shaChunks[] = {64, 512, 1024, 4096};
+    static const size_t loopBuffers[] = {128, 256, 512, 1024, 2048};
+    
+    for (size_t i = 0; i < sizeof(shaChunks) / sizeof(shaChunks[0]); i++) {
+        benchSha256(shaChunks[i]);
+    }
+    benchVerify();
+    benchHexDecode();
+    for (size_t i = 0; i < sizeof(loopBuffers) / sizeof(loopBuffers[0]); i++) {
+        benchDownloadLoop(loopBuffers[i], false);
+    }
+    // OTA_ZERO_COPY: one TCP segment per peek
+    benchDownloadLoop(1460, true);
+}
+
+void OTABench::benchSha256(size_t chunk) {
+    uint8_t* data = (uint8_t*)malloc(chunk);
+    if (!data) {
+        Serial.printf("[BENCH] Out of memory for %u byte chunk\n", (unsigned)chunk);
+        _failed = true;
+        return;
+    }
+    for (size_t i = 0; i < chunk; i++) {
+        data[i] = (uint8_t)(i * 31 + 7);
+    }
+    
+    uint32_t iterations = OTA_BENCH_VOLUME / chunk;
+    uint8_t digest[32];
+    br_sha256_context ctx;
+    
+    uint32_t start = otaMicros();
+    br_sha256_init(&ctx);
+    for (uint32_t i = 0; i < iterations; i++) {
+        br_sha256_update(&ctx, data, chunk);
+    }
+    br_sha256_out(&ctx, digest);
+    uint32_t elapsed = otaMicros() - start;
+    
+    char stage[32];
+    snprintf(stage, sizeof(stage), "bench_sha256_%u", (unsigned)chunk);
+    report(stage, elapsed, iterations * chunk, iterations);
+    free(data);
+}
+
+void OTABench::benchVerify() {
+    uint8_t publicKey[32];
+    uint8_t ecdsaKey[65];
+    ManifestParser::hexToBytes(BENCH_PUBLIC_KEY, publicKey, sizeof(publicKey));
+    ManifestParser::hexToBytes(BENCH_ECDSA_PUBLIC_KEY, ecdsaKey, sizeof(ecdsaKey));
+    
+    Ed25519Backend ed25519(publicKey);
+    benchBackend("bench_ed25519_verify", ed25519, BENCH_SIGNATURE);
+    
+    if (strcmp(PUBLIC_KEY_HEX, BENCH_PUBLIC_KEY) == 0) {
+        Ed25519FastBackend ed25519Fast;
+        benchBackend("bench_ed25519_fast_verify", ed25519Fast, BENCH_SIGNATURE);
+    } else {
+        Serial.println("[BENCH] Skipping ed25519-fast: PUBLIC_KEY_HEX is not the development key");
+    }
+    
+    EcdsaP256Backend ecdsa(ecdsaKey);
+    benchBackend("bench_ecdsa_p256_verify", ecdsa, BENCH_ECDSA_SIGNATURE);
+}
+
+void OTABench::benchBackend(const char* stage, const OTASignatureBackend& backend, const char* signatureHex) {
+    uint8_t hash[32];
+    uint8_t signature[64];
+    ManifestParser::hexToBytes(BENCH_HASH, hash, sizeof(hash));
+    ManifestParser::hexToBytes(signatureHex, signature, sizeof(signature));
+    
+    bool verified = true;
+    uint32_t start = otaMicros();
+    for (int i = 0; i < OTA_BENCH_VERIFY_ROUNDS; i++) {
+        verified &= backend.verify(hash, sizeof(hash), signature);
+        
+        // One verify is close to the software watchdog limit on the device
+        otaYield();
+    }
+    uint32_t elapsed = otaMicros() - start;
+    
+    if (!verified) {
+        Serial.printf("[BENCH] ERROR: %s test vector did not verify\n", backend.name());
+        _failed = true;
+    }
+    report(stage, elapsed, sizeof(hash), OTA_BENCH_VERIFY_ROUNDS);
+}
+
+void OTABench::benchHexDecode() {
+    // The manifest carries hashes as 64 and signatures as 128 hex characters
+    uint8_t out[64];
+    uint32_t start = otaMicros();
+    for (int i = 0; i < BENCH_HEX_ROUNDS; i++) {
+        if (ManifestParser::hexToBytes(BENCH_HASH, out, 32) != 32 ||
+            ManifestParser::hexToBytes(BENCH_SIGNATURE, out, 64) != 64) {
+            Serial.println("[BENCH] ERROR: Hex decoding failed");
+            _failed = true;
+            return;
+        }
+    }
+    uint32_t elapsed = otaMicros() - start;
+    report("bench_hex_decode", elapsed, BENCH_HEX_ROUNDS * (32 + 64), BENCH_HEX_ROUNDS * 2);
+}
+
+void OTABench::benchDownloadLoop(size_t bufferSize, bool zeroCopy) {
+    // Per-chunk work of OTAUpdater::readFirmware(): sector-bounded reads,
+    // hashing, copying into the sector buffer, the timers and yield. The
+    // socket read is a memcpy and flash writes are left out; both cost the
+    // same per byte at every buffer size, so only the loop overhead differs.
+    // With zeroCopy, hashing and the sector copy read the "network buffer"
+    // directly, as with OTA_ZERO_COPY.
+    uint8_t* source = (uint8_t*)malloc(FLASH_SECTOR_SIZE);
+    uint8_t* sector = (uint8_t*)malloc(FLASH_SECTOR_SIZE);
+    uint8_t* buffer = (uint8_t*)malloc(bufferSize);
+    if (!source || !sector || !buffer) {
+        Serial.printf("[BENCH] Out of memory for %u byte buffer\n", (unsigned)bufferSize);
+        _failed = true;
+        free(source);
+        free(sector);
+        free(buffer);
+        return;
+    }
+    for (size_t i = 0; i < FLASH_SECTOR_SIZE; i++) {
+        source[i] = (uint8_t)(i * 13 + 5);
+    }
+    
+    br_sha256_context ctx;
+    uint8_t digest[32];
+    uint32_t offset = 0;
+    uint32_t iterations = 0;
+    size_t sectorFill = 0;
+    
+    uint32_t start = otaMicros();
+    br_sha256_init(&ctx);
+    while (offset < OTA_BENCH_VOLUME) {
+        size_t toRead = min(bufferSize, (size_t)(OTA_BENCH_VOLUME - offset));
+        toRead = min(toRead, (size_t)(FLASH_SECTOR_SIZE - offset % FLASH_SECTOR_SIZE));
+        const uint8_t* data = source + offset % FLASH_SECTOR_SIZE;
+        if (!zeroCopy) {
+            memcpy(buffer, data, toRead);
+            data = buffer;
+        }
+        
+        br_sha256_update(&ctx, data, toRead);
+        memcpy(sector + sectorFill, data, toRead);
+        sectorFill = (sectorFill + toRead) % FLASH_SECTOR_SIZE;
+        
+        offset += toRead;
+        iterations++;
+        otaYield();
+    }
+    br_sha256_out(&ctx, digest);
+    uint32_t elapsed = otaMicros() - start;
+    
+    char stage[32];
+    if (zeroCopy) {
+        snprintf(stage, sizeof(stage), "bench_loop_zero_copy_%u", (unsigned)bufferSize);
+    } else {
+        snprintf(stage, sizeof(stage), "bench_loop_%u", (unsigned)bufferSize);
+    }
+    report(stage, elapsed, offset, iterations);
+    
+    free(source);
+    free(sector);
+    free(buffer);
+}
+
+void OTABench::report(const char* stage, uint32_t elapsedUs, uint32_t bytes, uint32_t iterations) {
+    // Heap is sampled while the kernel's buffers are still allocated
+    OTAHeapStats heap;
+    otaHeapStats(heap);
+    char timestamp[24];
+    otaTimestamp(timestamp, sizeof(timestamp));
+    
+    char extra[112];
+    int len = snprintf(extra, sizeof(extra), ",\"elapsed_us\":%u,\"bytes\":%u,\"iterations\":%u",
+                       (unsigned)elapsedUs, (unsigned)bytes, (unsigned)iterations);
+    if (bytes >= 1024 && len > 0 && len < (int)sizeof(extra)) {
+        snprintf(extra + len, sizeof(extra) - len, ",\"ns_per_kb\":%u",
+                 (unsigned)((uint64_t)elapsedUs * 1000 * 1024 / bytes));
+    }
+    
+    char msg[384];
+    otaFormatMetrics(msg, sizeof(msg), stage, elapsedUs / 1000, heap, timestamp, extra);
+    _out.publish("ota/bench", msg);
+}
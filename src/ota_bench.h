@@ -0,0 +1,49 @@
+#ifndef OTA_BENCH_H
+#define OTA_BENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ota_platform.h"
+
+class OTASignatureBackend;
+
+// Verifications per signature backend and run; the device needs most of a
+// second for one with the slower backends
+#ifndef OTA_BENCH_VERIFY_ROUNDS
+#define OTA_BENCH_VERIFY_ROUNDS 3
+#endif
+
+// Bytes pushed through each SHA-256 size and download loop buffer size
+// (multiple of 4096)
+#ifndef OTA_BENCH_VOLUME
+#define OTA_BENCH_VOLUME 65536
+#endif
+
+// Micro-benchmarks of the kernels behind the coarse OTA stages: SHA-256 per
+// input size, signature verification per backend (ota_signature.h), hex
+// decoding and the download loop at several buffer sizes, with and without
+// the copy out of the network buffer. Each result is published on ota/bench
+// as an ota/metrics message (see ota_metrics.h) with elapsed_us, bytes,
+// iterations and, where it applies, ns_per_kb added, so two releases can be
+// diffed with tools/ota_bench_diff.py.
+class OTABench {
+public:
+    explicit OTABench(OTAPublisher& out);
+    
+    void run();
+    bool failed() const { return _failed; }
+    
+    void benchSha256(size_t chunk);
+    void benchVerify();
+    void benchHexDecode();
+    void benchDownloadLoop(size_t bufferSize, bool zeroCopy);
+
+private:
+    OTAPublisher& _out;
+    bool _failed;
+    
+    void benchBackend(const char* stage, const OTASignatureBackend& backend, const char* signatureHex);
+    void report(const char* stage, uint32_t elapsedUs, uint32_t bytes, uint32_t iterations);
+};
+
+#endif // OTA_BENCH_H
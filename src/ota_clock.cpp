@@ -0,0 +1,70 @@
+#include "ota_clock.h"
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+// Anything before 2001 is the clock counting up from 0 after boot
+#define CLOCK_VALID_AFTER 1000000000
+
+static OTAClockSource clockSource = CLOCK_NONE;
+
+bool otaClockValid() {
+    return time(nullptr) >= CLOCK_VALID_AFTER;
+}
+
+OTAClockSource otaClockSource() {
+    return clockSource;
+}
+
+const char* otaClockSourceName(OTAClockSource source) {
+    switch (source) {
+    case CLOCK_RTC: return "rtc";
+    case CLOCK_HTTP_DATE: return "http_date";
+    case CLOCK_NTP: return "ntp";
+    default: return "none";
+    }
+}
+
+bool otaClockSeed(time_t t, OTAClockSource source) {
+    if (source <= clockSource || t < CLOCK_VALID_AFTER) return false;
+    
+    struct timeval tv = { t, 0 };
+    settimeofday(&tv, nullptr);
+    clockSource = source;
+    Serial.printf("[CLOCK] Seeded from %s: %lu\n", otaClockSourceName(source), (unsigned long)t);
+    return true;
+}
+
+void otaClockSynced() {
+    clockSource = CLOCK_NTP;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date (Howard Hinnant's
+// days_from_civil), so no timegm() or TZ juggling is needed
+static int32_t daysFromCivil(int32_t y, uint32_t m, uint32_t d) {
+    y -= m <= 2;
+    int32_t era = (y >= 0 ? y : y - 399) / 400;
+    uint32_t yoe = (uint32_t)(y - era * 400);
+    uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+bool otaParseHttpDate(const char* s, time_t& out) {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    char month[4];
+    int day, year, hour, minute, second;
+    if (sscanf(s, "%*3s, %d %3s %d %d:%d:%d GMT", &day, month, &year, &hour, &minute, &second) != 6) {
+        return false;
+    }
+    
+    const char* found = strstr(months, month);
+    if (!found || strlen(month) != 3 || (found - months) % 3 != 0) return false;
+    int mon = (found - months) / 3 + 1;
+    if (day < 1 || day > 31 || year < 1970 ||
+        hour < 0 || hour > 23 || minute < 0 || minute > 59 || second < 0 || second > 60) return false;
+    
+    out = (time_t)daysFromCivil(year, mon, day) * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
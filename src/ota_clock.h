@@ -0,0 +1,31 @@
+#ifndef OTA_CLOCK_H
+#define OTA_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Where the wall clock came from, from worst to best. Certificate checks only
+// need a roughly right clock, so a seed is enough to start TLS and updates
+// before SNTP answers; timings across a restart need the synced clock.
+enum OTAClockSource {
+    CLOCK_NONE,       // still counting from 1970
+    CLOCK_RTC,        // last synced time kept in RTC memory across a restart
+    CLOCK_HTTP_DATE,  // Date header of an HTTP response
+    CLOCK_NTP         // synced by SNTP
+};
+
+// Wall clock good enough for certificate validity and timestamps
+bool otaClockValid();
+OTAClockSource otaClockSource();
+const char* otaClockSourceName(OTAClockSource source);
+
+// Sets the clock to `t` unless a source at least as good already did
+bool otaClockSeed(time_t t, OTAClockSource source);
+
+// SNTP (or the host) has set the clock itself
+void otaClockSynced();
+
+// RFC 7231 IMF-fixdate, "Sun, 06 Nov 1994 08:49:37 GMT"
+bool otaParseHttpDate(const char* s, time_t& out);
+
+#endif // OTA_CLOCK_H
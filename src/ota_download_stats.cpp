@@ -0,0 +1,110 @@
+#include "ota_download_stats.h"
+#include <string.h>
+#include "config.h"
+
+// Upper bounds of the buckets; the last bucket takes everything above
+static const unsigned long gapEdgesUs[OTA_GAP_BUCKETS - 1] = {1000, 10000, 100000, 1000000};
+static const char* const gapKeys[OTA_GAP_BUCKETS] = {
+    "gap_lt_1ms", "gap_lt_10ms", "gap_lt_100ms", "gap_lt_1s", "gap_ge_1s"
+};
+
+// 1460 is a full TCP segment on Ethernet/WiFi
+static const size_t sizeEdges[OTA_CHUNK_BUCKETS - 1] = {128, 512, 1460, 4096};
+static const char* const sizeKeys[OTA_CHUNK_BUCKETS] = {
+    "chunk_le_128", "chunk_le_512", "chunk_le_mss", "chunk_le_4k", "chunk_gt_4k"
+};
+
+OTADownloadStats::OTADownloadStats() {
+    begin();
+}
+
+void OTADownloadStats::begin() {
+    memset(_gaps, 0, sizeof(_gaps));
+    memset(_sizes, 0, sizeof(_sizes));
+    _chunks = 0;
+    _stalls = 0;
+    _stallUs = 0;
+    _maxGapUs = 0;
+    _bps = 0;
+    _peakBps = 0;
+    resume();
+}
+
+void OTADownloadStats::resume() {
+    _hasLast = false;
+    _lastUs = 0;
+    _windowStartUs = 0;
+    _windowBytes = 0;
+}
+
+void OTADownloadStats::chunk(size_t bytes, unsigned long nowUs) {
+    _chunks++;
+    
+    uint8_t i = 0;
+    while (i < OTA_CHUNK_BUCKETS - 1 && bytes > sizeEdges[i]) i++;
+    _sizes[i]++;
+    
+    // The first chunk of a connection only starts the clocks
+    if (!_hasLast) {
+        _hasLast = true;
+        _lastUs = nowUs;
+        _windowStartUs = nowUs;
+        _windowBytes = 0;
+        return;
+    }
+    
+    unsigned long gapUs = nowUs - _lastUs;
+    _lastUs = nowUs;
+    i = 0;
+    while (i < OTA_GAP_BUCKETS - 1 && gapUs >= gapEdgesUs[i]) i++;
+    _gaps[i]++;
+    if (gapUs > _maxGapUs) _maxGapUs = gapUs;
+    if (gapUs >= OTA_STALL_THRESHOLD * 1000UL) {
+        _stalls++;
+        _stallUs += gapUs;
+    }
+    
+    _windowBytes += bytes;
+    unsigned long windowUs = nowUs - _windowStartUs;
+    if (windowUs >= OTA_THROUGHPUT_WINDOW * 1000UL) {
+        _bps = (uint64_t)_windowBytes * 1000000 / windowUs;
+        if (_bps > _peakBps) _peakBps = _bps;
+        _windowStartUs = nowUs;
+        _windowBytes = 0;
+    }
+}
+
+uint32_t OTADownloadStats::windowRate(unsigned long endUs) const {
+    unsigned long windowUs = endUs - _windowStartUs;
+    return windowUs > 0 ? (uint64_t)_windowBytes * 1000000 / windowUs : 0;
+}
+
+uint32_t OTADownloadStats::bytesPerSec(unsigned long nowUs) const {
+    if (!_hasLast) return _bps;
+    if (nowUs - _windowStartUs >= OTA_THROUGHPUT_WINDOW * 1000UL || _peakBps == 0) {
+        return windowRate(nowUs);
+    }
+    return _bps;
+}
+
+uint32_t OTADownloadStats::peakBytesPerSec() const {
+    // Downloads shorter than one window never complete one
+    if (_peakBps == 0 && _hasLast) return windowRate(_lastUs);
+    return _peakBps;
+}
+
+void OTADownloadStats::addTo(OTAStageRecord& record, int rssi) const {
+    record.add("chunks", _chunks);
+    for (uint8_t i = 0; i < OTA_GAP_BUCKETS; i++) {
+        record.add(gapKeys[i], _gaps[i]);
+    }
+    for (uint8_t i = 0; i < OTA_CHUNK_BUCKETS; i++) {
+        record.add(sizeKeys[i], _sizes[i]);
+    }
+    record.add("stalls", _stalls)
+          .add("stall_ms", _stallUs / 1000)
+          .add("max_gap_ms", _maxGapUs / 1000)
+          .add("last_bps", bytesPerSec(_lastUs))
+          .add("peak_bps", peakBytesPerSec())
+          .addSigned("rssi", rssi);
+}
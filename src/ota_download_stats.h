@@ -0,0 +1,52 @@
+#ifndef OTA_DOWNLOAD_STATS_H
+#define OTA_DOWNLOAD_STATS_H
+
+#include <Arduino.h>
+#include "ota_metrics.h"
+
+#define OTA_GAP_BUCKETS 5
+#define OTA_CHUNK_BUCKETS 5
+
+// Per-chunk view of a download: how long each read waited for data since
+// the previous one, how large the reads were, the stalls in between and the
+// throughput over OTA_THROUGHPUT_WINDOW. Averages over a whole stage hide
+// exactly these, and each chunk only costs a few compares and increments.
+class OTADownloadStats {
+public:
+    OTADownloadStats();
+    
+    void begin();   // new stage
+    void resume();  // new connection, the gap across a reconnect is not a stall
+    void chunk(size_t bytes, unsigned long nowUs);
+    
+    uint32_t chunks() const { return _chunks; }
+    uint32_t stalls() const { return _stalls; }
+    
+    // Rate of the last complete window. A window running past
+    // OTA_THROUGHPUT_WINDOW without data counts as it goes, so a stall shows
+    // as a falling rate; until the first window completes, the partial one
+    // stands in.
+    uint32_t bytesPerSec(unsigned long nowUs) const;
+    uint32_t peakBytesPerSec() const;
+    
+    // Appends the histograms and stall counters as stage record fields
+    void addTo(OTAStageRecord& record, int rssi) const;
+
+private:
+    uint32_t _gaps[OTA_GAP_BUCKETS];
+    uint32_t _sizes[OTA_CHUNK_BUCKETS];
+    uint32_t _chunks;
+    uint32_t _stalls;
+    unsigned long _stallUs;
+    unsigned long _maxGapUs;
+    bool _hasLast;              // _lastUs is from this connection
+    unsigned long _lastUs;
+    unsigned long _windowStartUs;
+    uint32_t _windowBytes;
+    uint32_t _bps;
+    uint32_t _peakBps;
+    
+    uint32_t windowRate(unsigned long endUs) const;
+};
+
+#endif // OTA_DOWNLOAD_STATS_H
@@ -0,0 +1,177 @@
+#include "ota_flash_writer.h"
+#include "ota_platform.h"
+#include "config.h"
+
+// First byte of every ESP8266 application image
+#define IMAGE_MAGIC 0xE9
+
+OTAFlashWriter::OTAFlashWriter()
+    : _buffer(nullptr), _bufferLen(0), _startAddress(0), _size(0), _flashed(0), _erasedEnd(0) {
+    resetStats();
+}
+
+OTAFlashWriter::~OTAFlashWriter() {
+    abort();
+}
+
+uint32_t OTAFlashWriter::slotAddressFor(uint32_t imageSize) {
+    // Same placement as UpdaterClass: the image ends right below the filesystem
+    uint32_t sketchEnd = (otaSketchSize() + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+    uint32_t slotEnd = otaSlotEnd();
+    uint32_t roundedSize = (imageSize + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+    
+    if (roundedSize == 0 || slotEnd <= roundedSize || slotEnd - roundedSize < sketchEnd) {
+        return 0;
+    }
+    return slotEnd - roundedSize;
+}
+
+bool OTAFlashWriter::begin(uint32_t imageSize, uint32_t resumeOffset) {
+    abort();
+    
+    if (resumeOffset % FLASH_SECTOR_SIZE != 0 || resumeOffset > imageSize) {
+        Serial.printf("[FLASH] Invalid resume offset %u\n", resumeOffset);
+        return false;
+    }
+    
+    _startAddress = slotAddressFor(imageSize);
+    if (_startAddress == 0) {
+        Serial.printf("[FLASH] Image of %u bytes does not fit the OTA slot\n", imageSize);
+        return false;
+    }
+    
+    _buffer = (uint8_t*)malloc(FLASH_SECTOR_SIZE);
+    if (!_buffer) {
+        Serial.println("[FLASH] Out of memory for sector buffer");
+        return false;
+    }
+    
+    _size = imageSize;
+    _flashed = resumeOffset;
+    _erasedEnd = resumeOffset;
+    _bufferLen = 0;
+    
+    Serial.printf("[FLASH] Slot 0x%06x, image %u bytes, starting at %u\n", _startAddress, _size, _flashed);
+    return true;
+}
+
+bool OTAFlashWriter::write(const uint8_t* data, size_t len) {
+    if (!_buffer) return false;
+    
+    if (written() + len > _size) {
+        Serial.println("[FLASH] Write past end of image");
+        return false;
+    }
+    
+    while (len > 0) {
+        size_t chunk = min(len, (size_t)FLASH_SECTOR_SIZE - _bufferLen);
+        memcpy(_buffer + _bufferLen, data, chunk);
+        _bufferLen += chunk;
+        data += chunk;
+        len -= chunk;
+        
+        if (_bufferLen == FLASH_SECTOR_SIZE || _flashed + _bufferLen == _size) {
+            if (!flushSector()) return false;
+        }
+    }
+    return true;
+}
+
+bool OTAFlashWriter::eraseAhead() {
+    if (!_buffer) return false;
+    
+    uint32_t imageEnd = (_size + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+    uint32_t limit = min(imageEnd, _flashed + (uint32_t)OTA_ERASE_AHEAD * FLASH_SECTOR_SIZE);
+    if (_erasedEnd >= limit) return false;
+    
+    unsigned long before = _eraseUs;
+    if (!eraseSector(_erasedEnd)) {
+        return false;
+    }
+    _eraseAheadUs += _eraseUs - before;
+    _sectorsErasedAhead++;
+    return true;
+}
+
+bool OTAFlashWriter::eraseSector(uint32_t offset) {
+    uint32_t address = _startAddress + offset;
+    unsigned long start = otaMicros();
+    bool erased = otaFlashErase(address / FLASH_SECTOR_SIZE);
+    _eraseUs += otaMicros() - start;
+    if (!erased) {
+        Serial.printf("[FLASH] Erase failed at 0x%06x\n", address);
+        return false;
+    }
+    _sectorsErased++;
+    _erasedEnd = offset + FLASH_SECTOR_SIZE;
+    return true;
+}
+
+bool OTAFlashWriter::flushSector() {
+    if (_flashed == 0) {
+        if (_buffer[0] != IMAGE_MAGIC) {
+            Serial.printf("[FLASH] Bad image magic 0x%02x\n", _buffer[0]);
+            return false;
+        }
+        // Only the flashed copy is adapted: callers hash the bytes as received
+        if (!otaAdaptImageHeader(_buffer, _bufferLen)) {
+            Serial.println("[FLASH] Image does not match this flash chip");
+            return false;
+        }
+    }
+    
+    // flashWrite needs a word-aligned length; pad the tail sector with erased bytes
+    size_t writeLen = (_bufferLen + 3) & ~3;
+    memset(_buffer + _bufferLen, 0xFF, writeLen - _bufferLen);
+    
+    // Usually eraseAhead() got to this sector already
+    if (_flashed >= _erasedEnd && !eraseSector(_flashed)) {
+        return false;
+    }
+    
+    uint32_t address = _startAddress + _flashed;
+    unsigned long start = otaMicros();
+    bool written = otaFlashWrite(address, _buffer, writeLen);
+    _writeUs += otaMicros() - start;
+    if (!written) {
+        Serial.printf("[FLASH] Write failed at 0x%06x\n", address);
+        return false;
+    }
+    
+    _flashed += _bufferLen;
+    _bufferLen = 0;
+    return true;
+}
+
+bool OTAFlashWriter::commit() {
+    if (!_buffer || written() != _size) {
+        Serial.printf("[FLASH] Cannot commit incomplete image (%u/%u)\n", written(), _size);
+        return false;
+    }
+    
+    if (!otaScheduleCopy(_startAddress, _size)) {
+        Serial.println("[FLASH] Failed to write the boot command");
+        return false;
+    }
+    
+    free(_buffer);
+    _buffer = nullptr;
+    Serial.printf("[FLASH] Committed %u bytes from 0x%06x\n", _size, _startAddress);
+    return true;
+}
+
+void OTAFlashWriter::resetStats() {
+    _eraseUs = 0;
+    _eraseAheadUs = 0;
+    _writeUs = 0;
+    _sectorsErased = 0;
+    _sectorsErasedAhead = 0;
+}
+
+void OTAFlashWriter::abort() {
+    if (_buffer) {
+        free(_buffer);
+        _buffer = nullptr;
+    }
+    _bufferLen = 0;
+}
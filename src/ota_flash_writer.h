@@ -0,0 +1,63 @@
+#ifndef OTA_FLASH_WRITER_H
+#define OTA_FLASH_WRITER_H
+
+#include <Arduino.h>
+
+// Writes a firmware image into the OTA slot one flash sector at a time.
+// Unlike UpdaterClass it can be re-opened at a sector-aligned offset, so an
+// interrupted download continues into the bytes already in flash.
+//
+// A sector erase blocks for tens of milliseconds. Download loops call
+// eraseAhead() while no network data is waiting, so the next sectors are
+// already erased when their data arrives and only the write remains.
+class OTAFlashWriter {
+public:
+    OTAFlashWriter();
+    ~OTAFlashWriter();
+    
+    bool begin(uint32_t imageSize, uint32_t resumeOffset = 0);
+    bool write(const uint8_t* data, size_t len);
+    
+    // Erases one sector of the next OTA_ERASE_AHEAD after the write position,
+    // if any is left. Returns false when there was nothing to do.
+    bool eraseAhead();
+    
+    bool commit();
+    void abort();
+    
+    bool isRunning() const { return _buffer != nullptr; }
+    uint32_t slotAddress() const { return _startAddress; }
+    uint32_t imageSize() const { return _size; }
+    uint32_t written() const { return _flashed + _bufferLen; }
+    uint32_t flushed() const { return _flashed; }
+    
+    static uint32_t slotAddressFor(uint32_t imageSize);
+    
+    // Flash time since resetStats(); eraseAheadUs() is the part of eraseUs()
+    // spent in eraseAhead()
+    void resetStats();
+    unsigned long eraseUs() const { return _eraseUs; }
+    unsigned long eraseAheadUs() const { return _eraseAheadUs; }
+    unsigned long writeUs() const { return _writeUs; }
+    uint16_t sectorsErased() const { return _sectorsErased; }
+    uint16_t sectorsErasedAhead() const { return _sectorsErasedAhead; }
+    
+private:
+    uint8_t* _buffer;
+    size_t _bufferLen;
+    uint32_t _startAddress;
+    uint32_t _size;
+    uint32_t _flashed;
+    uint32_t _erasedEnd;      // image offset up to which this session erased the slot
+    
+    unsigned long _eraseUs;
+    unsigned long _eraseAheadUs;
+    unsigned long _writeUs;
+    uint16_t _sectorsErased;
+    uint16_t _sectorsErasedAhead;
+    
+    bool eraseSector(uint32_t offset);
+    bool flushSector();
+};
+
+#endif // OTA_FLASH_WRITER_H
@@ -0,0 +1,253 @@
+#include "ota_http_client.h"
+#include "ota_platform.h"
+#include "ota_clock.h"
+
+OTAHttpClient::OTAHttpClient()
+    : _port(0), _keepAlive(false), _contentLength(-1), _remaining(-1),
+      _connections(0), _reused(0), _lastHandshake(HANDSHAKE_NONE), _connectMs(0) {
+    _host[0] = 0;
+    _contentRange[0] = 0;
+    _etag[0] = 0;
+    _lastModified[0] = 0;
+}
+
+bool OTAHttpClient::parseUrl(const char* url, char* host, size_t hostLen, uint16_t& port, const char*& path) {
+    const char* p;
+    if (strncmp(url, "https://", 8) == 0) {
+        p = url + 8;
+        port = 443;
+    } else if (strncmp(url, "http://", 7) == 0) {
+        p = url + 7;
+        port = 80;
+    } else {
+        return false;
+    }
+    
+    const char* slash = strchr(p, '/');
+    const char* hostEnd = slash ? slash : p + strlen(p);
+    path = slash ? slash : "/";
+    
+    const char* colon = (const char*)memchr(p, ':', hostEnd - p);
+    if (colon) {
+        port = (uint16_t)atoi(colon + 1);
+        hostEnd = colon;
+    }
+    
+    size_t len = hostEnd - p;
+    if (len == 0 || len >= hostLen) return false;
+    memcpy(host, p, len);
+    host[len] = 0;
+    return true;
+}
+
+bool OTAHttpClient::connect(const char* host, uint16_t port) {
+    unsigned long start = otaMillis();
+    
+    if (!_transport.connect(host, port)) {
+        Serial.printf("[HTTP] ERROR: Connection to %s:%u failed\n", host, port);
+        return false;
+    }
+    if (!_transport.secure()) {
+        _lastHandshake = HANDSHAKE_NONE;
+    } else {
+        _lastHandshake = _transport.resumed() ? HANDSHAKE_RESUMED : HANDSHAKE_FULL;
+    }
+    
+    snprintf(_host, sizeof(_host), "%s", host);
+    _port = port;
+    
+    unsigned long elapsed = otaMillis() - start;
+    _connectMs += elapsed;
+    _connections++;
+    Serial.printf("[HTTP] Connected in %lu ms (handshake: %s)\n", elapsed, handshakeName(_lastHandshake));
+    return true;
+}
+
+int OTAHttpClient::get(const char* url, const char* headers) {
+    char host[64];
+    uint16_t port;
+    const char* path;
+    if (!parseUrl(url, host, sizeof(host), port, path)) {
+        Serial.printf("[HTTP] ERROR: Bad URL %s\n", url);
+        return OTA_HTTP_ERROR_URL;
+    }
+    
+    _transport.setTimeout(OTA_STALL_TIMEOUT);
+    
+    // Reuse the open connection when the previous response left it idle
+    if (_keepAlive && port == _port && strcmp(host, _host) == 0 && _transport.connected()) {
+        _lastHandshake = HANDSHAKE_REUSED;
+        _reused++;
+        Serial.printf("[HTTP] Reusing connection to %s:%u\n", host, port);
+        
+        int status = request(host, path, headers);
+        if (status > 0) {
+            return status;
+        }
+        
+        // The server dropped the idle connection in the meantime
+        Serial.println("[HTTP] Kept-alive connection was closed, reconnecting");
+        _reused--;
+    }
+    
+    close();
+    if (!connect(host, port)) {
+        return OTA_HTTP_ERROR_CONNECT;
+    }
+    return request(host, path, headers);
+}
+
+int OTAHttpClient::request(const char* host, const char* path, const char* headers) {
+    _contentLength = -1;
+    _remaining = -1;
+    _contentRange[0] = 0;
+    _etag[0] = 0;
+    _lastModified[0] = 0;
+    _keepAlive = false;
+    
+    // HTTP/1.0 keeps the server from answering with a chunked body
+    char request[384];
+    int len = snprintf(request, sizeof(request),
+                       "GET %s HTTP/1.0\r\n"
+                       "Host: %s\r\n"
+                       "User-Agent: ESP8266\r\n"
+                       "Accept-Encoding: identity\r\n"
+                       "Connection: keep-alive\r\n"
+                       "%s\r\n",
+                       path, host, headers ? headers : "");
+    if (len <= 0 || len >= (int)sizeof(request) || _transport.write((const uint8_t*)request, len) != (size_t)len) {
+        Serial.println("[HTTP] ERROR: Failed to send request");
+        _transport.stop();
+        return OTA_HTTP_ERROR_SEND;
+    }
+    
+    return readResponseHead();
+}
+
+int OTAHttpClient::readResponseHead() {
+    char line[160];
+    int status = 0;
+    int minor = 0;
+    bool keepAlive = false;
+    bool closeRequested = false;
+    
+    while (true) {
+        // Only an empty line ends the head. A head cut off by a stall or a
+        // close may lack its Content-Length, and the connection would be
+        // left mid-response, so it is not reused.
+        int n = _transport.readLine(line, sizeof(line) - 1);
+        if (n < 0) {
+            Serial.println(status == 0 ? "[HTTP] ERROR: No response" : "[HTTP] ERROR: Response head cut off");
+            _transport.stop();
+            return OTA_HTTP_ERROR_RESPONSE;
+        }
+        if (n > 0 && line[n - 1] == '\r') n--;
+        line[n] = 0;
+        
+        if (status == 0) {
+            // Status line: HTTP/1.x <code> <reason>
+            if (sscanf(line, "HTTP/1.%d %d", &minor, &status) != 2 || status <= 0) {
+                Serial.printf("[HTTP] ERROR: Bad status line '%s'\n", line);
+                _transport.stop();
+                return OTA_HTTP_ERROR_RESPONSE;
+            }
+            continue;
+        }
+        if (n == 0) break;  // end of head
+        
+        char* value = strchr(line, ':');
+        if (!value) continue;
+        *value++ = 0;
+        while (*value == ' ') value++;
+        
+        if (strcasecmp(line, "Content-Length") == 0) {
+            _contentLength = atol(value);
+        } else if (strcasecmp(line, "Content-Range") == 0) {
+            snprintf(_contentRange, sizeof(_contentRange), "%s", value);
+        } else if (strcasecmp(line, "ETag") == 0) {
+            snprintf(_etag, sizeof(_etag), "%s", value);
+        } else if (strcasecmp(line, "Last-Modified") == 0) {
+            snprintf(_lastModified, sizeof(_lastModified), "%s", value);
+        } else if (strcasecmp(line, "Date") == 0 && !otaClockValid()) {
+            // Plain HTTP works without a clock, so a response can set it
+            time_t date;
+            if (otaParseHttpDate(value, date)) {
+                otaClockSeed(date, CLOCK_HTTP_DATE);
+            }
+        } else if (strcasecmp(line, "Connection") == 0) {
+            keepAlive = strcasecmp(value, "keep-alive") == 0;
+            closeRequested = strcasecmp(value, "close") == 0;
+        }
+    }
+    
+    // 304 Not Modified never carries a body
+    if (status == 304) {
+        _contentLength = 0;
+    }
+    
+    // Without a length the body runs until the server closes the connection
+    _keepAlive = _contentLength >= 0 && !closeRequested && (keepAlive || minor >= 1);
+    _remaining = _contentLength;
+    return status;
+}
+
+int OTAHttpClient::available() {
+    int n = _transport.available();
+    if (_remaining >= 0 && n > _remaining) n = _remaining;
+    return n;
+}
+
+int OTAHttpClient::read(uint8_t* buffer, size_t len) {
+    if (_remaining >= 0 && len > (size_t)_remaining) len = _remaining;
+    if (len == 0) return 0;
+    
+    int n = _transport.read(buffer, len);
+    if (n > 0 && _remaining >= 0) _remaining -= n;
+    return n;
+}
+
+size_t OTAHttpClient::peek(const uint8_t*& data) {
+    size_t n = _transport.peekAvailable();
+    if (_remaining >= 0 && n > (size_t)_remaining) n = _remaining;
+    data = _transport.peekBuffer();
+    return n;
+}
+
+void OTAHttpClient::consume(size_t len) {
+    _transport.peekConsume(len);
+    if (_remaining >= 0) _remaining -= len;
+}
+
+bool OTAHttpClient::connected() {
+    if (_remaining == 0) return false;
+    return _transport.connected() || _transport.available() > 0;
+}
+
+void OTAHttpClient::end() {
+    // Unread body bytes would be taken for the next response head
+    if (!_keepAlive || _remaining != 0) {
+        close();
+    }
+    _remaining = -1;
+}
+
+void OTAHttpClient::close() {
+    _transport.stop();
+    _keepAlive = false;
+}
+
+void OTAHttpClient::resetStats() {
+    _connections = 0;
+    _reused = 0;
+    _connectMs = 0;
+    _lastHandshake = HANDSHAKE_NONE;
+}
+
+const char* OTAHttpClient::handshakeName(Handshake h) {
+    switch (h) {
+        case HANDSHAKE_FULL: return "full";
+        case HANDSHAKE_RESUMED: return "resumed";
+        case HANDSHAKE_REUSED: return "reused";
+        default: return "none";
+    }
+}
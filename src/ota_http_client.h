@@ -0,0 +1,89 @@
+#ifndef OTA_HTTP_CLIENT_H
+#define OTA_HTTP_CLIENT_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "ota_transport.h"
+#include "ota_stream.h"
+
+// Negative results of OTAHttpClient::get()
+#define OTA_HTTP_ERROR_URL -1
+#define OTA_HTTP_ERROR_CONNECT -2
+#define OTA_HTTP_ERROR_SEND -3
+#define OTA_HTTP_ERROR_RESPONSE -4
+
+// Minimal HTTP/1.0 GET client for the OTA downloads. Unlike HTTPClient it
+// opens the connection itself, so the TCP/TLS setup can be timed and the TLS
+// session resumed from a TLSSessionCache. Requests ask for keep-alive; a fully
+// read response leaves the connection open for the next GET to the same
+// host:port until close() is called.
+class OTAHttpClient : public OTAStream {
+public:
+    enum Handshake {
+        HANDSHAKE_NONE,       // plain TCP
+        HANDSHAKE_FULL,
+        HANDSHAKE_RESUMED,
+        HANDSHAKE_REUSED      // kept-alive connection, no handshake at all
+    };
+    
+    OTAHttpClient();
+    
+#if FIRMWARE_TLS == 1
+    void setSessionCache(TLSSessionCache* cache) { _transport.setSessionCache(cache); }
+#endif
+    
+    // Sends the request and reads the response head. `headers` holds extra
+    // "Name: value\r\n" lines. Returns the HTTP status or OTA_HTTP_ERROR_*.
+    int get(const char* url, const char* headers = nullptr);
+    
+    int available();
+    int read(uint8_t* buffer, size_t len);
+    
+    // Zero-copy body access when the transport supports it: peek() points
+    // `data` at body bytes still in the network buffer, consume() releases them
+    bool peekSupported() { return _transport.hasPeek(); }
+    size_t peek(const uint8_t*& data);
+    void consume(size_t len);
+    
+    bool connected();
+    void end();     // finish the response, keeping the connection if possible
+    void close();   // drop the connection and its TLS buffers
+    
+    int32_t contentLength() const { return _contentLength; }
+    const char* contentRange() const { return _contentRange; }
+    const char* etag() const { return _etag; }
+    const char* lastModified() const { return _lastModified; }
+    
+    // Connection setup statistics, accumulated until resetStats()
+    void resetStats();
+    uint8_t connections() const { return _connections; }
+    uint8_t reused() const { return _reused; }
+    Handshake lastHandshake() const { return _lastHandshake; }
+    unsigned long connectMs() const { return _connectMs; }
+    
+    static const char* handshakeName(Handshake h);
+    static bool parseUrl(const char* url, char* host, size_t hostLen, uint16_t& port, const char*& path);
+    
+private:
+    OTATransport _transport;
+    char _host[64];
+    uint16_t _port;
+    bool _keepAlive;
+    
+    int32_t _contentLength;
+    int32_t _remaining;
+    char _contentRange[64];
+    char _etag[72];
+    char _lastModified[40];
+    
+    uint8_t _connections;
+    uint8_t _reused;
+    Handshake _lastHandshake;
+    unsigned long _connectMs;
+    
+    bool connect(const char* host, uint16_t port);
+    int request(const char* host, const char* path, const char* headers);
+    int readResponseHead();
+};
+
+#endif // OTA_HTTP_CLIENT_H
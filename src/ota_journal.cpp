@@ -0,0 +1,32 @@
+#include "ota_journal.h"
+#include "config.h"
+#include "ota_platform.h"
+
+#define JOURNAL_MAGIC 0x4F544A31  // "OTJ1"
+
+bool OTAJournal::load(OTAJournalRecord& record) {
+    if (!otaStorageRead(OTA_JOURNAL_PATH, &record, sizeof(record))) return false;
+    
+    if (record.magic != JOURNAL_MAGIC ||
+        record.check != otaRecordChecksum(&record, offsetof(OTAJournalRecord, check))) {
+        Serial.println("[JOURNAL] Discarding invalid journal");
+        clear();
+        return false;
+    }
+    return true;
+}
+
+bool OTAJournal::save(OTAJournalRecord& record) {
+    record.magic = JOURNAL_MAGIC;
+    record.check = otaRecordChecksum(&record, offsetof(OTAJournalRecord, check));
+    
+    if (!otaStorageWrite(OTA_JOURNAL_PATH, &record, sizeof(record))) {
+        Serial.println("[JOURNAL] Failed to write journal");
+        return false;
+    }
+    return true;
+}
+
+void OTAJournal::clear() {
+    otaStorageRemove(OTA_JOURNAL_PATH);
+}
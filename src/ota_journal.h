@@ -0,0 +1,25 @@
+#ifndef OTA_JOURNAL_H
+#define OTA_JOURNAL_H
+
+#include <Arduino.h>
+
+// Progress record for an interrupted firmware download. Everything needed to
+// continue hashing and writing from `offset` without re-reading earlier bytes.
+struct OTAJournalRecord {
+    uint32_t magic;
+    uint8_t imageHash[32];    // manifest hash, identifies the image being fetched
+    uint32_t imageSize;
+    uint32_t slotAddress;
+    uint32_t offset;          // bytes already in flash, multiple of FLASH_SECTOR_SIZE
+    uint8_t shaState[32];     // br_sha256_state() after `offset` bytes
+    uint32_t check;
+};
+
+class OTAJournal {
+public:
+    bool load(OTAJournalRecord& record);
+    bool save(OTAJournalRecord& record);
+    void clear();
+};
+
+#endif // OTA_JOURNAL_H
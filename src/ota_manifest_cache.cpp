@@ -0,0 +1,38 @@
+#include "ota_manifest_cache.h"
+#include "config.h"
+#include "ota_platform.h"
+
+#define VALIDATOR_MAGIC 0x4F544D31  // "OTM1"
+
+bool OTAManifestCache::load(OTAManifestValidator& validator) {
+    if (!otaStorageRead(OTA_VALIDATOR_PATH, &validator, sizeof(validator))) return false;
+    
+    if (validator.magic != VALIDATOR_MAGIC ||
+        validator.check != otaRecordChecksum(&validator, offsetof(OTAManifestValidator, check))) {
+        clear();
+        return false;
+    }
+    
+    // A manifest judged by another firmware build says nothing about this one
+    if (strcmp(validator.version, FIRMWARE_VERSION) != 0) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+bool OTAManifestCache::save(OTAManifestValidator& validator) {
+    validator.magic = VALIDATOR_MAGIC;
+    snprintf(validator.version, sizeof(validator.version), "%s", FIRMWARE_VERSION);
+    validator.check = otaRecordChecksum(&validator, offsetof(OTAManifestValidator, check));
+    
+    if (!otaStorageWrite(OTA_VALIDATOR_PATH, &validator, sizeof(validator))) {
+        Serial.println("[MANIFEST] Failed to store validator");
+        return false;
+    }
+    return true;
+}
+
+void OTAManifestCache::clear() {
+    otaStorageRemove(OTA_VALIDATOR_PATH);
+}
@@ -0,0 +1,24 @@
+#ifndef OTA_MANIFEST_CACHE_H
+#define OTA_MANIFEST_CACHE_H
+
+#include <Arduino.h>
+
+// HTTP validators of the last manifest that was fully processed without
+// finding an update. Sent back as If-None-Match / If-Modified-Since, so an
+// unchanged manifest costs a 304 with no body.
+struct OTAManifestValidator {
+    uint32_t magic;
+    char version[48];         // FIRMWARE_VERSION that evaluated the manifest
+    char etag[72];
+    char lastModified[40];
+    uint32_t check;
+};
+
+class OTAManifestCache {
+public:
+    bool load(OTAManifestValidator& validator);
+    bool save(OTAManifestValidator& validator);
+    void clear();
+};
+
+#endif // OTA_MANIFEST_CACHE_H
@@ -0,0 +1,337 @@
+#include "ota_metrics.h"
+#include <Arduino.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+void otaTimestamp(char* out, size_t outLen) {
+    otaFormatTime(time(nullptr), out, outLen);
+}
+
+void otaFormatTime(time_t t, char* out, size_t outLen) {
+    struct tm timeinfo;
+    localtime_r(&t, &timeinfo);
+    
+    snprintf(out, outLen, "%04d-%02d-%02dT%02d:%02d:%02d",
+             timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday,
+             timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
+}
+
+int otaFormatMetrics(char* out, size_t outLen, const char* stage, unsigned long elapsedMs,
+                     const OTAHeapStats& heap, const char* timestamp, const char* extra) {
+    return snprintf(out, outLen,
+                    "{\"stage\":\"%s\",\"elapsed_ms\":%lu,\"free_heap\":%u,\"max_block\":%u,\"fragmentation\":%u%s,\"algorithm\":\"%s\",\"version\":\"%s\",\"timestamp\":\"%s\"}",
+                    stage, elapsedMs, (unsigned)heap.freeHeap, (unsigned)heap.maxBlock, heap.fragmentation,
+                    extra ? extra : "", FIRMWARE_ALGORITHM, FIRMWARE_VERSION, timestamp);
+}
+
+static_assert(OTA_METRICS_FIELD_POOL >= OTA_METRICS_FIELDS && OTA_METRICS_FIELD_POOL <= 255,
+              "OTA_METRICS_FIELD_POOL must hold one full record and fit a uint8_t");
+
+const OTAMetricField& OTAStageRecord::field(uint8_t i) const {
+    return ring->_fields[(firstField + i) % OTA_METRICS_FIELD_POOL];
+}
+
+OTAStageRecord& OTAStageRecord::add(const char* key, uint32_t value) {
+    OTAMetricField* field = ring->claimField(*this);
+    if (field) {
+        field->key = key;
+        field->value = value;
+        field->type = OTAMetricField::UINT;
+    }
+    return *this;
+}
+
+OTAStageRecord& OTAStageRecord::add(const char* key, const char* value) {
+    OTAMetricField* field = ring->claimField(*this);
+    if (field) {
+        field->key = key;
+        field->str = value;
+        field->type = OTAMetricField::STR;
+    }
+    return *this;
+}
+
+OTAStageRecord& OTAStageRecord::addSigned(const char* key, int32_t value) {
+    OTAMetricField* field = ring->claimField(*this);
+    if (field) {
+        field->key = key;
+        field->signedValue = value;
+        field->type = OTAMetricField::INT;
+    }
+    return *this;
+}
+
+// Appends to a fixed buffer; once something does not fit, `ok` stays false
+struct MetricsWriter {
+    uint8_t* out;
+    size_t cap;
+    size_t pos;
+    bool ok;
+    
+    void bytes(const void* data, size_t len) {
+        if (!ok || len > cap - pos) {
+            ok = false;
+            return;
+        }
+        memcpy(out + pos, data, len);
+        pos += len;
+    }
+    
+    void format(const char* fmt, ...) {
+        if (!ok) return;
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf((char*)out + pos, cap - pos, fmt, args);
+        va_end(args);
+        if (n < 0 || (size_t)n >= cap - pos) {
+            ok = false;
+            return;
+        }
+        pos += n;
+    }
+    
+    // CBOR head: major type plus argument in the shortest form
+    void cborHead(uint8_t major, uint32_t value) {
+        uint8_t head[5];
+        size_t len = 1;
+        if (value < 24) {
+            head[0] = (major << 5) | value;
+        } else if (value <= 0xFF) {
+            head[0] = (major << 5) | 24;
+            head[len++] = value;
+        } else if (value <= 0xFFFF) {
+            head[0] = (major << 5) | 25;
+            head[len++] = value >> 8;
+            head[len++] = value;
+        } else {
+            head[0] = (major << 5) | 26;
+            head[len++] = value >> 24;
+            head[len++] = value >> 16;
+            head[len++] = value >> 8;
+            head[len++] = value;
+        }
+        bytes(head, len);
+    }
+    
+    void cborText(const char* s) {
+        size_t len = strlen(s);
+        cborHead(3, len);
+        bytes(s, len);
+    }
+    
+    void cborUint(const char* key, uint32_t value) {
+        cborText(key);
+        cborHead(0, value);
+    }
+    
+    // Negative integers are major type 1 with argument -1 - n
+    void cborInt(const char* key, int32_t value) {
+        cborText(key);
+        if (value < 0) {
+            cborHead(1, (uint32_t)(-1 - value));
+        } else {
+            cborHead(0, value);
+        }
+    }
+};
+
+#define CBOR_MAP 5
+#define CBOR_ARRAY_INDEFINITE 0x9F
+#define CBOR_BREAK 0xFF
+
+#if OTA_METRICS_CBOR == 1
+static void encodeRecordCbor(MetricsWriter& w, const OTAStageRecord& rec) {
+    w.cborHead(CBOR_MAP, 6 + rec.fieldCount);
+    w.cborText("stage");
+    w.cborText(rec.stage);
+    w.cborUint("elapsed_ms", rec.elapsedUs / 1000);
+    w.cborUint("free_heap", rec.heap.freeHeap);
+    w.cborUint("max_block", rec.heap.maxBlock);
+    w.cborUint("fragmentation", rec.heap.fragmentation);
+    for (uint8_t i = 0; i < rec.fieldCount; i++) {
+        const OTAMetricField& field = rec.field(i);
+        if (field.type == OTAMetricField::STR) {
+            w.cborText(field.key);
+            w.cborText(field.str);
+        } else if (field.type == OTAMetricField::INT) {
+            w.cborInt(field.key, field.signedValue);
+        } else {
+            w.cborUint(field.key, field.value);
+        }
+    }
+    w.cborUint("timestamp", (uint32_t)rec.timestamp);
+}
+#else
+static void encodeRecordJson(MetricsWriter& w, const OTAStageRecord& rec) {
+    char timestamp[24];
+    otaFormatTime(rec.timestamp, timestamp, sizeof(timestamp));
+    
+    w.format("{\"stage\":\"%s\",\"elapsed_ms\":%lu,\"free_heap\":%u,\"max_block\":%u,\"fragmentation\":%u",
+             rec.stage, (unsigned long)(rec.elapsedUs / 1000), (unsigned)rec.heap.freeHeap,
+             (unsigned)rec.heap.maxBlock, rec.heap.fragmentation);
+    for (uint8_t i = 0; i < rec.fieldCount; i++) {
+        const OTAMetricField& field = rec.field(i);
+        if (field.type == OTAMetricField::STR) {
+            w.format(",\"%s\":\"%s\"", field.key, field.str);
+        } else if (field.type == OTAMetricField::INT) {
+            w.format(",\"%s\":%ld", field.key, (long)field.signedValue);
+        } else {
+            w.format(",\"%s\":%lu", field.key, (unsigned long)field.value);
+        }
+    }
+    w.format(",\"timestamp\":\"%s\"}", timestamp);
+}
+#endif
+
+OTAMetricsRing::OTAMetricsRing() : _head(0), _count(0), _fieldsUsed(0), _dropped(0) {
+}
+
+OTAStageRecord& OTAMetricsRing::push(const char* stage, uint32_t elapsedUs) {
+    if (_count == OTA_METRICS_RING) {
+        dropOldest();
+    }
+    
+    // Fields are taken from the pool in record order, right after the
+    // previous record's
+    uint8_t firstField = _count ? (at(0).firstField + _fieldsUsed) % OTA_METRICS_FIELD_POOL : 0;
+    OTAStageRecord& rec = _records[(_head + _count) % OTA_METRICS_RING];
+    _count++;
+    rec.stage = stage;
+    rec.elapsedUs = elapsedUs;
+    otaHeapStats(rec.heap);
+    rec.timestamp = time(nullptr);
+    rec.ring = this;
+    rec.firstField = firstField;
+    rec.fieldCount = 0;
+    return rec;
+}
+
+void OTAMetricsRing::dropOldest() {
+    _fieldsUsed -= at(0).fieldCount;
+    _head = (_head + 1) % OTA_METRICS_RING;
+    _count--;
+    _dropped++;
+}
+
+OTAMetricField* OTAMetricsRing::claimField(OTAStageRecord& rec) {
+    if (_count == 0 || &rec != &at(_count - 1) || rec.fieldCount == OTA_METRICS_FIELDS) return nullptr;
+    
+    // Older records give their fields up to the newest one
+    while (_fieldsUsed == OTA_METRICS_FIELD_POOL && _count > 1) {
+        dropOldest();
+    }
+    if (_fieldsUsed == OTA_METRICS_FIELD_POOL) return nullptr;
+    
+    _fieldsUsed++;
+    return &_fields[(rec.firstField + rec.fieldCount++) % OTA_METRICS_FIELD_POOL];
+}
+
+uint8_t OTAMetricsRing::encode(uint8_t first, uint8_t n, uint8_t* out, size_t outLen, size_t& len) const {
+    // The closing bytes (and the JSON terminator) are reserved up front
+    MetricsWriter w = {out, outLen > 3 ? outLen - 3 : 0, 0, true};
+
+#if OTA_METRICS_CBOR == 1
+    w.cborHead(CBOR_MAP, 4);
+    w.cborText("algorithm");
+    w.cborText(FIRMWARE_ALGORITHM);
+    w.cborText("version");
+    w.cborText(FIRMWARE_VERSION);
+    w.cborUint("dropped", _dropped);
+    w.cborText("stages");
+    uint8_t open = CBOR_ARRAY_INDEFINITE;
+    w.bytes(&open, 1);
+#else
+    w.format("{\"algorithm\":\"%s\",\"version\":\"%s\",\"dropped\":%u,\"stages\":[",
+             FIRMWARE_ALGORITHM, FIRMWARE_VERSION, _dropped);
+#endif
+
+    uint8_t encoded = 0;
+    while (w.ok && encoded < n) {
+        size_t mark = w.pos;
+#if OTA_METRICS_CBOR == 1
+        encodeRecordCbor(w, at(first + encoded));
+#else
+        if (encoded > 0) w.format(",");
+        encodeRecordJson(w, at(first + encoded));
+#endif
+        if (!w.ok) {
+            w.pos = mark;
+            break;
+        }
+        encoded++;
+    }
+    
+    w.cap = outLen;
+    w.ok = true;
+#if OTA_METRICS_CBOR == 1
+    uint8_t close = CBOR_BREAK;
+    w.bytes(&close, 1);
+#else
+    w.format("]}");
+#endif
+    len = w.pos;
+    return encoded;
+}
+
+void OTAMetricsRing::flush(OTAPublisher* publisher, const char* topic) {
+    for (uint8_t i = 0; i < _count; i++) {
+        const OTAStageRecord& rec = at(i);
+        char timestamp[24];
+        otaFormatTime(rec.timestamp, timestamp, sizeof(timestamp));
+        Serial.printf("[%s] Stage %s: %lu ms, heap=%u, max_block=%u, frag=%u%%\n",
+                      timestamp, rec.stage, (unsigned long)(rec.elapsedUs / 1000),
+                      (unsigned)rec.heap.freeHeap, (unsigned)rec.heap.maxBlock, rec.heap.fragmentation);
+    }
+    
+    uint8_t* buffer = nullptr;  // for publishers that do not lend room
+    uint8_t first = 0;
+    while (publisher && first < _count) {
+        uint8_t* batch = publisher->reserve(topic, OTA_METRICS_BATCH_SIZE);
+        bool lent = batch != nullptr;
+        if (!lent) {
+            if (!buffer) buffer = (uint8_t*)malloc(OTA_METRICS_BATCH_SIZE);
+            batch = buffer;
+        }
+        if (!batch) {
+            Serial.println("[METRICS] No memory for the batch buffer, records dropped");
+            _dropped += _count - first;
+            break;
+        }
+        
+        size_t len = 0;
+        uint8_t n = encode(first, _count - first, batch, OTA_METRICS_BATCH_SIZE, len);
+        if (n == 0) {
+            Serial.printf("[METRICS] Stage %s does not fit in a batch, dropped\n", at(first).stage);
+            if (lent) publisher->commit(0);
+            _dropped++;
+            first++;
+            continue;
+        }
+        
+        bool published;
+        if (lent) {
+            published = publisher->commit(len);
+        } else {
+#if OTA_METRICS_CBOR == 1
+            published = publisher->publish(topic, batch, len);
+#else
+            published = publisher->publish(topic, (const char*)batch);
+#endif
+        }
+        
+        // The count goes out with the first batch that makes it; lost
+        // batches are reported by the next one
+        if (published) {
+            _dropped = 0;
+        } else {
+            _dropped += n;
+        }
+        first += n;
+    }
+    free(buffer);
+    
+    _head = (_head + _count) % OTA_METRICS_RING;
+    _count = 0;
+    _fieldsUsed = 0;
+}
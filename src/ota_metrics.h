@@ -0,0 +1,110 @@
+#ifndef OTA_METRICS_H
+#define OTA_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "config.h"
+#include "ota_platform.h"
+
+// ISO 8601 local time, "1970-01-01T00:00:00" until NTP has synced
+void otaTimestamp(char* out, size_t outLen);
+void otaFormatTime(time_t t, char* out, size_t outLen);
+
+// One ota/metrics message:
+//   {"stage":..,"elapsed_ms":..,"free_heap":..,"max_block":..,"fragmentation":..
+//    <extra>,"algorithm":..,"version":..,"timestamp":..}
+// `extra` holds additional ,"key":value pairs and may be empty.
+int otaFormatMetrics(char* out, size_t outLen, const char* stage, unsigned long elapsedMs,
+                     const OTAHeapStats& heap, const char* timestamp, const char* extra);
+
+// A stage's results, kept as numbers until the batch is encoded. Keys and
+// string values are not copied, so they must be literals.
+struct OTAMetricField {
+    enum Type : uint8_t {
+        UINT,
+        INT,
+        STR
+    };
+    
+    const char* key;
+    union {
+        uint32_t value;
+        int32_t signedValue;
+        const char* str;
+    };
+    Type type;
+};
+
+class OTAMetricsRing;
+
+// The fields live in the ring's shared pool, so a record costs the same few
+// bytes whether the stage reports nothing or 17 values
+struct OTAStageRecord {
+    const char* stage;
+    uint32_t elapsedUs;
+    OTAHeapStats heap;
+    time_t timestamp;
+    OTAMetricsRing* ring;
+    uint8_t firstField;   // index in the field pool
+    uint8_t fieldCount;
+    
+    const OTAMetricField& field(uint8_t i) const;
+    
+    // Only the newest record of the ring takes fields. Fields past
+    // OTA_METRICS_FIELDS, or that the pool cannot make room for, are dropped.
+    OTAStageRecord& add(const char* key, uint32_t value);
+    OTAStageRecord& add(const char* key, const char* value);
+    OTAStageRecord& addSigned(const char* key, int32_t value);
+};
+
+// Stage records collected during an update and published in batches, so
+// recording a stage costs a heap sample and a few stores instead of a
+// formatted MQTT publish in the middle of the timed pipeline.
+//
+// JSON batch:
+//   {"algorithm":..,"version":..,"dropped":N,"stages":[{"stage":..,"elapsed_ms":..,
+//    "free_heap":..,"max_block":..,"fragmentation":..,<fields>,"timestamp":".."},..]}
+// The CBOR batch (OTA_METRICS_CBOR) is the same map, with an indefinite-length
+// "stages" array and the timestamp as epoch seconds.
+class OTAMetricsRing {
+public:
+    OTAMetricsRing();
+    
+    // Claims the next record. When the ring is full the oldest unflushed
+    // record is overwritten and counted as dropped; so are the oldest
+    // records when the field pool (OTA_METRICS_FIELD_POOL) runs out.
+    OTAStageRecord& push(const char* stage, uint32_t elapsedUs);
+    
+    uint8_t count() const { return _count; }
+    uint16_t dropped() const { return _dropped; }
+    
+    // Publishes every record, split over as many messages of up to
+    // OTA_METRICS_BATCH_SIZE bytes as needed, and empties the ring. Batches
+    // are encoded in room the publisher lends (OTAPublisher::reserve()), or
+    // in a heap buffer when it has none.
+    // Without a publisher the records are only logged. Records that could
+    // not be published are added to the dropped count, which is kept until
+    // a batch reporting it has been accepted.
+    void flush(OTAPublisher* publisher, const char* topic);
+    
+    // Encodes records [first, first + n) of the ring into `out`; returns
+    // how many fit and sets `len`. Used by flush() and the host tests.
+    uint8_t encode(uint8_t first, uint8_t n, uint8_t* out, size_t outLen, size_t& len) const;
+
+private:
+    friend struct OTAStageRecord;
+    
+    OTAStageRecord _records[OTA_METRICS_RING];
+    OTAMetricField _fields[OTA_METRICS_FIELD_POOL];
+    uint8_t _head;      // oldest record
+    uint8_t _count;
+    uint8_t _fieldsUsed;  // by the records in the ring, from the oldest one's firstField on
+    uint16_t _dropped;
+    
+    const OTAStageRecord& at(uint8_t i) const { return _records[(_head + i) % OTA_METRICS_RING]; }
+    void dropOldest();
+    OTAMetricField* claimField(OTAStageRecord& rec);
+};
+
+#endif // OTA_METRICS_H
@@ -0,0 +1,192 @@
+#include "ota_mqtt_transfer.h"
+#include "ota_http_client.h"
+
+#define RING_SIZE (OTA_MQTT_CHUNK * OTA_MQTT_WINDOW)
+
+static uint32_t readLE32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+OTAMqttTransfer::OTAMqttTransfer()
+    : _publisher(nullptr), _ring(nullptr), _head(0), _count(0), _active(false), _missing(false),
+      _resend(false), _total(-1), _received(0), _limit(0), _nakOffset(0), _lastChunk(0),
+      _gaps(0), _rerequests(0) {
+    _file[0] = '\0';
+}
+
+OTAMqttTransfer::~OTAMqttTransfer() {
+    end();
+}
+
+int OTAMqttTransfer::request(const char* file, uint32_t offset) {
+    end();
+    if (!_publisher) return OTA_HTTP_ERROR_CONNECT;
+    if (strlen(file) >= sizeof(_file)) return OTA_HTTP_ERROR_URL;
+    
+    _ring = (uint8_t*)malloc(RING_SIZE);
+    if (!_ring) {
+        Serial.println("[MQTT-OTA] No memory for the receive ring");
+        return OTA_HTTP_ERROR_CONNECT;
+    }
+    
+    strcpy(_file, file);
+    _head = 0;
+    _count = 0;
+    _active = true;
+    _missing = false;
+    _resend = false;
+    _total = -1;
+    _received = offset;
+    _nakOffset = offset;
+    sendRequest();
+    
+    // Chunks only arrive from the MQTT loop, so pump it for the first one
+    unsigned long start = otaMillis();
+    while (_total < 0 && !_missing && otaMillis() - start < OTA_MQTT_RESPONSE_TIMEOUT) {
+        _publisher->loop();
+        otaYield();
+    }
+    
+    if (_missing) {
+        end();
+        return 404;
+    }
+    if (_total < 0) {
+        Serial.printf("[MQTT-OTA] No chunk within %d ms\n", OTA_MQTT_RESPONSE_TIMEOUT);
+        end();
+        return OTA_HTTP_ERROR_RESPONSE;
+    }
+    return offset > 0 ? 206 : 200;
+}
+
+void OTAMqttTransfer::sendRequest() {
+    char payload[160];
+    _limit = _received - _count + RING_SIZE;
+    snprintf(payload, sizeof(payload), "{\"file\":\"%s\",\"offset\":%u,\"limit\":%u,\"chunk\":%u}",
+             _file, (unsigned)_received, (unsigned)_limit, (unsigned)OTA_MQTT_CHUNK);
+    _publisher->publish(MQTT_TOPIC_FW_REQUEST, payload);
+    _lastChunk = otaMillis();
+}
+
+void OTAMqttTransfer::onChunk(const uint8_t* payload, size_t len) {
+    if (!_active || len < OTA_MQTT_CHUNK_HEADER) return;
+    
+    uint32_t offset = readLE32(payload);
+    uint32_t total = readLE32(payload + 4);
+    if (total == 0) {
+        Serial.printf("[MQTT-OTA] Server has no %s\n", _file);
+        _missing = true;
+        return;
+    }
+    _total = total;
+    
+    const uint8_t* data = payload + OTA_MQTT_CHUNK_HEADER;
+    size_t dataLen = len - OTA_MQTT_CHUNK_HEADER;
+    
+    // Ahead of what we have: something in between was lost. The chunks that
+    // follow it are dropped too until the re-requested stream catches up,
+    // and are not counted as gaps of their own.
+    if (offset > _received) {
+        if (!_resend && _nakOffset != _received) {
+            _gaps++;
+            _resend = true;
+        }
+        return;
+    }
+    
+    // Resent bytes we already hold
+    size_t skip = _received - offset;
+    if (skip >= dataLen) return;
+    data += skip;
+    dataLen -= skip;
+    
+    if (dataLen > RING_SIZE - _count) {
+        // The server went past the limit; drop it and let it come again
+        _resend = true;
+        return;
+    }
+    
+    size_t tail = (_head + _count) % RING_SIZE;
+    size_t first = min(dataLen, (size_t)(RING_SIZE - tail));
+    memcpy(_ring + tail, data, first);
+    memcpy(_ring, data + first, dataLen - first);
+    _count += dataLen;
+    _received += dataLen;
+    _lastChunk = otaMillis();
+}
+
+// Re-requests from the first missing byte after a gap, or when nothing came
+// for OTA_MQTT_RETRY although the server may send
+void OTAMqttTransfer::poll() {
+    if (!_active || (_total >= 0 && _received >= (uint32_t)_total)) return;
+    
+    unsigned long now = otaMillis();
+    if (_resend || now - _lastChunk >= OTA_MQTT_RETRY) {
+        _resend = false;
+        _nakOffset = _received;
+        _rerequests++;
+        Serial.printf("[MQTT-OTA] Re-requesting %s from %u\n", _file, (unsigned)_received);
+        sendRequest();
+    }
+}
+
+bool OTAMqttTransfer::connected() {
+    if (!_active || _missing) return false;
+    return _count > 0 || _total < 0 || _received < (uint32_t)_total;
+}
+
+int OTAMqttTransfer::available() {
+    if (_active && _count == 0) {
+        _publisher->loop();
+        poll();
+    }
+    return _count;
+}
+
+int OTAMqttTransfer::read(uint8_t* buffer, size_t len) {
+    size_t n = 0;
+    while (n < len && _count > 0) {
+        const uint8_t* data;
+        size_t chunk = min(peek(data), len - n);
+        memcpy(buffer + n, data, chunk);
+        consume(chunk);
+        n += chunk;
+    }
+    return n;
+}
+
+size_t OTAMqttTransfer::peek(const uint8_t*& data) {
+    // The zero-copy loop only peeks, so an empty ring still pumps MQTT
+    if (_count == 0) {
+        available();
+    }
+    data = _ring + _head;
+    return min(_count, (size_t)(RING_SIZE - _head));
+}
+
+void OTAMqttTransfer::consume(size_t len) {
+    if (len > _count) len = _count;
+    _head = (_head + len) % RING_SIZE;
+    _count -= len;
+    
+    // Grant the freed space in steps of half the ring, not per chunk
+    uint32_t limit = _received - _count + RING_SIZE;
+    if (limit - _limit >= RING_SIZE / 2 && (_total < 0 || _limit < (uint32_t)_total)) {
+        char payload[12];
+        snprintf(payload, sizeof(payload), "%u", (unsigned)limit);
+        _publisher->publish(MQTT_TOPIC_FW_ACK, payload);
+        _limit = limit;
+    }
+}
+
+void OTAMqttTransfer::end() {
+    free(_ring);
+    _ring = nullptr;
+    _count = 0;
+    _active = false;
+}
+
+void OTAMqttTransfer::resetStats() {
+    _gaps = 0;
+    _rerequests = 0;
+}
@@ -0,0 +1,77 @@
+#ifndef OTA_MQTT_TRANSFER_H
+#define OTA_MQTT_TRANSFER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "ota_platform.h"
+#include "ota_stream.h"
+
+#define OTA_MQTT_CHUNK_HEADER 8
+
+// Downloads a release file as chunk messages over the MQTT connection the
+// device already holds, instead of a second TLS connection to the OTA server.
+// Manifest URLs of the form "mqtt:<file>" select it.
+//
+//   request (device -> MQTT_TOPIC_FW_REQUEST)
+//     {"file":"firmware-otaq.bin","offset":N,"limit":L,"chunk":C}
+//   chunk   (server -> MQTT_TOPIC_FW_CHUNK)
+//     offset u32 LE | total u32 LE | up to C data bytes; total 0 = no such file
+//   ack     (device -> MQTT_TOPIC_FW_ACK)
+//     L as decimal text
+//
+// The server sends from `offset` in order and never past `limit`, which the
+// device raises as it consumes bytes, so at most OTA_MQTT_WINDOW chunks are
+// in flight and they always fit the receive ring. Chunks are sent at QoS 0:
+// anything lost (a broker reconnect) shows up as a gap or as silence, and
+// the device re-requests from the first byte it is missing.
+class OTAMqttTransfer : public OTAStream {
+public:
+    OTAMqttTransfer();
+    ~OTAMqttTransfer();
+    
+    void setPublisher(OTAPublisher* publisher) { _publisher = publisher; }
+    
+    // Asks for `file` from `offset` and waits for the first chunk, the way
+    // an HTTP GET waits for the response head. Returns 200 (206 when
+    // resuming), 404 when the server has no such file, or OTA_HTTP_ERROR_*.
+    int request(const char* file, uint32_t offset);
+    
+    // Feed of MQTT_TOPIC_FW_CHUNK messages, from the MQTT callback
+    void onChunk(const uint8_t* payload, size_t len);
+    
+    bool connected();
+    int available();
+    int read(uint8_t* buffer, size_t len);
+    bool peekSupported() { return true; }
+    size_t peek(const uint8_t*& data);
+    void consume(size_t len);
+    void end();
+    int32_t contentLength() const { return _total; }
+    
+    // Recovery statistics, accumulated until resetStats()
+    void resetStats();
+    uint16_t gaps() const { return _gaps; }
+    uint16_t rerequests() const { return _rerequests; }
+
+private:
+    OTAPublisher* _publisher;
+    uint8_t* _ring;           // OTA_MQTT_WINDOW chunks, allocated per transfer
+    size_t _head;             // oldest unread byte
+    size_t _count;
+    char _file[64];
+    bool _active;
+    bool _missing;            // server answered total 0
+    bool _resend;             // a gap was seen, re-request on the next poll
+    int32_t _total;
+    uint32_t _received;       // file offset of the next byte expected
+    uint32_t _limit;          // last limit granted to the server
+    uint32_t _nakOffset;      // _received when the last re-request went out
+    unsigned long _lastChunk;   // last accepted data, or the last request
+    uint16_t _gaps;
+    uint16_t _rerequests;
+    
+    void sendRequest();
+    void poll();
+};
+
+#endif // OTA_MQTT_TRANSFER_H
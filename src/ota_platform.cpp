@@ -0,0 +1,12 @@
+#include "ota_platform.h"
+
+// Platform-independent parts of the platform layer
+
+uint32_t otaRecordChecksum(const void* record, size_t len) {
+    const uint8_t* p = (const uint8_t*)record;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
@@ -0,0 +1,125 @@
+#ifndef OTA_PLATFORM_H
+#define OTA_PLATFORM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Hardware services used by the OTA pipeline. The device implementation is
+// ota_platform_esp8266.cpp; src/native/ota_platform_linux.cpp backs the same
+// calls with files so checkForUpdates() can run on a Linux host
+// (pio run -e native).
+
+// Clock
+uint32_t otaMillis();
+uint32_t otaMicros();
+void otaDelay(uint32_t ms);
+void otaYield();
+
+// Heap
+struct OTAHeapStats {
+    uint32_t freeHeap;
+    uint32_t maxBlock;
+    uint8_t fragmentation;    // percent
+};
+
+void otaHeapStats(OTAHeapStats& stats);
+uint32_t otaFreeHeap();
+
+// Network
+bool otaNetworkUp();
+int otaRssi();  // dBm, 0 when unknown
+
+// Storage: small records by path (SPIFFS on the device)
+bool otaStorageRead(const char* path, void* data, size_t len);
+bool otaStorageWrite(const char* path, const void* data, size_t len);
+void otaStorageRemove(const char* path);
+
+// Storage as a growing log: appended to, read back by offset
+bool otaStorageAppend(const char* path, const void* data, size_t len);
+bool otaStorageReadAt(const char* path, uint32_t offset, void* data, size_t len);
+uint32_t otaStorageSize(const char* path);  // 0 when missing
+
+// Integrity check for the small records kept in storage and RTC memory:
+// FNV-1a over the first `len` bytes, i.e. every field before the check
+// itself, which each record keeps last
+uint32_t otaRecordChecksum(const void* record, size_t len);
+
+// Records that survive a restart but not a power cycle: the 512 bytes of RTC
+// user memory on the device, rtc.bin on the host. Every owner has a region of
+// its own, all laid out in otaRetainedLayout so they cannot overlap.
+enum OTARetainedRegion {
+    RETAINED_EBOOT,     // eboot command, only written by otaScheduleCopy()
+    RETAINED_SESSION,   // OTASessionRecord, across the update restart
+    RETAINED_WIFI,      // WiFiFastRecord, the last good join
+    RETAINED_CLOCK,     // NTPClockRecord, the last synced time
+    RETAINED_REGIONS
+};
+
+struct OTARetainedSpan {
+    uint16_t offset;    // bytes, word aligned
+    uint16_t size;
+};
+
+#define OTA_RETAINED_SIZE 512
+
+constexpr OTARetainedSpan otaRetainedLayout[RETAINED_REGIONS] = {
+    {0, 128},           // eboot_command is 32 words
+    {128, 256},
+    {384, 40},
+    {424, 16},
+};
+
+constexpr bool otaRetainedLayoutValid(int i = 1) {
+    return i == RETAINED_REGIONS
+        ? otaRetainedLayout[i - 1].offset + otaRetainedLayout[i - 1].size <= OTA_RETAINED_SIZE
+        : otaRetainedLayout[i].offset % 4 == 0 &&
+          otaRetainedLayout[i].offset >= otaRetainedLayout[i - 1].offset + otaRetainedLayout[i - 1].size &&
+          otaRetainedLayoutValid(i + 1);
+}
+static_assert(otaRetainedLayoutValid(), "Retained regions overlap or do not fit in RTC user memory");
+
+// `len` must be a multiple of 4 and no larger than the region
+bool otaRetainedRead(OTARetainedRegion region, void* data, size_t len);
+bool otaRetainedWrite(OTARetainedRegion region, const void* data, size_t len);
+
+// Flash. The running sketch starts at address 0, the OTA slot ends at
+// otaSlotEnd(). Writes must be word aligned and go to erased sectors.
+uint32_t otaSketchSize();
+uint32_t otaSlotEnd();
+bool otaFlashErase(uint32_t sector);
+bool otaFlashWrite(uint32_t address, const uint8_t* data, size_t len);
+bool otaFlashRead(uint32_t address, uint8_t* data, size_t len);
+
+// Checks a new image's header (its first bytes) against the flash chip the
+// way UpdaterClass does: false when the image was built for more flash than
+// the chip has; otherwise the flash mode byte is set to the running one
+bool otaAdaptImageHeader(uint8_t* header, size_t len);
+
+// Has the bootloader copy `size` bytes from `address` over the sketch on the
+// next boot
+bool otaScheduleCopy(uint32_t address, uint32_t size);
+void otaRestart();
+
+// Where ota/metrics go: MQTTHandler on the device, stdout on the host
+class OTAPublisher {
+public:
+    virtual ~OTAPublisher() {}
+    virtual void loop() = 0;
+    
+    // False when the message was not accepted (queue full, too large)
+    virtual bool publish(const char* topic, const char* payload) = 0;
+    virtual bool publish(const char* topic, const uint8_t* payload, size_t len) = 0;
+    
+    // Publishers with a queue of their own can lend room in it, so a message
+    // is encoded in place instead of in a buffer publish() then copies:
+    // reserve() returns `len` bytes for a message to `topic` (nullptr when it
+    // cannot), commit() queues the first `used` of them, 0 gives them back.
+    virtual uint8_t* reserve(const char*, size_t) { return nullptr; }
+    virtual bool commit(size_t) { return false; }
+    
+    // Publishers that queue send what they hold, for up to `timeoutMs`;
+    // called before a restart
+    virtual void flush(uint32_t) {}
+};
+
+#endif // OTA_PLATFORM_H
@@ -0,0 +1,160 @@
+#include "ota_platform.h"
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <FS.h>
+#include <eboot_command.h>
+
+extern "C" uint32_t _FS_start;
+
+uint32_t otaMillis() {
+    return millis();
+}
+
+uint32_t otaMicros() {
+    return micros();
+}
+
+void otaDelay(uint32_t ms) {
+    delay(ms);
+}
+
+void otaYield() {
+    yield();
+}
+
+void otaHeapStats(OTAHeapStats& stats) {
+    stats.freeHeap = ESP.getFreeHeap();
+    stats.maxBlock = ESP.getMaxFreeBlockSize();
+    stats.fragmentation = ESP.getHeapFragmentation();
+}
+
+uint32_t otaFreeHeap() {
+    return ESP.getFreeHeap();
+}
+
+bool otaNetworkUp() {
+    return WiFi.status() == WL_CONNECTED;
+}
+
+int otaRssi() {
+    return WiFi.status() == WL_CONNECTED ? WiFi.RSSI() : 0;
+}
+
+bool otaStorageRead(const char* path, void* data, size_t len) {
+    File f = SPIFFS.open(path, "r");
+    if (!f) return false;
+    
+    size_t n = f.read((uint8_t*)data, len);
+    f.close();
+    return n == len;
+}
+
+bool otaStorageWrite(const char* path, const void* data, size_t len) {
+    File f = SPIFFS.open(path, "w");
+    if (!f) return false;
+    
+    size_t n = f.write((const uint8_t*)data, len);
+    f.close();
+    return n == len;
+}
+
+void otaStorageRemove(const char* path) {
+    if (SPIFFS.exists(path)) {
+        SPIFFS.remove(path);
+    }
+}
+
+bool otaStorageAppend(const char* path, const void* data, size_t len) {
+    File f = SPIFFS.open(path, "a");
+    if (!f) return false;
+    
+    size_t n = f.write((const uint8_t*)data, len);
+    f.close();
+    return n == len;
+}
+
+bool otaStorageReadAt(const char* path, uint32_t offset, void* data, size_t len) {
+    File f = SPIFFS.open(path, "r");
+    if (!f) return false;
+    
+    bool ok = f.seek(offset, SeekSet) && f.read((uint8_t*)data, len) == len;
+    f.close();
+    return ok;
+}
+
+uint32_t otaStorageSize(const char* path) {
+    File f = SPIFFS.open(path, "r");
+    if (!f) return 0;
+    
+    uint32_t size = f.size();
+    f.close();
+    return size;
+}
+
+// RTC user memory is addressed in 4-byte blocks
+bool otaRetainedRead(OTARetainedRegion region, void* data, size_t len) {
+    const OTARetainedSpan& span = otaRetainedLayout[region];
+    return len <= span.size && ESP.rtcUserMemoryRead(span.offset / 4, (uint32_t*)data, len);
+}
+
+bool otaRetainedWrite(OTARetainedRegion region, const void* data, size_t len) {
+    const OTARetainedSpan& span = otaRetainedLayout[region];
+    return len <= span.size && ESP.rtcUserMemoryWrite(span.offset / 4, (uint32_t*)data, len);
+}
+
+uint32_t otaSketchSize() {
+    return ESP.getSketchSize();
+}
+
+uint32_t otaSlotEnd() {
+    // The OTA slot ends right below the filesystem, same as UpdaterClass
+    return (uint32_t)&_FS_start - 0x40200000;
+}
+
+bool otaFlashErase(uint32_t sector) {
+    return ESP.flashEraseSector(sector);
+}
+
+bool otaFlashWrite(uint32_t address, const uint8_t* data, size_t len) {
+    return ESP.flashWrite(address, (uint32_t*)data, len);
+}
+
+bool otaFlashRead(uint32_t address, uint8_t* data, size_t len) {
+    return ESP.flashRead(address, data, len);
+}
+
+bool otaAdaptImageHeader(uint8_t* header, size_t len) {
+    if (len < 4) return false;
+    
+    // Byte 3: flash size in the high nibble, frequency in the low one
+    uint32_t imageFlashSize = ESP.magicFlashChipSize((header[3] & 0xF0) >> 4);
+    if (imageFlashSize > ESP.getFlashChipRealSize()) {
+        Serial.printf("[FLASH] Image built for %u bytes of flash, chip has %u\n",
+                      imageFlashSize, ESP.getFlashChipRealSize());
+        return false;
+    }
+    
+    // Byte 2: flash mode. eboot boots the copy with it, so an image built for
+    // QIO would not start on a DOUT-wired module
+    FlashMode_t mode = ESP.getFlashChipMode();
+    if (mode <= FM_DOUT && ESP.magicFlashChipMode(header[2]) != mode) {
+        Serial.printf("[FLASH] Flash mode %u -> %u\n", header[2], (unsigned)mode);
+        header[2] = mode;
+    }
+    return true;
+}
+
+bool otaScheduleCopy(uint32_t address, uint32_t size) {
+    // eboot copies the slot over the running sketch on the next boot
+    eboot_command ebcmd;
+    ebcmd.action = ACTION_COPY_RAW;
+    ebcmd.args[0] = address;
+    ebcmd.args[1] = 0x00000;
+    ebcmd.args[2] = size;
+    eboot_command_write(&ebcmd);
+    return true;
+}
+
+void otaRestart() {
+    ESP.restart();
+}
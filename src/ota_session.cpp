@@ -0,0 +1,130 @@
+#include "ota_session.h"
+#include "config.h"
+#include "ota_platform.h"
+#include "ota_clock.h"
+#include <sys/time.h>
+
+#define SESSION_MAGIC 0x4F545331  // "OTS1"
+
+static_assert(sizeof(OTASessionRecord) <= otaRetainedLayout[RETAINED_SESSION].size,
+              "Session record does not fit its RTC region");
+
+// Wall clock in ms, 0 until NTP has synced. A seeded clock is off by the
+// time the device was down, which is what the restart gap measures.
+static uint64_t epochMs() {
+    if (otaClockSource() != CLOCK_NTP) return 0;
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static const char* const bootKeys[BOOT_PHASES] = { "wifi_ms", "clock_ms", "ntp_ms", "mqtt_ms" };
+static const char* const bootViaKeys[BOOT_PHASES] = { "wifi_via", "clock_via", "ntp_via", "mqtt_via" };
+
+OTASession::OTASession() : _startMs(0), _reached(0), _pending(false) {
+    memset(&_record, 0, sizeof(_record));
+    memset(_boot, 0, sizeof(_boot));
+    memset(_bootVia, 0, sizeof(_bootVia));
+}
+
+// Leaves the version strings alone: a reported record may still point at
+// them until the next flush
+void OTASession::start() {
+    _record.id = ((uint32_t)random(0x10000) << 16) | random(0x10000);
+    memset(_record.marks, 0, sizeof(_record.marks));
+    _startMs = otaMillis();
+}
+
+void OTASession::mark(OTASessionMark mark) {
+    _record.marks[mark] = otaMillis() - _startMs;
+}
+
+bool OTASession::save(const char* toVersion) {
+    _record.magic = SESSION_MAGIC;
+    _record.restartEpochMs = epochMs();
+    snprintf(_record.fromVersion, sizeof(_record.fromVersion), "%s", FIRMWARE_VERSION);
+    snprintf(_record.toVersion, sizeof(_record.toVersion), "%s", toVersion);
+    _record.check = otaRecordChecksum(&_record, offsetof(OTASessionRecord, check));
+    
+    if (!otaRetainedWrite(RETAINED_SESSION, &_record, sizeof(_record))) {
+        Serial.println("[SESSION] Failed to store session");
+        return false;
+    }
+    return true;
+}
+
+bool OTASession::load() {
+    _pending = false;
+    if (!otaRetainedRead(RETAINED_SESSION, &_record, sizeof(_record))) return false;
+    
+    // RTC memory holds garbage after a power cycle
+    bool valid = _record.magic == SESSION_MAGIC &&
+                 _record.check == otaRecordChecksum(&_record, offsetof(OTASessionRecord, check));
+    if (valid) {
+        OTASessionRecord cleared;
+        memset(&cleared, 0, sizeof(cleared));
+        otaRetainedWrite(RETAINED_SESSION, &cleared, sizeof(cleared));
+        _record.fromVersion[sizeof(_record.fromVersion) - 1] = '\0';
+        _record.toVersion[sizeof(_record.toVersion) - 1] = '\0';
+        Serial.printf("[SESSION] Booted from update %08x (%s -> %s)\n",
+                      _record.id, _record.fromVersion, _record.toVersion);
+        _pending = true;
+    } else {
+        memset(&_record, 0, sizeof(_record));
+    }
+    return valid;
+}
+
+void OTASession::bootPhase(OTABootPhase phase, const char* via) {
+    if (reached(phase)) return;
+    _boot[phase] = otaMillis();
+    _bootVia[phase] = via;
+    _reached |= 1 << phase;
+}
+
+// Phases that were not reached (no SNTP answer yet, say) are left out
+void OTASession::reportBoot(OTAMetricsRing& metrics) {
+    OTAStageRecord& record = metrics.push("boot_timeline", _boot[BOOT_MQTT] * 1000);
+    for (uint8_t i = 0; i < BOOT_PHASES; i++) {
+        if (!reached((OTABootPhase)i)) continue;
+        record.add(bootKeys[i], _boot[i]);
+        if (_bootVia[i]) {
+            record.add(bootViaKeys[i], _bootVia[i]);
+        }
+    }
+    
+    Serial.printf("[BOOT] Ready after %u ms (wifi %u, clock %u, ntp %u)\n", _boot[BOOT_MQTT],
+                  _boot[BOOT_WIFI], _boot[BOOT_CLOCK], _boot[BOOT_NTP]);
+}
+
+// The restart-to-boot gap can only come from the wall clock, so it needs NTP
+// on both sides of the restart; the boot phases count from this image's start
+void OTASession::report(OTAMetricsRing& metrics) {
+    if (!_pending) return;
+    _pending = false;
+    
+    uint64_t now = epochMs();
+    uint64_t bootEpochMs = now ? now - otaMillis() : 0;
+    bool rebootKnown = _record.restartEpochMs && bootEpochMs > _record.restartEpochMs;
+    uint32_t rebootMs = rebootKnown ? bootEpochMs - _record.restartEpochMs : 0;
+    uint32_t totalMs = _record.marks[MARK_RESTART] + rebootMs + _boot[BOOT_MQTT];
+    
+    OTAStageRecord& record = metrics.push("update_timeline", totalMs * 1000);
+    record.add("session", _record.id)
+          .add("from", _record.fromVersion)
+          .add("to", _record.toVersion)
+          .add("running", FIRMWARE_VERSION)
+          .add("manifest_ms", _record.marks[MARK_MANIFEST])
+          .add("download_ms", _record.marks[MARK_DOWNLOAD])
+          .add("verify_ms", _record.marks[MARK_VERIFY])
+          .add("commit_ms", _record.marks[MARK_COMMIT])
+          .add("restart_ms", _record.marks[MARK_RESTART]);
+    if (rebootKnown) {
+        record.add("reboot_ms", rebootMs);
+    }
+    record.add("wifi_ms", _boot[BOOT_WIFI])
+          .add("ntp_ms", _boot[BOOT_NTP])
+          .add("mqtt_ms", _boot[BOOT_MQTT]);
+    
+    Serial.printf("[SESSION] Update %08x ready after %u ms\n", _record.id, totalMs);
+}
@@ -0,0 +1,76 @@
+#ifndef OTA_SESSION_H
+#define OTA_SESSION_H
+
+#include <Arduino.h>
+#include "ota_metrics.h"
+
+// Milestones of an update, in ms since its check started
+enum OTASessionMark {
+    MARK_MANIFEST,      // manifest verified
+    MARK_DOWNLOAD,      // image complete in the OTA slot
+    MARK_VERIFY,        // image hash verified
+    MARK_COMMIT,        // eboot copy scheduled
+    MARK_RESTART,       // right before otaRestart()
+    MARK_COUNT
+};
+
+// Boot milestones, in ms since the image started. They overlap: the clock
+// can be seeded before WiFi is up, and MQTT can connect before SNTP answers.
+enum OTABootPhase {
+    BOOT_WIFI,          // IP address
+    BOOT_CLOCK,         // wall clock usable (seeded or synced)
+    BOOT_NTP,           // synced by SNTP
+    BOOT_MQTT,          // broker connected
+    BOOT_PHASES
+};
+
+// What the restart into a new image must carry over. Kept in RTC memory
+// (RETAINED_SESSION), which survives the restart but not a power cycle.
+struct OTASessionRecord {
+    uint32_t magic;
+    uint32_t id;
+    uint64_t restartEpochMs;  // wall clock at the restart, 0 if NTP never synced
+    char fromVersion[48];
+    char toVersion[48];
+    uint32_t marks[MARK_COUNT];
+    uint32_t check;
+};
+
+// The boot timeline, and an update's timeline across the restart. Nothing
+// after the commit can be timed by the image that did the update: eboot
+// copying the image, the boot, and rejoining WiFi, NTP and MQTT are usually
+// the longest part. The old image saves its milestones right before
+// restarting; the new one adds its boot phases and reports the whole update
+// as one update_timeline record.
+class OTASession {
+public:
+    OTASession();
+    
+    // Update side
+    void start();
+    void mark(OTASessionMark mark);
+    bool save(const char* toVersion);
+    uint32_t id() const { return _record.id; }
+    
+    // Boot side. load() takes the record out of RTC memory, so a session is
+    // reported by the first boot after its restart only.
+    bool load();
+    bool pending() const { return _pending; }
+    
+    // Every boot: the first bootPhase() of each phase counts, `via` (a
+    // literal) tells how it was reached. reportBoot() queues boot_timeline.
+    void bootPhase(OTABootPhase phase, const char* via = nullptr);
+    bool reached(OTABootPhase phase) const { return _reached & (1 << phase); }
+    void reportBoot(OTAMetricsRing& metrics);
+    void report(OTAMetricsRing& metrics);
+
+private:
+    OTASessionRecord _record;
+    unsigned long _startMs;
+    uint32_t _boot[BOOT_PHASES];
+    const char* _bootVia[BOOT_PHASES];
+    uint8_t _reached;
+    bool _pending;
+};
+
+#endif // OTA_SESSION_H
@@ -0,0 +1,34 @@
+#include "ota_signature.h"
+#include "ed25519_fast.h"
+#include <Ed25519.h>
+#include <bearssl/bearssl_ec.h>
+#include <string.h>
+
+bool Ed25519Backend::verify(const uint8_t* digest, size_t digestLen, const uint8_t* signature) const {
+    return Ed25519::verify(signature, _publicKey, digest, digestLen);
+}
+
+bool Ed25519FastBackend::verify(const uint8_t* digest, size_t digestLen, const uint8_t* signature) const {
+    return Ed25519Fast::verify(signature, digest, digestLen);
+}
+
+bool EcdsaP256Backend::verify(const uint8_t* digest, size_t digestLen, const uint8_t* signature) const {
+    // br_ec_public_key wants a mutable buffer
+    uint8_t q[65];
+    memcpy(q, _publicKey, sizeof(q));
+    br_ec_public_key pk = { BR_EC_secp256r1, q, sizeof(q) };
+    return br_ecdsa_i15_vrfy_raw(&br_ec_p256_m15, digest, digestLen, &pk, signature, 64) == 1;
+}
+
+OTASignatureBackend& otaSignatureBackend() {
+#if FIRMWARE_ALGORITHM_ID == OTA_SIG_ED25519
+    static Ed25519Backend backend(OTA_ED25519_KEY.bytes);
+#elif FIRMWARE_ALGORITHM_ID == OTA_SIG_ED25519_FAST
+    static Ed25519FastBackend backend;
+#elif FIRMWARE_ALGORITHM_ID == OTA_SIG_ECDSA_P256
+    static EcdsaP256Backend backend(OTA_ECDSA_P256_KEY.bytes);
+#else
+#error "Unknown FIRMWARE_ALGORITHM_ID"
+#endif
+    return backend;
+}
@@ -0,0 +1,101 @@
+#ifndef OTA_SIGNATURE_H
+#define OTA_SIGNATURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+// Values of FIRMWARE_ALGORITHM_ID, which version_inject.py derives from
+// FIRMWARE_ALGORITHM
+#define OTA_SIG_ED25519 1       // "ed25519": rweather/Crypto
+#define OTA_SIG_ED25519_FAST 2  // "ed25519-fast": precomputed tables, see ed25519_fast.h
+#define OTA_SIG_ECDSA_P256 3    // "ecdsa-p256": BearSSL, key in ECDSA_PUBLIC_KEY_HEX
+
+#ifndef FIRMWARE_ALGORITHM_ID
+#define FIRMWARE_ALGORITHM_ID OTA_SIG_ED25519
+#endif
+
+// Compile-time decoding of the hex keys in config.h
+constexpr int otaHexNibble(char c) {
+    return (c >= '0' && c <= '9') ? c - '0' :
+           (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+           (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+}
+
+template <size_t L>
+constexpr bool otaHexValid(const char (&hex)[L]) {
+    for (size_t i = 0; i + 1 < L; i++) {
+        if (otaHexNibble(hex[i]) < 0) return false;
+    }
+    return L % 2 == 1;
+}
+
+template <size_t N>
+struct OTAKeyBytes {
+    uint8_t bytes[N];
+};
+
+template <size_t L>
+constexpr OTAKeyBytes<L / 2> otaKeyFromHex(const char (&hex)[L]) {
+    OTAKeyBytes<L / 2> key = {};
+    for (size_t i = 0; i < L / 2; i++) {
+        key.bytes[i] = (uint8_t)((otaHexNibble(hex[2 * i]) << 4) | otaHexNibble(hex[2 * i + 1]));
+    }
+    return key;
+}
+
+constexpr bool otaStrEqual(const char* a, const char* b) {
+    return *a == *b && (*a == '\0' || otaStrEqual(a + 1, b + 1));
+}
+
+static_assert(sizeof(PUBLIC_KEY_HEX) == 65 && otaHexValid(PUBLIC_KEY_HEX),
+              "PUBLIC_KEY_HEX must be 64 hex characters");
+static_assert(sizeof(ECDSA_PUBLIC_KEY_HEX) == 131 && otaHexValid(ECDSA_PUBLIC_KEY_HEX),
+              "ECDSA_PUBLIC_KEY_HEX must be 130 hex characters (04 | X | Y)");
+
+constexpr OTAKeyBytes<32> OTA_ED25519_KEY = otaKeyFromHex(PUBLIC_KEY_HEX);
+constexpr OTAKeyBytes<65> OTA_ECDSA_P256_KEY = otaKeyFromHex(ECDSA_PUBLIC_KEY_HEX);
+
+// Verifies a 64-byte signature (Ed25519 R | S or ECDSA r | s) over the
+// SHA-256 digest the release pipeline signed. Every backend is built;
+// FIRMWARE_ALGORITHM picks the one otaSignatureBackend() returns, and the
+// others are dropped by the linker.
+class OTASignatureBackend {
+public:
+    virtual ~OTASignatureBackend() {}
+    virtual const char* name() const = 0;
+    virtual bool verify(const uint8_t* digest, size_t digestLen, const uint8_t* signature) const = 0;
+};
+
+// rweather/Crypto, any 32-byte key
+class Ed25519Backend : public OTASignatureBackend {
+public:
+    explicit Ed25519Backend(const uint8_t* publicKey) : _publicKey(publicKey) {}
+    const char* name() const { return "ed25519"; }
+    bool verify(const uint8_t* digest, size_t digestLen, const uint8_t* signature) const;
+
+private:
+    const uint8_t* _publicKey;
+};
+
+// Ed25519Fast, PUBLIC_KEY_HEX only
+class Ed25519FastBackend : public OTASignatureBackend {
+public:
+    const char* name() const { return "ed25519-fast"; }
+    bool verify(const uint8_t* digest, size_t digestLen, const uint8_t* signature) const;
+};
+
+// BearSSL i15 P-256, any uncompressed 65-byte key
+class EcdsaP256Backend : public OTASignatureBackend {
+public:
+    explicit EcdsaP256Backend(const uint8_t* publicKey) : _publicKey(publicKey) {}
+    const char* name() const { return "ecdsa-p256"; }
+    bool verify(const uint8_t* digest, size_t digestLen, const uint8_t* signature) const;
+
+private:
+    const uint8_t* _publicKey;
+};
+
+OTASignatureBackend& otaSignatureBackend();
+
+#endif // OTA_SIGNATURE_H
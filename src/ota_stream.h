@@ -0,0 +1,28 @@
+#ifndef OTA_STREAM_H
+#define OTA_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Body of a download as the stream loops in OTAUpdater read it, whichever
+// way it arrives: OTAHttpClient for HTTP(S), OTAMqttTransfer as chunks over
+// the MQTT connection.
+class OTAStream {
+public:
+    virtual ~OTAStream() {}
+    
+    virtual bool connected() = 0;
+    virtual int available() = 0;
+    virtual int read(uint8_t* buffer, size_t len) = 0;
+    
+    // Zero-copy access: peek() points `data` at bytes that stay valid until
+    // consume()
+    virtual bool peekSupported() = 0;
+    virtual size_t peek(const uint8_t*& data) = 0;
+    virtual void consume(size_t len) = 0;
+    
+    virtual void end() = 0;
+    virtual int32_t contentLength() const = 0;  // -1 when unknown
+};
+
+#endif // OTA_STREAM_H
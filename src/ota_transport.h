@@ -0,0 +1,74 @@
+#ifndef OTA_TRANSPORT_H
+#define OTA_TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+#ifdef ARDUINO
+#include <ESP8266WiFi.h>
+#if FIRMWARE_TLS == 1
+#include <WiFiClientSecure.h>
+#include "tls_session_cache.h"
+#endif
+#elif FIRMWARE_TLS == 1
+#error "The native build speaks plain HTTP, build it with -DFIRMWARE_TLS=0"
+#endif
+
+// Byte stream under OTAHttpClient. On the device a WiFiClientSecure (or
+// WiFiClient without FIRMWARE_TLS), on the host a TCP socket
+// (src/native/ota_transport_linux.cpp).
+class OTATransport {
+public:
+    OTATransport();
+    ~OTATransport();
+
+#if FIRMWARE_TLS == 1
+    void setSessionCache(TLSSessionCache* cache) { _sessions = cache; }
+#endif
+
+    bool connect(const char* host, uint16_t port);
+    bool connected();
+    int available();
+    int read(uint8_t* buffer, size_t len);
+    size_t write(const uint8_t* data, size_t len);
+    void stop();
+    
+    // Reads up to '\n' (not stored), waiting at most the timeout for each
+    // byte. Returns the line length, capped at `maxLen` with the rest of the
+    // line dropped, or -1 when the timeout or a close came before the '\n'.
+    int readLine(char* line, size_t maxLen);
+    void setTimeout(uint32_t ms);
+    
+    // Direct access to received bytes without copying them out: peekBuffer()
+    // points at peekAvailable() contiguous bytes, which stay valid until
+    // peekConsume(). Only usable when hasPeek() is true.
+    bool hasPeek();
+    size_t peekAvailable();
+    const uint8_t* peekBuffer();
+    void peekConsume(size_t len);
+    
+    // Whether connect() did a TLS handshake, and whether it was resumed
+    bool secure() const { return FIRMWARE_TLS == 1; }
+    bool resumed() const { return _resumed; }
+
+private:
+#ifdef ARDUINO
+#if FIRMWARE_TLS == 1
+    WiFiClientSecure _client;
+    TLSSessionCache* _sessions;
+#else
+    WiFiClient _client;
+#endif
+#else
+    int _fd;
+    uint32_t _timeout;
+    bool _eof;
+    uint8_t _rx[2048];    // bytes handed out by peekBuffer(), read first
+    size_t _rxStart;
+    size_t _rxEnd;
+#endif
+    bool _resumed;
+};
+
+#endif // OTA_TRANSPORT_H
@@ -0,0 +1,106 @@
+#include "ota_transport.h"
+#include "certificates.h"
+
+OTATransport::OTATransport() : _resumed(false) {
+#if FIRMWARE_TLS == 1
+    _sessions = nullptr;
+    
+    // Configure TLS buffer sizes (reduce memory usage)
+    _client.setBufferSizes(512, 512);
+    
+    // Use fingerprint verification (lightweight, ~3KB memory vs ~20KB for CA cert)
+    _client.setFingerprint(OTA_FINGERPRINT);
+#endif
+}
+
+OTATransport::~OTATransport() {
+    stop();
+}
+
+bool OTATransport::connect(const char* host, uint16_t port) {
+    _resumed = false;
+
+#if FIRMWARE_TLS == 1
+    // Offer the cached session ID; the server decides whether to resume
+    BearSSL::Session* session = _sessions ? _sessions->get(host, port) : nullptr;
+    TLSSessionCache::Offer offer = {};
+    if (session) {
+        offer = TLSSessionCache::offer(*session);
+        _client.setSession(session);
+    }
+    
+    Serial.printf("[HTTPS] Connecting to %s:%u (fingerprint, %s session)\n",
+                  host, port, offer.len ? "cached" : "no");
+    Serial.printf("[HTTPS] Free heap: %d bytes\n", ESP.getFreeHeap());
+    
+    if (!_client.connect(host, port)) {
+        Serial.println("[HTTPS] Possible causes:");
+        Serial.println("  - Certificate fingerprint mismatch");
+        Serial.println("  - Server certificate changed (update FINGERPRINT)");
+        Serial.println("  - Time not synchronized (check NTP)");
+        Serial.printf("  - Free heap: %d bytes\n", ESP.getFreeHeap());
+        return false;
+    }
+    _resumed = session && TLSSessionCache::resumed(offer, *session);
+    return true;
+#else
+    return _client.connect(host, port);
+#endif
+}
+
+bool OTATransport::connected() {
+    return _client.connected();
+}
+
+int OTATransport::available() {
+    return _client.available();
+}
+
+int OTATransport::read(uint8_t* buffer, size_t len) {
+    return _client.read(buffer, len);
+}
+
+size_t OTATransport::write(const uint8_t* data, size_t len) {
+    return _client.write(data, len);
+}
+
+void OTATransport::stop() {
+    _client.stop();
+}
+
+int OTATransport::readLine(char* line, size_t maxLen) {
+    // readBytesUntil() returns the same for an empty line and a timeout
+    size_t n = 0;
+    unsigned long last = millis();
+    while (true) {
+        int c = _client.read();
+        if (c < 0) {
+            if (!_client.connected() || millis() - last >= _client.getTimeout()) return -1;
+            yield();
+            continue;
+        }
+        last = millis();
+        if (c == '\n') return n;
+        if (n < maxLen) line[n++] = c;
+    }
+}
+
+void OTATransport::setTimeout(uint32_t ms) {
+    _client.setTimeout(ms);
+}
+
+bool OTATransport::hasPeek() {
+    return _client.hasPeekBufferAPI();
+}
+
+size_t OTATransport::peekAvailable() {
+    return _client.peekAvailable();
+}
+
+const uint8_t* OTATransport::peekBuffer() {
+    return (const uint8_t*)_client.peekBuffer();
+}
+
+void OTATransport::peekConsume(size_t len) {
+    _client.peekConsume(len);
+}
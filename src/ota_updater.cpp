@@ -1,500 +1,1111 @@
 #include "ota_updater.h"
-#include "mqtt_handler.h"
+#include "ota_platform.h"
+#include "ota_metrics.h"
+#include "ota_clock.h"
 #include "config.h"
-#include "certificates.h"
-#include <ESP8266WiFi.h>
-#include <ESP8266HTTPClient.h>
-#include <ESP8266httpUpdate.h>
-#include <WiFiClientSecure.h>
-#include <FS.h>
-#include <ArduinoJson.h>
+#include "ota_flash_writer.h"
+#include "ota_journal.h"
+#include "delta_patch.h"
+#include "lzss_decoder.h"
+#include "manifest_parser.h"
+#include "ota_signature.h"
 #include <bearssl/bearssl_hash.h>
-#include <Ed25519.h>
 #include <time.h>
 
-OTAUpdater::OTAUpdater() : _mqttHandler(nullptr), _stageStartTime(0) {
+// The base is the running sketch at flash address 0, nothing per updater
+static bool deltaReadBase(void*, uint32_t offset, uint8_t* out, size_t len) {
+    return otaFlashRead(offset, out, len);
 }
 
-void OTAUpdater::setMQTTHandler(MQTTHandler* mqtt) {
-    _mqttHandler = mqtt;
+OTAUpdater::OTAUpdater()
+    : _publisher(nullptr), _stageStartTime(0), _manifest(), _parser(_manifest), _source(&_http), _step(STEP_IDLE),
+      _lzss(inflateWrite, this), _decoder(nullptr), _patch(deltaReadBase, deltaWrite, this), _delta(false),
+      _attempt(0), _retryAt(0), _lastData(0), _lastCheckpoint(0), _lastPercent(-1), _streamOffset(0), _streamSize(0),
+      _streamBytes(0), _streamCpuUs(0), _streamWaitUs(0), _minHeap(0), _streamTicks(0), _unreadArrival(0), _zeroCopy(false), _inlineManifest(false),
+      _lastFlush(0), _lastProgress(0), _lastCheck(0), _nextCheckDelay(OTA_CHECK_INTERVAL) {
+#if FIRMWARE_TLS == 1
+    _http.setSessionCache(&_sessions);
+#endif
+}
+
+void OTAUpdater::setPublisher(OTAPublisher* publisher) {
+    _publisher = publisher;
+    _mqtt.setPublisher(publisher);
 }
 
 void OTAUpdater::checkForUpdates() {
-    if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("[OTA] WiFi not connected");
-        return;
+    if (beginCheck()) {
+        _step = STEP_MANIFEST_REQUEST;
     }
-    
-    // Check if time is synced (required for TLS certificate verification)
-    time_t now = time(nullptr);
-    if (now < 1000000000) {
-        Serial.println("[OTA] Time not synced! TLS will fail. Please wait for NTP sync.");
+}
+
+// A manifest pushed with the MQTT trigger replaces the manifest request and
+// its TLS handshake. Only the version is looked at before the signature
+// check, to drop triggers for a version this build already runs; an
+// unauthenticated field can only ever cancel an update that way.
+void OTAUpdater::checkManifest(const uint8_t* data, size_t len) {
+    if (!beginCheck()) {
         return;
     }
     
-    Serial.println("\n[OTA] Checking for updates...");
-    Serial.printf("[OTA] Current time: %s", ctime(&now));
-    Serial.printf("[OTA] Free heap: %d bytes\n", ESP.getFreeHeap());
-    
     monitorStartStage();
-    String manifestData;
-    if (!downloadManifest(manifestData)) {
-        Serial.println("[OTA] Failed to download manifest");
+    _parser.reset();
+    if (!_parser.feed(data, len) || !_parser.finish()) {
+        Serial.printf("[Manifest] Rejected: %s\n", _parser.error());
         return;
     }
-    monitorEndStage("download_manifest");
+    monitorEndStage("mqtt_manifest").add("bytes", len);
+    logManifest();
     
-    monitorStartStage();
-    String newVersion, expectedHash, signature;
-    if (!parseManifest(manifestData, newVersion, expectedHash, signature)) {
-        Serial.println("[OTA] Failed to parse manifest");
+    if (compareVersions(FIRMWARE_VERSION, _manifest.version) <= 0) {
+        Serial.printf("[OTA] Already running %s, trigger ignored\n", FIRMWARE_VERSION);
         return;
     }
-    monitorEndStage("parse_manifest");
-    
-    Serial.printf("[OTA] Current version: %s\n", FIRMWARE_VERSION);
-    Serial.printf("[OTA] New version: %s\n", newVersion.c_str());
+    _inlineManifest = true;
+    _step = STEP_MANIFEST_VERIFY;
+}
+
+bool OTAUpdater::beginCheck() {
+    if (busy()) {
+        Serial.printf("[OTA] Update already running (%s)\n", stateName(state()));
+        return false;
+    }
     
-    int cmp = compareVersions(FIRMWARE_VERSION, newVersion);
-    if (cmp <= 0) {
-        Serial.println("[OTA] No update needed (current >= new)");
-        return;
+    // MQTT-triggered checks also restart the periodic timer
+    _lastCheck = otaMillis();
+    _nextCheckDelay = OTA_CHECK_INTERVAL + random(OTA_CHECK_JITTER);
+    _lastFlush = _lastCheck;
+    _lastProgress = _lastCheck;
+    _inlineManifest = false;
+    _session.start();
+    return true;
+}
+
+void OTAUpdater::tick() {
+#if OTA_CHECK_PERIODIC == 1
+    if (!busy() && otaMillis() - _lastCheck >= _nextCheckDelay) {
+        checkForUpdates();
+    }
+#endif
+
+    // Steps that hand over right away let the next one use the rest of the
+    // budget; a step waiting for data or for its retry time ends the tick
+    unsigned long start = otaMillis();
+    while (busy()) {
+        Step step = _step;
+        runStep();
+        if (_step == step || otaMillis() - start >= OTA_TICK_BUDGET) {
+            break;
+        }
     }
     
-    Serial.println("[OTA] Update available! Starting OTA...");
-    performOTA(expectedHash, signature);
+    if (_metrics.count() > 0 && (!busy() || otaMillis() - _lastFlush >= OTA_METRICS_FLUSH_INTERVAL)) {
+        flushMetrics();
+    }
+
+#if OTA_PROGRESS_INTERVAL > 0
+    if (state() == STATE_DOWNLOAD && otaMillis() - _lastProgress >= OTA_PROGRESS_INTERVAL) {
+        publishProgress();
+    }
+#endif
 }
 
-bool OTAUpdater::downloadManifest(String& manifestData) {
-    HTTPClient http;
-    WiFiClient client;
+void OTAUpdater::runStep() {
+    switch (_step) {
+    case STEP_IDLE:
+        break;
+    
+    case STEP_MANIFEST_REQUEST:
+        startManifest();
+        break;
+    
+    case STEP_MANIFEST_BODY: {
+        DownloadResult result = readManifest();
+        if (result == DOWNLOAD_COMPLETE) {
+            monitorEndStage("download_manifest");
+            _step = STEP_MANIFEST_VERIFY;
+        } else if (result != DOWNLOAD_PENDING) {
+            Serial.println("[OTA] Failed to download manifest");
+            finish();
+        }
+        break;
+    }
     
-#if FIRMWARE_TLS == 1
-    WiFiClientSecure secureClient;
+    case STEP_MANIFEST_VERIFY:
+        evaluateManifest();
+        break;
+    
+    case STEP_BASE_CHECK: {
+        DownloadResult result = checkBase();
+        if (result == DOWNLOAD_COMPLETE) {
+            monitorStartStage();
+            resetStreamStats();
+            _step = STEP_DELTA_REQUEST;
+        } else if (result != DOWNLOAD_PENDING) {
+            _step = STEP_FULL_START;
+        }
+        break;
+    }
     
-    // Configure TLS buffer sizes (reduce memory usage)
-    secureClient.setBufferSizes(512, 512);
+    case STEP_DELTA_REQUEST:
+        if (requestDelta()) {
+            _step = STEP_DELTA_BODY;
+        } else {
+            fallBackToFull();
+        }
+        break;
+    
+    case STEP_DELTA_BODY: {
+        DownloadResult result = readDelta();
+        if (result == DOWNLOAD_COMPLETE) {
+            OTAStageRecord& record = monitorEndStage("stream_delta");
+            record.add("ticks", _streamTicks);
+            addFlashStats(record);
+            addTransportStats(record);
+            addChunkStats(record);
+            _session.mark(MARK_DOWNLOAD);
+            _delta = true;
+            _step = STEP_VERIFY;
+        } else if (result != DOWNLOAD_PENDING) {
+            fallBackToFull();
+        }
+        break;
+    }
     
-    // Use fingerprint verification (lightweight, ~3KB memory vs ~20KB for CA cert)
-    secureClient.setFingerprint(OTA_FINGERPRINT);
+    case STEP_FULL_START:
+        startFullDownload();
+        break;
     
-    Serial.println("[HTTPS] TLS: Fingerprint verification");
-    Serial.printf("[HTTPS] Fingerprint: %s\n", OTA_FINGERPRINT);
-    Serial.printf("[HTTPS] Free heap: %d bytes\n", ESP.getFreeHeap());
+    case STEP_FULL_REQUEST: {
+        if ((long)(otaMillis() - _retryAt) < 0) {
+            break;
+        }
+        DownloadResult result = requestFirmware();
+        if (result == DOWNLOAD_PENDING) {
+            _step = STEP_FULL_BODY;
+        } else {
+            retryDownload(result);
+        }
+        break;
+    }
     
-    if (!http.begin(secureClient, MANIFEST_URL)) {
-        Serial.println("[HTTPS] ERROR: Failed to begin HTTPS connection");
-        return false;
+    case STEP_FULL_BODY: {
+        DownloadResult result = readFirmware();
+        if (result == DOWNLOAD_COMPLETE) {
+            Serial.printf("[OTA] Download complete: %u bytes transferred, %u bytes image\n", _streamSize, _writer.written());
+            
+            // Throughput, and the processing cost per KB with network waits left out
+            unsigned long elapsed_us = otaMicros() - _stageStartTime;
+            OTAStageRecord& record = monitorEndStage("stream_firmware");
+            record.add("mode", _zeroCopy ? "zero_copy" : "copy")
+                  .add("bytes_per_sec", (uint64_t)_streamBytes * 1000000 / max(elapsed_us, 1UL))
+                  .add("cpu_us_per_kb", (uint64_t)_streamCpuUs * 1024 / max(_streamBytes, (uint32_t)1));
+            addFlashStats(record);
+            addTransportStats(record);
+            addChunkStats(record);
+            _session.mark(MARK_DOWNLOAD);
+            _step = STEP_VERIFY;
+        } else if (result != DOWNLOAD_PENDING) {
+            retryDownload(result);
+        }
+        break;
     }
-#else
-    if (!http.begin(client, MANIFEST_URL)) {
-        Serial.println("[HTTP] ERROR: Failed to begin connection");
-        return false;
+    
+    case STEP_VERIFY:
+        if (verifyImage()) {
+            _step = STEP_FLASH;
+        } else if (_delta) {
+            fallBackToFull();
+        } else {
+            finish();
+        }
+        break;
+    
+    case STEP_FLASH:
+        commitImage();
+        break;
+    }
+}
+
+// Back to idle; also releases the TLS buffers and the decoder window
+void OTAUpdater::finish() {
+    _http.close();
+    _mqtt.end();
+    _lzss.reset();
+    _step = STEP_IDLE;
+}
+
+OTAUpdater::State OTAUpdater::state() const {
+    switch (_step) {
+    case STEP_IDLE:
+        return STATE_IDLE;
+    case STEP_MANIFEST_REQUEST:
+    case STEP_MANIFEST_BODY:
+    case STEP_MANIFEST_VERIFY:
+        return STATE_MANIFEST;
+    case STEP_VERIFY:
+        return STATE_VERIFY;
+    case STEP_FLASH:
+        return STATE_FLASH;
+    default:
+        return STATE_DOWNLOAD;
+    }
+}
+
+uint8_t OTAUpdater::progress() const {
+    switch (state()) {
+    case STATE_DOWNLOAD:
+        if (_step == STEP_DELTA_BODY && _patch.targetSize() > 0) {
+            return (uint64_t)_patch.produced() * 100 / _patch.targetSize();
+        }
+        if (_step >= STEP_FULL_REQUEST && _streamSize > 0) {
+            return (uint64_t)_streamOffset * 100 / _streamSize;
+        }
+        return 0;
+    case STATE_VERIFY:
+    case STATE_FLASH:
+        return 100;
+    default:
+        return 0;
+    }
+}
+
+const char* OTAUpdater::stateName(State state) {
+    switch (state) {
+    case STATE_MANIFEST: return "manifest";
+    case STATE_DOWNLOAD: return "download";
+    case STATE_VERIFY: return "verify";
+    case STATE_FLASH: return "flash";
+    default: return "idle";
+    }
+}
+
+void OTAUpdater::beginBoot() {
+    _session.load();
+}
+
+void OTAUpdater::bootPhase(OTABootPhase phase, const char* via) {
+    _session.bootPhase(phase, via);
+}
+
+// Published right away: an update check started next would push the
+// records out of the ring before its own flush
+void OTAUpdater::bootReady() {
+    _session.reportBoot(_metrics);
+    _session.report(_metrics);
+    flushMetrics();
+}
+
+void OTAUpdater::startManifest() {
+    if (!otaNetworkUp()) {
+        Serial.println("[OTA] WiFi not connected");
+        finish();
+        return;
+    }
+    
+    // Certificate validity needs the wall clock; after a restart it is seeded
+    // from RTC memory, so only a cold boot waits for SNTP. Plain HTTP goes
+    // ahead and the manifest response's Date header sets the clock.
+    time_t now = time(nullptr);
+#if FIRMWARE_TLS == 1
+    if (!otaClockValid()) {
+        Serial.println("[OTA] Time not synced! TLS will fail. Please wait for NTP sync.");
+        finish();
+        return;
     }
 #endif
+
+    Serial.println("\n[OTA] Checking for updates...");
+    Serial.printf("[OTA] Current time: %s", ctime(&now));
+    Serial.printf("[OTA] Free heap: %d bytes\n", otaFreeHeap());
+    
+    // The manifest is parsed as it arrives, so this stage covers parsing too
+    monitorStartStage();
     
-    http.addHeader("Accept-Encoding", "identity");
-    http.addHeader("User-Agent", "ESP8266");
+    char headers[160] = "";
+    OTAManifestValidator validator;
+    if (_manifestCache.load(validator)) {
+        int len = 0;
+        if (validator.etag[0]) {
+            len += snprintf(headers + len, sizeof(headers) - len, "If-None-Match: %s\r\n", validator.etag);
+        }
+        if (validator.lastModified[0] && len < (int)sizeof(headers)) {
+            snprintf(headers + len, sizeof(headers) - len, "If-Modified-Since: %s\r\n", validator.lastModified);
+        }
+    }
     
     Serial.println("[HTTP] Sending GET request...");
-    int httpCode = http.GET();
+    int httpCode = _http.get(MANIFEST_URL, headers);
     Serial.printf("[HTTP] Response code: %d\n", httpCode);
     
-    if (httpCode == HTTP_CODE_OK) {
-        manifestData = http.getString();
-        Serial.printf("[HTTP] Manifest downloaded: %d bytes\n", manifestData.length());
-        http.end();
-        return true;
-    } else {
-        Serial.printf("[HTTP] GET failed, error: %s\n", http.errorToString(httpCode).c_str());
-        
-#if FIRMWARE_TLS == 1
-        // Additional debugging for TLS errors
-        if (httpCode == HTTPC_ERROR_CONNECTION_FAILED) {
-            Serial.println("[HTTPS] Connection failed. Possible causes:");
-            Serial.println("  - Certificate fingerprint mismatch");
-            Serial.println("  - Server certificate changed (update FINGERPRINT)");
-            Serial.println("  - Time not synchronized (check NTP)");
-            Serial.printf("  - Free heap: %d bytes\n", ESP.getFreeHeap());
-        }
-#endif
-        http.end();
-        return false;
+    // Same manifest this build already evaluated: nothing to parse or compare
+    if (httpCode == 304) {
+        _http.end();
+        monitorEndStage("download_manifest");
+        Serial.println("[OTA] Manifest not modified, no update needed");
+        finish();
+        return;
     }
-}
-
-bool OTAUpdater::parseManifest(const String& manifestData, String& version, String& hash, String& signature) {
-    DynamicJsonDocument doc(1024);
-    DeserializationError error = deserializeJson(doc, manifestData);
     
-    if (error) {
-        Serial.printf("[JSON] Parse failed: %s\n", error.c_str());
-        return false;
+    if (httpCode != 200) {
+        _http.end();
+        Serial.println("[OTA] Failed to download manifest");
+        finish();
+        return;
     }
     
-    if (!doc.containsKey("version") || !doc.containsKey("hash") || !doc.containsKey("signature")) {
-        Serial.println("[JSON] Missing required fields (version, hash, signature)");
-        return false;
+    if (_http.contentLength() > MANIFEST_MAX_SIZE) {
+        Serial.printf("[HTTP] Manifest too large: %d bytes\n", _http.contentLength());
+        Serial.println("[OTA] Failed to download manifest");
+        finish();
+        return;
     }
     
-    version = doc["version"].as<String>();
-    hash = doc["hash"].as<String>();
-    signature = doc["signature"].as<String>();
+    // Parse straight off the socket into fixed-size fields
+    _parser.reset();
+    _streamOffset = 0;
+    _lastData = otaMillis();
+    _step = STEP_MANIFEST_BODY;
+}
+
+OTAUpdater::DownloadResult OTAUpdater::readManifest() {
+    uint8_t buffer[128];
+    unsigned long start = otaMillis();
+    while (_http.connected()) {
+        int readLen = _http.read(buffer, sizeof(buffer));
+        if (readLen > 0) {
+            if (!_parser.feed(buffer, readLen)) {
+                break;
+            }
+            _streamOffset += readLen;
+            _lastData = otaMillis();
+        } else if (otaMillis() - _lastData > OTA_STALL_TIMEOUT) {
+            break;
+        } else {
+            return DOWNLOAD_PENDING;
+        }
+        if (otaMillis() - start >= OTA_TICK_BUDGET) {
+            return DOWNLOAD_PENDING;
+        }
+    }
+    _http.end();
     
-    Serial.printf("[Manifest] Version: %s\n", version.c_str());
-    Serial.printf("[Manifest] Hash: %s\n", hash.c_str());
-    Serial.printf("[Manifest] Signature: %s...\n", signature.substring(0, 32).c_str());
+    int totalRead = _streamOffset;
+    if (_http.contentLength() >= 0 && totalRead != _http.contentLength() && !_parser.error()) {
+        Serial.printf("[HTTP] Manifest truncated: %d/%d bytes\n", totalRead, _http.contentLength());
+        return DOWNLOAD_FAILED;
+    }
+    if (!_parser.finish()) {
+        Serial.printf("[Manifest] Rejected: %s\n", _parser.error());
+        return DOWNLOAD_FAILED;
+    }
     
-    return true;
+    Serial.printf("[HTTP] Manifest downloaded: %d bytes\n", totalRead);
+    logManifest();
+    return DOWNLOAD_COMPLETE;
 }
 
-int OTAUpdater::compareVersions(const String& currentVer, const String& newVer) {
-    int idx1 = currentVer.indexOf('-');
-    int idx2 = currentVer.indexOf('-', idx1 + 1);
-    int idx3 = newVer.indexOf('-');
-    int idx4 = newVer.indexOf('-', idx3 + 1);
-    
-    if (idx1 == -1 || idx2 == -1 || idx3 == -1 || idx4 == -1) {
-        return 0;
+void OTAUpdater::logManifest() {
+    Serial.printf("[Manifest] Version: %s\n", _manifest.version);
+    Serial.printf("[Manifest] Hash: %02x%02x%02x%02x...\n",
+                  _manifest.hash[0], _manifest.hash[1], _manifest.hash[2], _manifest.hash[3]);
+    if (_manifest.patchUrl[0]) {
+        Serial.printf("[Manifest] Delta base: %u bytes, patch %s\n", _manifest.baseSize, _manifest.patchUrl);
+    }
+    if (_manifest.compression[0]) {
+        Serial.printf("[Manifest] Compression: %s\n", _manifest.compression);
+    }
+}
+
+void OTAUpdater::evaluateManifest() {
+    // Authenticate the manifest before trusting any of its fields
+    monitorStartStage();
+    if (!verifyManifest(_manifest)) {
+        Serial.println("[OTA] Manifest rejected, no firmware will be downloaded");
+        finish();
+        return;
     }
+    monitorEndStage("verify_manifest");
+    _session.mark(MARK_MANIFEST);
     
-    String currentTS = currentVer.substring(idx1 + 1, idx2);
-    String newTS = newVer.substring(idx3 + 1, idx4);
+    Serial.printf("[OTA] Current version: %s\n", FIRMWARE_VERSION);
+    Serial.printf("[OTA] New version: %s\n", _manifest.version);
     
-    if (currentVer.endsWith("-local") && newVer.indexOf("-build") > 0) {
-        return 1;
+    int cmp = compareVersions(FIRMWARE_VERSION, _manifest.version);
+    if (cmp <= 0) {
+        Serial.println("[OTA] No update needed (current >= new)");
+        
+        // Remember the validators so the next poll can be answered with a 304
+        if (!_inlineManifest && (_http.etag()[0] || _http.lastModified()[0])) {
+            OTAManifestValidator validator;
+            memset(&validator, 0, sizeof(validator));
+            snprintf(validator.etag, sizeof(validator.etag), "%s", _http.etag());
+            snprintf(validator.lastModified, sizeof(validator.lastModified), "%s", _http.lastModified());
+            _manifestCache.save(validator);
+        }
+        finish();
+        return;
     }
     
-    int cmp = newTS.compareTo(currentTS);
-    if (cmp > 0) return 1;
-    if (cmp < 0) return -1;
-    return 0;
+    // The manifest connection stays open so the image GET can reuse it
+    Serial.println("[OTA] Update available! Starting OTA...");
+    startUpdate();
 }
 
-int OTAUpdater::hexStringToBytes(const String& hexStr, uint8_t* output, size_t maxLen) {
-    size_t hexLen = hexStr.length();
-    if (hexLen % 2 != 0) {
-        Serial.println("[HEX] Odd length hex string");
-        return -1;
-    }
-    
-    size_t byteLen = hexLen / 2;
-    if (byteLen > maxLen) {
-        Serial.printf("[HEX] Buffer too small: %d > %d\n", byteLen, maxLen);
-        return -1;
+int OTAUpdater::compareVersions(const char* currentVer, const char* newVer) {
+    // <git hash>-<YYYYMMDDTHHMM>-<build|local>; only the timestamps are compared
+    const char* cur1 = strchr(currentVer, '-');
+    const char* cur2 = cur1 ? strchr(cur1 + 1, '-') : nullptr;
+    const char* new1 = strchr(newVer, '-');
+    const char* new2 = new1 ? strchr(new1 + 1, '-') : nullptr;
+    
+    if (!cur2 || !new2) {
+        return 0;
     }
     
-    for (size_t i = 0; i < byteLen; i++) {
-        String byteStr = hexStr.substring(i * 2, i * 2 + 2);
-        output[i] = (uint8_t)strtol(byteStr.c_str(), NULL, 16);
+    size_t currentLen = strlen(currentVer);
+    if (currentLen >= 6 && strcmp(currentVer + currentLen - 6, "-local") == 0 && strstr(newVer + 1, "-build")) {
+        return 1;
     }
     
-    return byteLen;
+    size_t curTsLen = cur2 - cur1 - 1;
+    size_t newTsLen = new2 - new1 - 1;
+    int cmp = memcmp(new1 + 1, cur1 + 1, min(curTsLen, newTsLen));
+    if (cmp == 0) cmp = (int)newTsLen - (int)curTsLen;
+    if (cmp > 0) return 1;
+    if (cmp < 0) return -1;
+    return 0;
 }
 
 bool OTAUpdater::verifySignature(const uint8_t* hash, size_t hashLen, const uint8_t* signature, size_t sigLen) {
-    Serial.println("[OTA] Verifying ED25519 signature...");
+    const OTASignatureBackend& backend = otaSignatureBackend();
+    Serial.printf("[OTA] Verifying %s signature...\n", backend.name());
     
     if (sigLen != 64) {
-        Serial.printf("[OTA] Invalid signature length: %d (expected 64)\n", sigLen);
+        Serial.printf("[OTA] Invalid signature length: %u (expected 64)\n", (unsigned)sigLen);
         return false;
     }
     
     if (hashLen != 32) {
-        Serial.printf("[OTA] Invalid hash length: %d (expected 32)\n", hashLen);
+        Serial.printf("[OTA] Invalid hash length: %u (expected 32)\n", (unsigned)hashLen);
         return false;
     }
     
-    uint8_t publicKey[32];
-    String pubKeyHex = String(PUBLIC_KEY_HEX);
+    unsigned long start = otaMicros();
+    bool verified = backend.verify(hash, hashLen, signature);
+    unsigned long elapsed_us = otaMicros() - start;
+    
+    // Backends differ by an order of magnitude, so report them on their own
+    _metrics.push("verify_signature", elapsed_us).add("elapsed_us", elapsed_us);
     
-    if (pubKeyHex.length() != 64) {
-        Serial.printf("[OTA] Invalid public key length: %d (expected 64 hex chars)\n", pubKeyHex.length());
+    if (verified) {
+        Serial.printf("[OTA] ✓ %s signature verification PASSED\n", backend.name());
+        return true;
+    } else {
+        Serial.printf("[OTA] ✗ %s signature verification FAILED\n", backend.name());
         return false;
     }
-    
-    int keyLen = hexStringToBytes(pubKeyHex, publicKey, sizeof(publicKey));
-    if (keyLen != 32) {
-        Serial.println("[OTA] Failed to parse public key");
+}
+
+bool OTAUpdater::verifyManifest(const FirmwareManifest& manifest) {
+    uint8_t canonical[MANIFEST_CANONICAL_MAX];
+    size_t len = ManifestParser::canonicalize(manifest, canonical, sizeof(canonical));
+    if (len == 0) {
         return false;
     }
     
-    bool verified = Ed25519::verify(signature, publicKey, hash, hashLen);
+    uint8_t digest[32];
+    br_sha256_context ctx;
+    br_sha256_init(&ctx);
+    br_sha256_update(&ctx, canonical, len);
+    br_sha256_out(&ctx, digest);
     
-    if (verified) {
-        Serial.println("[OTA] ✓ ED25519 signature verification PASSED");
-        return true;
+    return verifySignature(digest, sizeof(digest), manifest.signature, sizeof(manifest.signature));
+}
+
+void OTAUpdater::startUpdate() {
+    Serial.println("[OTA] Starting single-pass firmware download, flash and verification...");
+    Serial.printf("[OTA] Free heap: %d bytes\n", otaFreeHeap());
+    _delta = false;
+    
+    // A patch against the running image is a fraction of the full download.
+    // The base can only be the running sketch, which starts at flash address 0
+    uint32_t sketchSpace = (otaSketchSize() + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+    if (!_manifest.patchUrl[0]) {
+        _step = STEP_FULL_START;
+    } else if (_manifest.baseSize == 0 || _manifest.baseSize > sketchSpace) {
+        Serial.printf("[DELTA] Base size %u does not match running sketch (%u)\n", _manifest.baseSize, otaSketchSize());
+        _step = STEP_FULL_START;
     } else {
-        Serial.println("[OTA] ✗ ED25519 signature verification FAILED");
-        return false;
+        br_sha256_init(&_sha);
+        _streamOffset = 0;
+        _step = STEP_BASE_CHECK;
     }
 }
 
-void OTAUpdater::performOTA(const String& expectedHashHex, const String& signatureHex) {
-    Serial.println("[OTA] Starting firmware download and verification...");
-    Serial.printf("[OTA] Free heap: %d bytes\n", ESP.getFreeHeap());
+OTAUpdater::DownloadResult OTAUpdater::checkBase() {
+    uint8_t buffer[OTA_DOWNLOAD_BUFFER];
+    unsigned long start = otaMillis();
+    while (_streamOffset < _manifest.baseSize) {
+        size_t len = min((size_t)sizeof(buffer), (size_t)(_manifest.baseSize - _streamOffset));
+        if (!otaFlashRead(_streamOffset, buffer, len)) {
+            return DOWNLOAD_FAILED;
+        }
+        br_sha256_update(&_sha, buffer, len);
+        _streamOffset += len;
+        if (otaMillis() - start >= OTA_TICK_BUDGET) {
+            return DOWNLOAD_PENDING;
+        }
+    }
     
-    monitorStartStage();
+    uint8_t runningHash[32];
+    br_sha256_out(&_sha, runningHash);
+    if (memcmp(runningHash, _manifest.baseHash, sizeof(runningHash)) != 0) {
+        Serial.println("[DELTA] Running image is not the patch base");
+        return DOWNLOAD_FAILED;
+    }
+    return DOWNLOAD_COMPLETE;
+}
+
+// Output side of the LZSS decoder: hash and flash the decompressed image
+bool OTAUpdater::inflateWrite(void* ctx, const uint8_t* data, size_t len) {
+    OTAUpdater* self = (OTAUpdater*)ctx;
+    
+    // The image size is only known once the stream header has been parsed.
+    // That header is not signed, so it has to agree with the manifest before
+    // the slot is erased for it.
+    if (!self->_writer.isRunning()) {
+        if (self->_lzss.originalSize() != self->_manifest.size) {
+            Serial.printf("[LZSS] Stream is for %u bytes, manifest says %u\n",
+                          self->_lzss.originalSize(), self->_manifest.size);
+            return false;
+        }
+        if (!self->_writer.begin(self->_lzss.originalSize())) {
+            return false;
+        }
+    }
+    br_sha256_update(&self->_sha, data, len);
+    return self->_writer.write(data, len);
+}
+
+// Output side of DeltaPatch, the same for the rebuilt image
+bool OTAUpdater::deltaWrite(void* ctx, const uint8_t* data, size_t len) {
+    OTAUpdater* self = (OTAUpdater*)ctx;
     
-    WiFiClient client;
-    HTTPClient http;
+    // The target size is only known once the patch header has been parsed
+    if (!self->_writer.isRunning() && !self->_writer.begin(self->_patch.targetSize())) {
+        return false;
+    }
+    br_sha256_update(&self->_sha, data, len);
+    return self->_writer.write(data, len);
+}
+
+bool OTAUpdater::requestDelta() {
+    resolveUrl(_manifest.patchUrl, _url, sizeof(_url));
+    
+    Serial.printf("[DELTA] Downloading patch: %s\n", _url);
+    int httpCode = openStream(0, "");
+    if (httpCode != 200) {
+        Serial.printf("[DELTA] Download failed: %d\n", httpCode);
+        _source->end();
+        return false;
+    }
     
-#if FIRMWARE_TLS == 1
-    WiFiClientSecure secureClient;
+    // Chunked patches run until the patch itself says it is done
+    int patchSize = _source->contentLength();
+    _streamOffset = 0;
+    _streamSize = patchSize >= 0 ? patchSize : UINT32_MAX;
+    _lastData = otaMillis();
+    br_sha256_init(&_sha);
+    _writer.abort();
+    _patch.reset();
+    _unreadArrival = 0;
+    _chunkStats.resume();
+    return true;
+}
+
+OTAUpdater::DownloadResult OTAUpdater::readDelta() {
+    uint8_t buffer[OTA_DOWNLOAD_BUFFER];
+    unsigned long start = otaMillis();
+    _minHeap = min(_minHeap, otaFreeHeap());
+    _streamTicks++;
+    
+    // A COPY is rebuilt from the base image without reading the patch, up
+    // to OTA_DELTA_COPY_SLICE bytes per tick
+    size_t copyBudget = OTA_DELTA_COPY_SLICE;
+    while (_source->connected() && !_patch.finished() && _streamOffset < _streamSize) {
+        if (otaMillis() - start >= OTA_TICK_BUDGET) {
+            return DOWNLOAD_PENDING;
+        }
+        
+        if (_patch.copying()) {
+            if (copyBudget == 0) return DOWNLOAD_PENDING;
+            uint32_t before = _patch.produced();
+            if (!_patch.pump(min(copyBudget, sizeof(buffer)))) {
+                Serial.printf("[DELTA] Patch rejected: %s\n", _patch.error());
+                break;
+            }
+            copyBudget -= _patch.produced() - before;
+            _lastData = otaMillis();  // busy, not stalled
+            continue;
+        }
+        
+        unsigned long waitStart = otaMicros();
+        size_t available = _source->available();
+        if (!available) {
+            // Nothing to read yet: erase the sectors coming up meanwhile
+            _writer.eraseAhead();
+            _streamWaitUs += otaMicros() - waitStart;
+            if (otaMillis() - _lastData > OTA_STALL_TIMEOUT) {
+                Serial.printf("[DELTA] No data for %d ms\n", OTA_STALL_TIMEOUT);
+                break;
+            }
+            return DOWNLOAD_PENDING;
+        }
+        
+        // Bytes that arrived together count as one chunk, however many
+        // reads they take
+        if (_unreadArrival == 0) {
+            _chunkStats.chunk(available, waitStart);
+            _unreadArrival = available;
+        }
+        
+        // Never past a COPY, so it is left for the slices above
+        int readLen = _source->read(buffer, min(min((size_t)sizeof(buffer), available), _patch.wanted()));
+        if (readLen > 0) {
+            if (!_patch.feed(buffer, readLen)) {
+                Serial.printf("[DELTA] Patch rejected: %s\n", _patch.error());
+                break;
+            }
+            // wanted() stops the read that completes the header right there,
+            // so nothing has been rebuilt yet from a patch for another base
+            if (_streamOffset < DELTA_HEADER_SIZE && _patch.headerParsed() &&
+                _patch.baseSize() != _manifest.baseSize) {
+                Serial.printf("[DELTA] Patch is for a %u byte base, manifest says %u\n",
+                              _patch.baseSize(), _manifest.baseSize);
+                break;
+            }
+            _streamOffset += readLen;
+            _lastData = otaMillis();
+            _unreadArrival -= min((uint32_t)readLen, _unreadArrival);
+        }
+    }
     
-    // Configure TLS buffer sizes
-    secureClient.setBufferSizes(512, 512);
+    _source->end();
     
-    // Use fingerprint verification
-    secureClient.setFingerprint(OTA_FINGERPRINT);
+    if (!_patch.finished() || _writer.written() != _patch.targetSize()) {
+        Serial.printf("[DELTA] Patch incomplete: %u bytes read, %u/%u rebuilt\n",
+                      _streamOffset, _patch.produced(), _patch.targetSize());
+        return DOWNLOAD_FAILED;
+    }
     
-    Serial.println("[HTTPS] TLS: Fingerprint verification");
-    Serial.printf("[HTTPS] Free heap: %d bytes\n", ESP.getFreeHeap());
+    Serial.printf("[DELTA] Rebuilt %u bytes from a %u byte patch\n", _patch.targetSize(), _streamOffset);
+    return DOWNLOAD_COMPLETE;
+}
+
+void OTAUpdater::fallBackToFull() {
+    Serial.println("[OTA] Delta update failed, falling back to full image");
+    _writer.abort();
+    _delta = false;
+    _step = STEP_FULL_START;
+}
+
+void OTAUpdater::startFullDownload() {
+    monitorStartStage();
+    br_sha256_init(&_sha);
+    _streamOffset = 0;
+    _streamSize = 0;
+    resetStreamStats();
+    
+    // Prefer the compressed artifact; hashing still covers the decompressed image
+    _lzss.reset();
+    _decoder = nullptr;
+    if (strcmp(_manifest.compression, "lzss") == 0 && _manifest.compressedUrl[0]) {
+        resolveUrl(_manifest.compressedUrl, _url, sizeof(_url));
+        _decoder = &_lzss;
+    } else {
+        resolveUrl(_manifest.url, _url, sizeof(_url));
+    }
     
-    if (!http.begin(secureClient, FIRMWARE_URL)) {
-        Serial.println("[HTTPS] ERROR: Failed to begin HTTPS connection");
-        return;
+    // Pick up where an interrupted download of the same image left off
+    OTAJournalRecord& journal = _journalRecord;
+    if (!_decoder && _journal.load(journal) &&
+        memcmp(journal.imageHash, _manifest.hash, sizeof(_manifest.hash)) == 0 &&
+        journal.imageSize == _manifest.size &&
+        journal.slotAddress == OTAFlashWriter::slotAddressFor(journal.imageSize) &&
+        _writer.begin(journal.imageSize, journal.offset)) {
+        br_sha256_set_state(&_sha, journal.shaState, journal.offset);
+        _streamOffset = journal.offset;
+        _streamSize = journal.imageSize;
+        Serial.printf("[OTA] Resuming download at %u/%u bytes\n", journal.offset, journal.imageSize);
+    } else {
+        _journal.clear();
+        memset(&journal, 0, sizeof(journal));
+        memcpy(journal.imageHash, _manifest.hash, sizeof(_manifest.hash));
     }
-#else
-    if (!http.begin(client, FIRMWARE_URL)) {
-        Serial.println("[HTTP] ERROR: Failed to begin connection");
+    
+    _attempt = 0;
+    _retryAt = otaMillis();
+    _step = STEP_FULL_REQUEST;
+}
+
+// Interrupted downloads reconnect after OTA_RESUME_BACKOFF without holding
+// up loop(); anything else, or running out of attempts, ends the update
+void OTAUpdater::retryDownload(DownloadResult result) {
+    if (result == DOWNLOAD_INTERRUPTED && ++_attempt < OTA_RESUME_ATTEMPTS) {
+        Serial.printf("[OTA] Reconnecting (%d/%d) to resume at %u bytes...\n",
+                      _attempt, OTA_RESUME_ATTEMPTS - 1, _streamOffset);
+        _retryAt = otaMillis() + OTA_RESUME_BACKOFF;
+        _step = STEP_FULL_REQUEST;
         return;
     }
-#endif
-
-    Serial.println("[OTA] Downloading firmware for verification...");
-    Serial.printf("[OTA] Free heap before download: %d bytes\n", ESP.getFreeHeap());
-    int httpCode = http.GET();
     
-    if (httpCode != HTTP_CODE_OK) {
-        Serial.printf("[OTA] Download failed: %s\n", http.errorToString(httpCode).c_str());
-        http.end();
+    _writer.abort();
+    if (result == DOWNLOAD_FAILED) {
+        _journal.clear();
+    }
+    Serial.println("[OTA] ERROR: Firmware download did not complete");
+    finish();
+}
+
+void OTAUpdater::resolveUrl(const char* ref, char* out, size_t outLen) {
+    if (strncmp(ref, "http://", 7) == 0 || strncmp(ref, "https://", 8) == 0 ||
+        strncmp(ref, "mqtt:", 5) == 0) {
+        snprintf(out, outLen, "%s", ref);
         return;
     }
     
-    int totalSize = http.getSize();
-    Serial.printf("[OTA] Firmware size: %d bytes\n", totalSize);
+    // Relative references live next to the firmware image
+    const char* base = FIRMWARE_URL;
+    const char* slash = strrchr(base, '/');
+    snprintf(out, outLen, "%.*s/%s", (int)(slash - base), base, ref);
+}
+
+// "mqtt:<file>" streams the file over the MQTT connection; the idle OTA
+// server connection is closed first so its TLS buffers are not held too
+int OTAUpdater::openStream(uint32_t offset, const char* headers) {
+    if (strncmp(_url, "mqtt:", 5) == 0) {
+        _http.close();
+        _source = &_mqtt;
+        return _mqtt.request(_url + 5, offset);
+    }
+    _source = &_http;
+    return _http.get(_url, headers);
+}
+
+OTAUpdater::DownloadResult OTAUpdater::requestFirmware() {
+    // Offsets are in transfer bytes; for compressed streams the decoder keeps
+    // its window in RAM, so a Range resume picks up mid-stream
+    uint32_t offset = _streamOffset;
+    
+    char headers[40] = "";
+    if (offset > 0) {
+        snprintf(headers, sizeof(headers), "Range: bytes=%u-\r\n", offset);
+    }
     
-    br_sha256_context sha256_ctx;
-    br_sha256_init(&sha256_ctx);
+    Serial.printf("[OTA] Requesting %s from byte %u...\n", _url, offset);
+    int httpCode = openStream(offset, headers);
     
-    WiFiClient* stream = http.getStreamPtr();
-    uint8_t buffer[OTA_DOWNLOAD_BUFFER];
-    int totalRead = 0;
-    int lastPercent = -1;
-    unsigned long lastMqttLoop = millis();
-    
-    File firmware = SPIFFS.open("/firmware.tmp", "w");
-    if (!firmware) {
-        Serial.println("[OTA] Failed to open temp file");
-        http.end();
-        return;
+    if (httpCode == 200) {
+        if (offset > 0) {
+            Serial.println("[OTA] Server ignored Range, restarting from byte 0");
+        }
+        
+        // The slot is sized from Content-Length, so chunked responses are rejected
+        int size = _source->contentLength();
+        if (size <= 0) {
+            Serial.println("[OTA] ERROR: Server did not send Content-Length");
+            _source->end();
+            return DOWNLOAD_FAILED;
+        }
+        
+        // The signed manifest already fixed the image size
+        if (!_decoder && (uint32_t)size != _manifest.size) {
+            Serial.printf("[OTA] ERROR: Image is %d bytes, manifest says %u\n", size, _manifest.size);
+            _source->end();
+            return DOWNLOAD_FAILED;
+        }
+        
+        _journal.clear();
+        br_sha256_init(&_sha);
+        _streamOffset = 0;
+        _streamSize = size;
+        
+        if (_decoder) {
+            // The writer starts once the decoder knows the decompressed size
+            _writer.abort();
+            _decoder->reset();
+        } else {
+            if (!_writer.begin(size)) {
+                _source->end();
+                return DOWNLOAD_FAILED;
+            }
+            _journalRecord.imageSize = size;
+            _journalRecord.slotAddress = _writer.slotAddress();
+        }
+        Serial.printf("[OTA] Transfer size: %d bytes\n", size);
+    } else if (httpCode == 206 && offset > 0) {
+        // Content-Range: bytes <first>-<last>/<total>; a chunk header carries
+        // the same offset and total
+        unsigned long first = 0, last = 0, total = 0;
+        bool range = false;
+        if (_source == &_mqtt) {
+            first = offset;
+            total = _mqtt.contentLength();
+            range = true;
+        } else {
+            range = sscanf(_http.contentRange(), "bytes %lu-%lu/%lu", &first, &last, &total) == 3;
+        }
+        if (!range || first != offset || total != _streamSize) {
+            Serial.printf("[OTA] Unexpected range %lu/%lu, restarting download\n", first, total);
+            _writer.abort();
+            _journal.clear();
+            _streamOffset = 0;
+            _source->end();
+            return DOWNLOAD_INTERRUPTED;
+        }
+        Serial.printf("[OTA] Resumed at %lu/%lu bytes\n", first, total);
+    } else {
+        Serial.printf("[OTA] Download failed: %d\n", httpCode);
+        _source->end();
+        return DOWNLOAD_INTERRUPTED;
     }
     
-    while (http.connected() && (totalRead < totalSize || totalSize == -1)) {
-        size_t available = stream->available();
-        if (available) {
-            int readLen = stream->readBytes(buffer, min((size_t)sizeof(buffer), available));
-            if (readLen > 0) {
-                firmware.write(buffer, readLen);
-                br_sha256_update(&sha256_ctx, buffer, readLen);
-                totalRead += readLen;
-                
-                int percent = (totalRead * 100) / totalSize;
-                if (percent != lastPercent && percent % 10 == 0) {
-                    Serial.printf("[OTA] Download: %d%% (%d/%d)\n", percent, totalRead, totalSize);
-                    lastPercent = percent;
-                }
+    // Zero-copy hashes and flashes straight from the network buffer
+    _zeroCopy = OTA_ZERO_COPY && _source->peekSupported();
+    _lastPercent = -1;
+    _lastData = otaMillis();
+    _lastCheckpoint = _writer.flushed();
+    _chunkStats.resume();
+    return DOWNLOAD_PENDING;
+}
+
+OTAUpdater::DownloadResult OTAUpdater::readFirmware() {
+    // The copy path reads into `buffer` first
+    uint8_t buffer[OTA_DOWNLOAD_BUFFER];
+    unsigned long start = otaMillis();
+    _minHeap = min(_minHeap, otaFreeHeap());
+    
+    while (_source->connected() && _streamOffset < _streamSize) {
+        if (otaMillis() - start >= OTA_TICK_BUDGET) {
+            return DOWNLOAD_PENDING;
+        }
+        
+        unsigned long waitStart = otaMicros();
+        const uint8_t* data = buffer;
+        size_t available = _zeroCopy ? _source->peek(data) : _source->available();
+        if (!available) {
+            // Nothing to read yet: erase the sectors coming up meanwhile, so
+            // the flush that needs them only has to write
+            _writer.eraseAhead();
+            _streamWaitUs += otaMicros() - waitStart;
+            if (otaMillis() - _lastData > OTA_STALL_TIMEOUT) {
+                Serial.printf("[OTA] No data for %d ms, dropping connection\n", OTA_STALL_TIMEOUT);
+                break;
             }
+            return DOWNLOAD_PENDING;
         }
         
-        // Keep MQTT alive during long download (every 1 second)
-        if (_mqttHandler && (millis() - lastMqttLoop > 1000)) {
-            _mqttHandler->loop();
-            lastMqttLoop = millis();
+        unsigned long cpuStart = otaMicros();
+        size_t toRead = _zeroCopy ? available : min((size_t)sizeof(buffer), available);
+        if (!_decoder) {
+            // Never straddle a sector boundary, so the hash state lines up with
+            // the flushed sectors whenever a checkpoint is due
+            toRead = min(toRead, (size_t)(FLASH_SECTOR_SIZE - _streamOffset % FLASH_SECTOR_SIZE));
         }
         
-        yield();
+        int readLen = _zeroCopy ? (int)toRead : _source->read(buffer, toRead);
+        if (readLen > 0) {
+            if (_decoder) {
+                if (!_decoder->feed(data, readLen)) {
+                    Serial.printf("[OTA] ERROR: Decompression failed: %s\n", _decoder->error());
+                    _source->end();
+                    return DOWNLOAD_FAILED;
+                }
+            } else {
+                // Hash exactly the bytes that go to flash
+                br_sha256_update(&_sha, data, readLen);
+                if (!_writer.write(data, readLen)) {
+                    Serial.println("[OTA] ERROR: Flash write failed");
+                    _source->end();
+                    return DOWNLOAD_FAILED;
+                }
+            }
+            if (_zeroCopy) {
+                _source->consume(readLen);
+            }
+            _streamOffset += readLen;
+            _streamBytes += readLen;
+            _lastData = otaMillis();
+            _chunkStats.chunk(readLen, cpuStart);
+            
+            // Compressed streams are not journaled: resuming them after a
+            // reset would also need the decoder window
+            if (!_decoder && _writer.written() == _writer.flushed() &&
+                _writer.flushed() - _lastCheckpoint >= OTA_JOURNAL_INTERVAL) {
+                _journalRecord.offset = _writer.flushed();
+                br_sha256_state(&_sha, _journalRecord.shaState);
+                _journal.save(_journalRecord);
+                _lastCheckpoint = _journalRecord.offset;
+            }
+            
+            int percent = (uint64_t)_streamOffset * 100 / _streamSize;
+            if (percent != _lastPercent && percent % 10 == 0) {
+                Serial.printf("[OTA] Download: %d%% (%u/%u)\n", percent, _streamOffset, _streamSize);
+                _lastPercent = percent;
+            }
+        }
+        _streamCpuUs += otaMicros() - cpuStart;
     }
     
-    firmware.close();
-    http.end();
+    _source->end();
     
-    Serial.printf("[OTA] Download complete: %d bytes\n", totalRead);
-    monitorEndStage("stream_firmware");
+    if (_streamOffset < _streamSize) {
+        Serial.printf("[OTA] Connection lost at %u/%u bytes\n", _streamOffset, _streamSize);
+        return DOWNLOAD_INTERRUPTED;
+    }
     
+    if (_decoder && (!_decoder->finished() || _writer.written() != _decoder->originalSize())) {
+        Serial.printf("[OTA] ERROR: Compressed stream ended early (%u/%u bytes)\n",
+                      _decoder->produced(), _decoder->originalSize());
+        return DOWNLOAD_FAILED;
+    }
+    return DOWNLOAD_COMPLETE;
+}
+
+bool OTAUpdater::verifyImage() {
     monitorStartStage();
     uint8_t calculatedHash[32];
-    br_sha256_out(&sha256_ctx, calculatedHash);
+    br_sha256_out(&_sha, calculatedHash);
     
     char hashHex[65];
+    char expectedHex[65];
     for (int i = 0; i < 32; i++) {
         sprintf(hashHex + (i * 2), "%02x", calculatedHash[i]);
+        sprintf(expectedHex + (i * 2), "%02x", _manifest.hash[i]);
     }
-    hashHex[64] = 0;
     
     Serial.printf("[OTA] Calculated hash: %s\n", hashHex);
-    Serial.printf("[OTA] Expected hash: %s\n", expectedHashHex.c_str());
-    
-    if (expectedHashHex != String(hashHex)) {
-        Serial.println("[OTA] ERROR: Hash mismatch!");
-        SPIFFS.remove("/firmware.tmp");
-        return;
+    Serial.printf("[OTA] Expected hash: %s\n", expectedHex);
+    
+    // The manifest signature covers hash and size, so a match is all the
+    // image needs. A mismatch means the journaled bytes are bad too.
+    if (_writer.written() != _manifest.size || memcmp(calculatedHash, _manifest.hash, 32) != 0) {
+        Serial.printf("[OTA] ERROR: Hash mismatch! (%u/%u bytes)\n", _writer.written(), _manifest.size);
+        _writer.abort();
+        _journal.clear();
+        return false;
     }
     
     Serial.println("[OTA] Hash verification passed!");
     monitorEndStage("verify_hash");
-    
+    _session.mark(MARK_VERIFY);
+    return true;
+}
+
+void OTAUpdater::commitImage() {
+    // Only a verified image gets the eboot copy command written
     monitorStartStage();
-    uint8_t signatureBytes[128];
-    int sigLen = hexStringToBytes(signatureHex, signatureBytes, sizeof(signatureBytes));
-    
-    if (sigLen < 0) {
-        Serial.println("[OTA] ERROR: Failed to parse signature");
-        SPIFFS.remove("/firmware.tmp");
+    _journal.clear();
+    if (!_writer.commit()) {
+        Serial.println("[OTA] ERROR: Failed to commit update");
+        _writer.abort();
+        if (_delta) {
+            fallBackToFull();
+        } else {
+            finish();
+        }
         return;
     }
+    monitorEndStage("flash_commit").add("session", _session.id());
+    _session.mark(MARK_COMMIT);
     
-    if (!verifySignature(calculatedHash, 32, signatureBytes, sigLen)) {
-        Serial.println("[OTA] ERROR: Signature verification failed!");
-        SPIFFS.remove("/firmware.tmp");
-        return;
+    Serial.println("[OTA] Update successful! Rebooting...");
+    flushMetrics();
+    if (_publisher) {
+        _publisher->flush(MQTT_FLUSH_TIMEOUT);
     }
     
-    Serial.println("[OTA] Signature verification passed!");
-    monitorEndStage("verify_signature");
-    
-    Serial.println("[OTA] Proceeding to flash...");
-    SPIFFS.remove("/firmware.tmp");
-    
-#if FIRMWARE_TLS == 1
-    WiFiClientSecure secureClient2;
-    
-    // Configure TLS buffer sizes
-    secureClient2.setBufferSizes(512, 512);
-    
-    // Use fingerprint verification for final flash
-    secureClient2.setFingerprint(OTA_FINGERPRINT);
-    
-    ESPhttpUpdate.setLedPin(LED_BUILTIN, LOW);
-    
-    ESPhttpUpdate.onStart([]() {
-        Serial.println("[OTA] Flash update started");
-    });
-    
-    ESPhttpUpdate.onEnd([]() {
-        Serial.println("\n[OTA] Flash update finished");
-        Serial.println("[OTA] Update successful! Rebooting...");
-        // Don't call monitorEndStage here - it causes WDT
-        delay(100);  // Short delay before auto-restart
-    });
-    
-    ESPhttpUpdate.onProgress([](int current, int total) {
-        static int lastPercent = -1;
-        int percent = (current * 100) / total;
-        if (percent != lastPercent && percent % 10 == 0) {
-            Serial.printf("[OTA] Flashing: %d%% (%d/%d)\n", percent, current, total);
-            lastPercent = percent;
-        }
-    });
-    
-    ESPhttpUpdate.onError([](int error) {
-        Serial.printf("[OTA] Flash error (%d): %s\n", error, ESPhttpUpdate.getLastErrorString().c_str());
-    });
-    
-    Serial.println("[OTA] Starting HTTPS update...");
-    Serial.printf("[OTA] Free heap: %d bytes\n", ESP.getFreeHeap());
-    
-    // ESPhttpUpdate.update() will auto-restart on success
-    ESPhttpUpdate.update(secureClient2, FIRMWARE_URL);
-    
-    // This code only runs if update failed (no restart)
-    Serial.println("[OTA] Update did not complete (no restart occurred)");
-#else
-    ESPhttpUpdate.setLedPin(LED_BUILTIN, LOW);
-    
-    ESPhttpUpdate.onStart([]() {
-        Serial.println("[OTA] Update started");
-    });
-    
-    ESPhttpUpdate.onEnd([]() {
-        Serial.println("\n[OTA] Update finished");
-        Serial.println("[OTA] Update successful! Rebooting...");
-        // Don't call monitorEndStage here - it causes WDT
-        delay(100);  // Short delay before auto-restart
-    });
-    
-    ESPhttpUpdate.onProgress([](int current, int total) {
-        static int lastPercent = -1;
-        int percent = (current * 100) / total;
-        if (percent != lastPercent && percent % 10 == 0) {
-            Serial.printf("[OTA] Progress: %d%% (%d/%d)\n", percent, current, total);
-            lastPercent = percent;
-        }
-    });
-    
-    ESPhttpUpdate.onError([](int error) {
-        Serial.printf("[OTA] Error (%d): %s\n", error, ESPhttpUpdate.getLastErrorString().c_str());
-    });
-    
-    Serial.println("[OTA] Starting HTTP update...");
-    
-    // ESPhttpUpdate.update() will auto-restart on success
-    ESPhttpUpdate.update(client, FIRMWARE_URL);
-    
-    // This code only runs if update failed (no restart)
-    Serial.println("[OTA] Update did not complete (no restart occurred)");
-#endif
+    // The new image reports the rest of the timeline once it is back online
+    _session.mark(MARK_RESTART);
+    _session.save(_manifest.version);
+    otaRestart();
+}
+
+void OTAUpdater::resetStreamStats() {
+    _streamBytes = 0;
+    _streamCpuUs = 0;
+    _streamWaitUs = 0;
+    _minHeap = otaFreeHeap();
+    _streamTicks = 0;
+    _writer.resetStats();
+    _mqtt.resetStats();
+    _chunkStats.begin();
+}
+
+// Where the stage time went: erase_ahead_ms is the part of erase_ms hidden in
+// wait_ms, so erase_ms - erase_ahead_ms is what erases still added on top
+void OTAUpdater::addFlashStats(OTAStageRecord& record) {
+    record.add("erase_ms", _writer.eraseUs() / 1000)
+          .add("erase_ahead_ms", _writer.eraseAheadUs() / 1000)
+          .add("write_ms", _writer.writeUs() / 1000)
+          .add("wait_ms", _streamWaitUs / 1000)
+          .add("sectors_erased", _writer.sectorsErased())
+          .add("sectors_erased_ahead", _writer.sectorsErasedAhead());
+}
+
+// Which connection carried the body, and the heap low point while it did,
+// to compare the MQTT transfer with a second TLS connection
+void OTAUpdater::addTransportStats(OTAStageRecord& record) {
+    record.add("transport", _source == &_mqtt ? "mqtt" : "http")
+          .add("min_free_heap", _minHeap);
+    if (_source == &_mqtt) {
+        record.add("mqtt_gaps", _mqtt.gaps())
+              .add("mqtt_rerequests", _mqtt.rerequests());
+    }
+}
+
+// A record of its own right after the stream stage, which has no room left
+// for another 17 fields
+void OTAUpdater::addChunkStats(const OTAStageRecord& streamRecord) {
+    _chunkStats.addTo(_metrics.push("stream_chunks", streamRecord.elapsedUs), otaRssi());
+}
+
+// Small enough to publish mid-download; rssi next to bps shows whether a
+// slow stretch was the radio
+void OTAUpdater::publishProgress() {
+    _lastProgress = otaMillis();
+    if (!_publisher) return;
+    
+    char payload[160];
+    snprintf(payload, sizeof(payload),
+             "{\"percent\":%u,\"bytes\":%u,\"bps\":%u,\"peak_bps\":%u,\"stalls\":%u,\"rssi\":%d,\"version\":\"%s\"}",
+             progress(), (unsigned)_streamOffset, (unsigned)_chunkStats.bytesPerSec(otaMicros()),
+             (unsigned)_chunkStats.peakBytesPerSec(), (unsigned)_chunkStats.stalls(), otaRssi(), FIRMWARE_VERSION);
+    _publisher->publish(MQTT_TOPIC_PROGRESS, payload);
 }
 
 void OTAUpdater::monitorStartStage() {
-    _stageStartTime = micros();
+    _stageStartTime = otaMicros();
+    _http.resetStats();
 }
 
-void OTAUpdater::monitorEndStage(const char* stageName) {
-    if (!_mqttHandler) return;
-    
-    // Feed watchdog
-    yield();
-    
-    // Calculate elapsed time
-    unsigned long elapsed_us = micros() - _stageStartTime;
-    unsigned long elapsed_ms = elapsed_us / 1000;
-    
-    // Get heap info (ESP8266 specific)
-    uint32_t free_heap = ESP.getFreeHeap();
-    uint32_t max_free_block = ESP.getMaxFreeBlockSize();
-    uint8_t heap_fragmentation = ESP.getHeapFragmentation();
-    
-    // Get current time
-    time_t now = time(nullptr);
-    struct tm timeinfo;
-    localtime_r(&now, &timeinfo);
-    
-    // Create ISO 8601 timestamp
-    char timestamp[64];
-    snprintf(timestamp, sizeof(timestamp), "%04d-%02d-%02dT%02d:%02d:%02d",
-             timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday,
-             timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
-    
-    // Create metrics JSON with extended heap info
-    char msg[384];
-    snprintf(msg, sizeof(msg),
-             "{\"stage\":\"%s\",\"elapsed_ms\":%lu,\"free_heap\":%u,\"max_block\":%u,\"fragmentation\":%u,\"algorithm\":\"%s\",\"version\":\"%s\",\"timestamp\":\"%s\"}",
-             stageName, elapsed_ms, free_heap, max_free_block, heap_fragmentation, FIRMWARE_ALGORITHM, FIRMWARE_VERSION, timestamp);
-    
-    Serial.printf("[%s] Stage %s: %lu ms, heap=%u, max_block=%u, frag=%u%%\n", 
-                  timestamp, stageName, elapsed_ms, free_heap, max_free_block, heap_fragmentation);
-    
-    // Keep MQTT connection alive
-    _mqttHandler->loop();
-    
-    // Publish to MQTT (with reconnect handling inside publish())
-    _mqttHandler->publish("ota/metrics", msg);
-    
-    // Keep MQTT connection alive after publish
-    _mqttHandler->loop();
-    
-    // Feed watchdog
-    yield();
+OTAStageRecord& OTAUpdater::monitorEndStage(const char* stageName) {
+    OTAStageRecord& record = _metrics.push(stageName, otaMicros() - _stageStartTime);
+    
+    // Stages that made requests report how the connection was set up
+    if (_http.connections() + _http.reused() > 0) {
+        record.add("handshake", OTAHttpClient::handshakeName(_http.lastHandshake()))
+              .add("connect_ms", _http.connectMs())
+              .add("connections", _http.connections())
+              .add("reused", _http.reused());
+    }
+    return record;
+}
+
+// Publishing can block on MQTT retries, so it happens between steps rather
+// than inside a timed stage
+void OTAUpdater::flushMetrics() {
+    _metrics.flush(_publisher, MQTT_TOPIC_METRICS);
+    _lastFlush = otaMillis();
 }
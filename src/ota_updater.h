@@ -2,29 +2,166 @@
 #define OTA_UPDATER_H
 
 #include <Arduino.h>
+#include <bearssl/bearssl_hash.h>
+#include "ota_flash_writer.h"
+#include "ota_journal.h"
+#include "ota_http_client.h"
+#include "ota_mqtt_transfer.h"
+#include "ota_manifest_cache.h"
+#include "ota_metrics.h"
+#include "ota_download_stats.h"
+#include "ota_session.h"
+#include "manifest_parser.h"
+#include "lzss_decoder.h"
+#include "delta_patch.h"
+#include "ota_platform.h"
 
-class MQTTHandler;
-
+// Runs an update as a state machine: checkForUpdates() only starts it, and
+// every tick() from loop() does a bounded step of it (about OTA_TICK_BUDGET ms
+// of reading, hashing and flashing), so the application keeps running while
+// the image streams in. Connection setup, the signature check and the final
+// commit are single steps and still block for their own duration.
 class OTAUpdater {
 public:
+    enum State {
+        STATE_IDLE,
+        STATE_MANIFEST,     // fetching and authenticating the manifest
+        STATE_DOWNLOAD,     // streaming the image or patch into the OTA slot
+        STATE_VERIFY,       // checking the image hash against the manifest
+        STATE_FLASH         // committing the image, then restart
+    };
+    
     OTAUpdater();
-    void setMQTTHandler(MQTTHandler* mqtt);
-    void checkForUpdates();
+    void setPublisher(OTAPublisher* publisher);  // receives ota/metrics
+    void checkForUpdates();  // starts a check unless an update is running
+    void checkManifest(const uint8_t* data, size_t len);  // same, with manifest.json already at hand
+    void tick();  // advances the update and the periodic check, call from loop()
+    
+    State state() const;
+    bool busy() const { return _step != STEP_IDLE; }
+    uint8_t progress() const;  // download percent, 100 once the image is complete
+    void flushMetrics();  // publishes the queued ota/metrics records now
+    static const char* stateName(State state);
     
+    // Boot timeline: beginBoot() first thing in setup(), then bootPhase() as
+    // each phase completes and bootReady() once the device is up. bootReady()
+    // publishes boot_timeline, and update_timeline when an update restarted
+    // into this image.
+    void beginBoot();
+    void bootPhase(OTABootPhase phase, const char* via = nullptr);
+    bool bootReached(OTABootPhase phase) const { return _session.reached(phase); }
+    void bootReady();
+    
+    // Receives MQTT_TOPIC_FW_CHUNK messages for "mqtt:" downloads
+    OTAMqttTransfer& mqttTransfer() { return _mqtt; }
+
+#if FIRMWARE_TLS == 1
+    // Shared with the MQTT client so every TLS connection can resume
+    TLSSessionCache& sessionCache() { return _sessions; }
+#endif
+
 private:
-    MQTTHandler* _mqttHandler;
+    enum Step {
+        STEP_IDLE,
+        STEP_MANIFEST_REQUEST,
+        STEP_MANIFEST_BODY,
+        STEP_MANIFEST_VERIFY,
+        STEP_BASE_CHECK,        // hashing the running sketch, is it the patch base?
+        STEP_DELTA_REQUEST,
+        STEP_DELTA_BODY,
+        STEP_FULL_START,
+        STEP_FULL_REQUEST,      // (re)connect once _retryAt has passed
+        STEP_FULL_BODY,
+        STEP_VERIFY,
+        STEP_FLASH
+    };
+    
+    enum DownloadResult {
+        DOWNLOAD_PENDING,       // tick budget used up or no data yet, call again
+        DOWNLOAD_COMPLETE,
+        DOWNLOAD_INTERRUPTED,   // connection lost, retry with Range from written()
+        DOWNLOAD_FAILED         // flash or protocol error, start over next time
+    };
+    
+    OTAPublisher* _publisher;
     unsigned long _stageStartTime;
+    OTAFlashWriter _writer;
+    OTAJournal _journal;
+    OTAManifestCache _manifestCache;
+    FirmwareManifest _manifest;
+    ManifestParser _parser;
+    OTAHttpClient _http;
+    OTAMqttTransfer _mqtt;
+    OTAStream* _source;       // the download's body: &_http, or &_mqtt for "mqtt:" URLs
+#if FIRMWARE_TLS == 1
+    TLSSessionCache _sessions;
+#endif
+    Step _step;
+    br_sha256_context _sha;   // image hash, or the running sketch's during STEP_BASE_CHECK
+    LzssDecoder _lzss;
+    LzssDecoder* _decoder;    // &_lzss for a compressed download
+    DeltaPatch _patch;
+    bool _delta;              // the image in the slot was rebuilt from a patch
+    OTAJournalRecord _journalRecord;
+    char _url[192];
+    uint8_t _attempt;
+    unsigned long _retryAt;
+    unsigned long _lastData;
+    uint32_t _lastCheckpoint;
+    int _lastPercent;
+    uint32_t _streamOffset;   // transfer bytes received for the current download
+    uint32_t _streamSize;     // Content-Length of the full transfer
+    uint32_t _streamBytes;    // bytes received in this stage, over all attempts
+    unsigned long _streamCpuUs;  // time spent hashing/flashing them, network waits excluded
+    unsigned long _streamWaitUs; // tick time with no data to read, erase-ahead included
+    uint32_t _minHeap;        // lowest free heap seen while streaming
+    uint32_t _streamTicks;    // tick() calls the stream took
+    uint32_t _unreadArrival;  // patch bytes of the last arrival not read yet
+    bool _zeroCopy;           // last attempt read through peekBuffer()
+    bool _inlineManifest;     // manifest came with the MQTT trigger, not over HTTP
+    OTADownloadStats _chunkStats;
+    OTASession _session;
+    OTAMetricsRing _metrics;
+    unsigned long _lastFlush;
+    unsigned long _lastProgress;
+    unsigned long _lastCheck;
+    unsigned long _nextCheckDelay;
     
-    bool downloadManifest(String& manifestData);
-    bool parseManifest(const String& manifestData, String& version, String& hash, String& signature);
-    int compareVersions(const String& currentVer, const String& newVer);
-    int hexStringToBytes(const String& hexStr, uint8_t* output, size_t maxLen);
+    void runStep();
+    void finish();
+    bool beginCheck();
+    void startManifest();
+    DownloadResult readManifest();
+    void logManifest();
+    void evaluateManifest();
+    int compareVersions(const char* currentVer, const char* newVer);
     bool verifySignature(const uint8_t* hash, size_t hashLen, const uint8_t* signature, size_t sigLen);
-    void performOTA(const String& expectedHashHex, const String& signatureHex);
+    bool verifyManifest(const FirmwareManifest& manifest);
+    void startUpdate();
+    DownloadResult checkBase();
+    void resolveUrl(const char* ref, char* out, size_t outLen);
+    int openStream(uint32_t offset, const char* headers);
+    bool requestDelta();
+    DownloadResult readDelta();
+    void fallBackToFull();
+    void startFullDownload();
+    DownloadResult requestFirmware();
+    DownloadResult readFirmware();
+    void retryDownload(DownloadResult result);
+    bool verifyImage();
+    void commitImage();
+    
+    static bool inflateWrite(void* ctx, const uint8_t* data, size_t len);
+    static bool deltaWrite(void* ctx, const uint8_t* data, size_t len);
     
     // Monitoring functions
     void monitorStartStage();
-    void monitorEndStage(const char* stageName);
+    OTAStageRecord& monitorEndStage(const char* stageName);
+    void resetStreamStats();
+    void addFlashStats(OTAStageRecord& record);
+    void addChunkStats(const OTAStageRecord& streamRecord);
+    void addTransportStats(OTAStageRecord& record);
+    void publishProgress();
 };
 
 #endif // OTA_UPDATER_H
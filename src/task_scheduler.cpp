@@ -0,0 +1,113 @@
+#include "task_scheduler.h"
+#include "ota_platform.h"
+
+#define PERIOD_MAX_US (30UL * 60 * 1000000)
+
+// Deadlines are compared as a signed difference, so they survive the us
+// counter wrapping every 71 minutes
+static bool reached(uint32_t now, uint32_t deadline) {
+    return (int32_t)(now - deadline) >= 0;
+}
+
+TaskScheduler::TaskScheduler() : _count(0), _sleptUs(0) {
+}
+
+int TaskScheduler::add(const char* name, TaskFunction fn, uint32_t periodMs, TaskReady ready) {
+    if (!fn || (uint64_t)periodMs * 1000 >= PERIOD_MAX_US) {
+        Serial.printf("[SCHED] Invalid task '%s'\n", name ? name : "");
+        return -1;
+    }
+    if (_count == SCHEDULER_TASKS_MAX) {
+        Serial.printf("[SCHED] Task table full, '%s' not added\n", name);
+        return -1;
+    }
+    
+    Task& task = _tasks[_count];
+    memset(&task, 0, sizeof(task));
+    task.name = name;
+    task.fn = fn;
+    task.ready = ready;
+    task.periodUs = periodMs * 1000;
+    task.dueUs = otaMicros();  // the first pass runs every periodic task
+    return _count++;
+}
+
+void TaskScheduler::wake(int id) {
+    if (id < 0 || id >= _count) return;
+    Task& task = _tasks[id];
+    if (!task.woken) {
+        task.wokenUs = otaMicros();
+        task.woken = true;
+    }
+}
+
+void TaskScheduler::resetStats() {
+    for (uint8_t i = 0; i < _count; i++) {
+        memset(&_tasks[i].stats, 0, sizeof(TaskStats));
+    }
+    _sleptUs = 0;
+}
+
+void TaskScheduler::run() {
+    for (uint8_t i = 0; i < _count; i++) {
+        Task& task = _tasks[i];
+        uint32_t now = otaMicros();
+        bool timer = task.periodUs && reached(now, task.dueUs);
+        bool woken = task.woken;
+        if (!timer && !woken && !(task.ready && task.ready())) continue;
+        
+        // How late the earlier of the deadline and the wake-up was served
+        uint32_t lateUs = 0;
+        bool counted = timer || woken;
+        if (timer) lateUs = now - task.dueUs;
+        if (woken && (!timer || now - task.wokenUs > lateUs)) lateUs = now - task.wokenUs;
+        
+        // Cleared first, so a wake() from inside the task runs it again
+        task.woken = false;
+        if (timer) {
+            // Fixed rate, but a task that fell a whole period behind skips
+            // the missed runs instead of running back to back
+            task.dueUs += task.periodUs;
+            if (reached(now, task.dueUs)) task.dueUs = now + task.periodUs;
+        }
+        
+        task.fn();
+        uint32_t runUs = otaMicros() - now;
+        
+        TaskStats& stats = task.stats;
+        stats.runs++;
+        stats.runTotalUs += runUs;
+        if (runUs > stats.runMaxUs) stats.runMaxUs = runUs;
+        if (counted) {
+            stats.lateRuns++;
+            stats.lateTotalUs += lateUs;
+            if (lateUs > stats.lateMaxUs) stats.lateMaxUs = lateUs;
+        }
+    }
+    
+    sleep();
+}
+
+bool TaskScheduler::pending() const {
+    for (uint8_t i = 0; i < _count; i++) {
+        const Task& task = _tasks[i];
+        if (task.woken || (task.ready && task.ready())) return true;
+    }
+    return false;
+}
+
+// Until the earliest deadline, in slices so an event is noticed within
+// SCHEDULER_IDLE_SLICE ms. otaDelay() hands the time to the WiFi stack.
+void TaskScheduler::sleep() {
+    uint32_t start = otaMicros();
+    while (!pending()) {
+        uint32_t now = otaMicros();
+        bool due = false;
+        for (uint8_t i = 0; i < _count && !due; i++) {
+            due = _tasks[i].periodUs && reached(now, _tasks[i].dueUs);
+        }
+        if (due) break;
+        otaDelay(SCHEDULER_IDLE_SLICE);
+    }
+    _sleptUs += otaMicros() - start;
+}
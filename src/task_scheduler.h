@@ -0,0 +1,71 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+typedef void (*TaskFunction)();
+
+// Polled while the scheduler sleeps: true when the task has work right now
+// (bytes waiting on a socket, an update running)
+typedef bool (*TaskReady)();
+
+// Run time and scheduling lateness of one task, in us. Lateness is how long
+// after its deadline (timer runs) or its wake() (event runs) the task
+// started; runs because ready() turned true are not counted there.
+struct TaskStats {
+    uint32_t runs;
+    uint32_t runTotalUs;
+    uint32_t runMaxUs;
+    uint32_t lateRuns;
+    uint32_t lateTotalUs;
+    uint32_t lateMaxUs;
+};
+
+// Cooperative scheduler for loop(): every run() pass starts the tasks that
+// are due, woken or ready, in registration order, then sleeps until the
+// earliest deadline. The sleep is cut short as soon as a task is woken or
+// reports ready, checked every SCHEDULER_IDLE_SLICE ms.
+class TaskScheduler {
+public:
+    TaskScheduler();
+    
+    // `name` is not copied, so it must be a literal. A task with periodMs 0
+    // only runs when woken or ready. Periods are kept in us, so they must stay
+    // below 30 minutes. Returns the task id, -1 when the table
+    // (SCHEDULER_TASKS_MAX) is full.
+    int add(const char* name, TaskFunction fn, uint32_t periodMs, TaskReady ready = nullptr);
+    
+    // Runs the task on the next pass; safe from MQTT route handlers and
+    // other callbacks
+    void wake(int id);
+    
+    void run();
+    
+    uint8_t count() const { return _count; }
+    const char* name(uint8_t id) const { return _tasks[id].name; }
+    const TaskStats& stats(uint8_t id) const { return _tasks[id].stats; }
+    uint32_t sleptMs() const { return _sleptUs / 1000; }
+    void resetStats();
+
+private:
+    struct Task {
+        const char* name;
+        TaskFunction fn;
+        TaskReady ready;
+        uint32_t periodUs;
+        uint32_t dueUs;
+        uint32_t wokenUs;
+        volatile bool woken;
+        TaskStats stats;
+    };
+    
+    bool pending() const;
+    void sleep();
+    
+    Task _tasks[SCHEDULER_TASKS_MAX];
+    uint8_t _count;
+    uint64_t _sleptUs;
+};
+
+#endif // TASK_SCHEDULER_H
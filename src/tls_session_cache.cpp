@@ -0,0 +1,56 @@
+#include "tls_session_cache.h"
+#include <type_traits>
+
+TLSSessionCache::TLSSessionCache() : _uses(0) {
+    for (size_t i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+        _entries[i].host[0] = 0;
+        _entries[i].port = 0;
+        _entries[i].lastUse = 0;
+    }
+}
+
+BearSSL::Session* TLSSessionCache::get(const char* host, uint16_t port) {
+    Entry* victim = &_entries[0];
+    
+    for (size_t i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+        Entry& e = _entries[i];
+        if (e.port == port && strcmp(e.host, host) == 0) {
+            e.lastUse = ++_uses;
+            return &e.session;
+        }
+        // A use count instead of millis(), which wraps after 49 days
+        if (e.lastUse < victim->lastUse) {
+            victim = &e;
+        }
+    }
+    
+    // Least recently used slot gets the new host with an empty session
+    snprintf(victim->host, sizeof(victim->host), "%s", host);
+    victim->port = port;
+    victim->lastUse = ++_uses;
+    victim->session = BearSSL::Session();
+    return &victim->session;
+}
+
+// BearSSL::Session holds nothing but the br_ssl_session_parameters that
+// WiFiClientSecure fills in, and keeps its accessor private; the parameters
+// are read through that layout, checked here at compile time
+static_assert(sizeof(BearSSL::Session) == sizeof(br_ssl_session_parameters) &&
+              std::is_standard_layout<BearSSL::Session>::value, "BearSSL::Session layout changed");
+
+const br_ssl_session_parameters& TLSSessionCache::parameters(const BearSSL::Session& session) {
+    return *reinterpret_cast<const br_ssl_session_parameters*>(&session);
+}
+
+TLSSessionCache::Offer TLSSessionCache::offer(const BearSSL::Session& session) {
+    const br_ssl_session_parameters& params = parameters(session);
+    Offer offer;
+    offer.len = min((size_t)params.session_id_len, sizeof(offer.id));
+    memcpy(offer.id, params.session_id, offer.len);
+    return offer;
+}
+
+bool TLSSessionCache::resumed(const Offer& offer, const BearSSL::Session& after) {
+    const br_ssl_session_parameters& params = parameters(after);
+    return offer.len > 0 && params.session_id_len == offer.len && memcmp(params.session_id, offer.id, offer.len) == 0;
+}
@@ -0,0 +1,45 @@
+#ifndef TLS_SESSION_CACHE_H
+#define TLS_SESSION_CACHE_H
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include <bearssl/bearssl_ssl.h>
+#include "config.h"
+
+// BearSSL session parameters per host:port. A WiFiClientSecure given one of
+// these sessions offers its ID to the server and skips the full handshake
+// when the server still knows it.
+class TLSSessionCache {
+public:
+    TLSSessionCache();
+    
+    BearSSL::Session* get(const char* host, uint16_t port);
+    
+    // The session ID a client given `session` offers, taken before
+    // connect(); empty while the session never completed a handshake
+    struct Offer {
+        uint8_t id[32];
+        uint8_t len;
+    };
+    
+    static Offer offer(const BearSSL::Session& session);
+    
+    // A server that resumes echoes the offered ID, a full handshake gets a
+    // new one
+    static bool resumed(const Offer& offer, const BearSSL::Session& after);
+
+private:
+    struct Entry {
+        char host[48];
+        uint16_t port;
+        uint32_t lastUse;   // _uses at the last get(), 0 for a free slot
+        BearSSL::Session session;
+    };
+    
+    Entry _entries[TLS_SESSION_CACHE_SIZE];
+    uint32_t _uses;
+    
+    static const br_ssl_session_parameters& parameters(const BearSSL::Session& session);
+};
+
+#endif // TLS_SESSION_CACHE_H
@@ -1,33 +1,217 @@
 #include "wifi_manager.h"
 #include "config.h"
-#include <ESP8266WiFi.h>
+#include "ota_platform.h"
+#include "ota_clock.h"
+#include <time.h>
+#include <lwip/netif.h>
+#include <lwip/dhcp.h>
+
+#define WIFI_FAST_MAGIC 0x57464332  // "WFC2"
+
+static_assert(sizeof(WiFiFastRecord) <= otaRetainedLayout[RETAINED_WIFI].size, "WiFi record does not fit its RTC region");
 
 WiFiManager::WiFiManager() {
     _ssid = WIFI_SSID;
     _password = WIFI_PASSWORD;
     _timeout = WIFI_CONNECT_TIMEOUT;
+    _attempt = ATTEMPT_NONE;
+    _beginMs = 0;
+    _attemptMs = 0;
+    _timedOut = false;
+    _connectMs = 0;
+    _fast = false;
+    _static = false;
+    _renewing = false;
+    _lease = 0;
+    _obtained = 0;
+    _leaseMs = 0;
+    _gotIP = false;
+    _disconnected = false;
 }
 
-bool WiFiManager::connect() {
-    Serial.printf("Connecting to WiFi: %s ", _ssid);
+void WiFiManager::begin() {
+    _beginMs = millis();
+    Serial.printf("[WIFI] Connecting to %s\n", _ssid);
+    
+    // The record in RTC memory replaces the SDK's own flash copy, which would
+    // otherwise be rewritten on every begin()
+    WiFi.persistent(false);
     WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(true);
+    
+    // loop() only looks at these flags instead of polling the connection
+    _onGotIP = WiFi.onStationModeGotIP([this](const WiFiEventStationModeGotIP&) {
+        _gotIP = true;
+    });
+    _onDisconnected = WiFi.onStationModeDisconnected([this](const WiFiEventStationModeDisconnected&) {
+        _disconnected = true;
+    });
+    
+    WiFiFastRecord cached;
+    if (loadRecord(cached)) {
+        startFast(cached);
+    } else {
+        startScan();
+    }
+}
+
+// Joins the cached access point on its channel without scanning, and with
+// WIFI_FAST_STATIC_IP also reuses the cached lease instead of asking DHCP
+void WiFiManager::startFast(const WiFiFastRecord& cached) {
+    Serial.printf("[WIFI] Fast connect to %02x:%02x:%02x:%02x:%02x:%02x on channel %u\n",
+                  cached.bssid[0], cached.bssid[1], cached.bssid[2],
+                  cached.bssid[3], cached.bssid[4], cached.bssid[5], cached.channel);
+#if WIFI_FAST_STATIC_IP == 1
+    _static = leaseValid(cached.lease, cached.obtained);
+    if (_static) {
+        WiFi.config(IPAddress(cached.ip), IPAddress(cached.gateway), IPAddress(cached.subnet),
+                    IPAddress(cached.dns));
+        // The address is still the one DHCP granted then, not a new lease
+        _lease = cached.lease;
+        _obtained = cached.obtained;
+    } else {
+        Serial.println("[WIFI] Cached lease due for renewal, asking DHCP");
+    }
+#endif
+
+    _attempt = ATTEMPT_FAST;
+    _attemptMs = millis();
+    _gotIP = false;
+    _disconnected = false;
+    WiFi.begin(_ssid, _password, cached.channel, cached.bssid, true);
+}
+
+void WiFiManager::startScan() {
+    _attempt = ATTEMPT_SCAN;
+    _attemptMs = millis();
+    _gotIP = false;
+    _disconnected = false;
     WiFi.begin(_ssid, _password);
+}
+
+void WiFiManager::loop() {
+    if (_attempt == ATTEMPT_DONE) {
+        loopLease();
+        return;
+    }
+    if (_attempt == ATTEMPT_NONE) return;
     
-    int retries = 0;
-    while (WiFi.status() != WL_CONNECTED && retries < _timeout) {
-        delay(500);
-        Serial.print(".");
-        retries++;
+    if (_gotIP && WiFi.status() == WL_CONNECTED) {
+        finish();
+        return;
     }
     
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.println(" Connected!");
-        Serial.printf("IP Address: %s\n", WiFi.localIP().toString().c_str());
-        return true;
-    } else {
-        Serial.println(" Failed!");
-        return false;
+    unsigned long elapsed = millis() - _attemptMs;
+    if (_attempt == ATTEMPT_FAST && (_disconnected || elapsed >= WIFI_FAST_CONNECT_TIMEOUT)) {
+        // The access point moved, changed channel or is gone: forget it
+        Serial.println("[WIFI] Fast connect failed, scanning");
+        clearRecord();
+        WiFi.disconnect();
+        if (_static) {
+            WiFi.config(0u, 0u, 0u);  // back to DHCP
+            _static = false;
+        }
+        startScan();
+    } else if (_attempt == ATTEMPT_SCAN && !_timedOut && elapsed >= (unsigned long)_timeout * 1000) {
+        // The SDK keeps retrying on its own, so this is only reported
+        _timedOut = true;
+        Serial.printf("[WIFI] Not connected after %d s, still trying\n", _timeout);
+    }
+}
+
+void WiFiManager::loopLease() {
+    // A static address is given up once its lease is due, before the DHCP
+    // server hands it to another host
+    if (_static && !leaseValid(_lease, _obtained)) {
+        Serial.println("[WIFI] Cached lease due for renewal, asking DHCP");
+        _static = false;
+        _renewing = true;
+        _gotIP = false;
+        WiFi.config(0u, 0u, 0u);
     }
+    if (_renewing && _gotIP && WiFi.status() == WL_CONNECTED) {
+        _renewing = false;
+        takeLease();
+        saveRecord();
+        Serial.printf("[WIFI] DHCP lease %u s, IP %s\n", _lease, WiFi.localIP().toString().c_str());
+    }
+    
+    // A lease granted before the clock was set gets its date once it is
+    if (_lease != 0 && _obtained == 0 && otaClockValid()) {
+        _obtained = (uint32_t)time(nullptr) - (millis() - _leaseMs) / 1000;
+        saveRecord();
+    }
+}
+
+void WiFiManager::finish() {
+    _fast = _attempt == ATTEMPT_FAST;
+    _attempt = ATTEMPT_DONE;
+    _connectMs = millis() - _beginMs;
+    if (!_static) {
+        takeLease();
+    }
+    saveRecord();
+    Serial.printf("[WIFI] Connected in %lu ms (%s), IP %s, channel %d\n",
+                  _connectMs, _fast ? "fast" : "scan", WiFi.localIP().toString().c_str(),
+                  (int)WiFi.channel());
+}
+
+bool WiFiManager::loadRecord(WiFiFastRecord& record) {
+    if (!otaRetainedRead(RETAINED_WIFI, &record, sizeof(record))) return false;
+    
+    // RTC memory holds garbage after a power cycle
+    return record.magic == WIFI_FAST_MAGIC &&
+           record.check == otaRecordChecksum(&record, offsetof(WiFiFastRecord, check)) &&
+           record.channel != 0;
+}
+
+void WiFiManager::saveRecord() {
+    WiFiFastRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = WIFI_FAST_MAGIC;
+    memcpy(record.bssid, WiFi.BSSID(), sizeof(record.bssid));
+    record.channel = WiFi.channel();
+    record.ip = WiFi.localIP();
+    record.gateway = WiFi.gatewayIP();
+    record.subnet = WiFi.subnetMask();
+    record.dns = WiFi.dnsIP();
+    record.lease = _lease;
+    record.obtained = _obtained;
+    record.check = otaRecordChecksum(&record, offsetof(WiFiFastRecord, check));
+    otaRetainedWrite(RETAINED_WIFI, &record, sizeof(record));
+}
+
+// A cached lease is reused up to its renewal time (T1, half the lease), when a
+// DHCP client would have asked again. The clock seeded after a restart runs
+// behind by the time the device was down, which the other half covers.
+bool WiFiManager::leaseValid(uint32_t lease, uint32_t obtained) {
+    if (lease == 0 || obtained == 0 || !otaClockValid()) return false;
+    uint32_t now = time(nullptr);
+    return now >= obtained && now - obtained < lease / 2;
+}
+
+// Takes the lease DHCP just granted, dated when the clock allows
+void WiFiManager::takeLease() {
+    _lease = dhcpLease();
+    _leaseMs = millis();
+    _obtained = otaClockValid() ? (uint32_t)time(nullptr) : 0;
+}
+
+// Lease time DHCP granted the station interface, 0 when it has none
+uint32_t WiFiManager::dhcpLease() {
+    for (netif* intf = netif_list; intf != nullptr; intf = intf->next) {
+        if (intf->num == STATION_IF) {
+            struct dhcp* dhcp = netif_dhcp_data(intf);
+            return dhcp ? dhcp->offered_t0_lease : 0;
+        }
+    }
+    return 0;
+}
+
+void WiFiManager::clearRecord() {
+    WiFiFastRecord record;
+    memset(&record, 0, sizeof(record));
+    otaRetainedWrite(RETAINED_WIFI, &record, sizeof(record));
 }
 
 bool WiFiManager::isConnected() {
@@ -2,18 +2,74 @@
 #define WIFI_MANAGER_H
 
 #include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+// The last good join, kept in RTC memory (RETAINED_WIFI) so the next boot (every OTA restart included) can skip the scan, and with WIFI_FAST_STATIC_IP DHCP while the lease lasts.
+// Survives a restart but not a power cycle.
+struct WiFiFastRecord {
+    uint32_t magic;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t reserved;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+    uint32_t lease;           // s granted by DHCP, 0 when unknown
+    uint32_t obtained;        // epoch the lease was granted, 0 while the clock was not set
+    uint32_t check;
+};
 
 class WiFiManager {
 public:
     WiFiManager();
-    bool connect();
+    void begin();   // starts joining and returns at once
+    void loop();    // falls back from the fast join to a scan, saves the join
     bool isConnected();
     String getIPAddress();
     
+    // How the join went, for the boot timeline and status
+    bool joined() const { return _attempt == ATTEMPT_DONE; }
+    unsigned long connectMs() const { return _connectMs; }
+    bool fastConnected() const { return _fast; }
+
 private:
+    enum Attempt {
+        ATTEMPT_NONE,
+        ATTEMPT_FAST,       // cached BSSID/channel (and lease)
+        ATTEMPT_SCAN,
+        ATTEMPT_DONE
+    };
+    
+    void startFast(const WiFiFastRecord& cached);
+    void loopLease();
+    void takeLease();
+    static bool leaseValid(uint32_t lease, uint32_t obtained);
+    static uint32_t dhcpLease();
+    void startScan();
+    void finish();
+    bool loadRecord(WiFiFastRecord& record);
+    void saveRecord();
+    void clearRecord();
+    
     const char* _ssid;
     const char* _password;
     int _timeout;
+    Attempt _attempt;
+    unsigned long _beginMs;
+    unsigned long _attemptMs;
+    bool _timedOut;
+    unsigned long _connectMs;
+    bool _fast;
+    bool _static;             // joined on the cached lease, DHCP not asked
+    bool _renewing;           // gave up the cached lease, waiting for DHCP
+    uint32_t _lease;
+    uint32_t _obtained;
+    unsigned long _leaseMs;   // millis() when DHCP granted _lease
+    volatile bool _gotIP;
+    volatile bool _disconnected;
+    WiFiEventHandler _onGotIP;
+    WiFiEventHandler _onDisconnected;
 };
 
 #endif // WIFI_MANAGER_H
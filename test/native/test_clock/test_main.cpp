@@ -0,0 +1,48 @@
+// Host tests for the wall clock seeding: pio test -e native
+
+#include <unity.h>
+#include "ota_clock.h"
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_http_date_is_parsed(void) {
+    time_t t = 0;
+    TEST_ASSERT_TRUE(otaParseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT", t));
+    TEST_ASSERT_EQUAL(784111777, (long)t);
+    TEST_ASSERT_TRUE(otaParseHttpDate("Thu, 29 Feb 2024 23:59:59 GMT", t));
+    TEST_ASSERT_EQUAL(1709251199, (long)t);
+    TEST_ASSERT_TRUE(otaParseHttpDate("Fri, 01 Jan 2038 00:00:00 GMT", t));
+    TEST_ASSERT_EQUAL(2145916800LL, (long long)t);
+}
+
+void test_bad_http_date_is_rejected(void) {
+    time_t t = 0;
+    TEST_ASSERT_FALSE(otaParseHttpDate("Sunday, 06-Nov-94 08:49:37 GMT", t));
+    TEST_ASSERT_FALSE(otaParseHttpDate("Sun, 06 Noz 1994 08:49:37 GMT", t));
+    TEST_ASSERT_FALSE(otaParseHttpDate("Sun, 06 ovD 1994 08:49:37 GMT", t));
+    TEST_ASSERT_FALSE(otaParseHttpDate("Sun, 06 Nov 1994 25:49:37 GMT", t));
+    TEST_ASSERT_FALSE(otaParseHttpDate("", t));
+}
+
+// Only checks the refusals, a successful seed would set the host's clock
+void test_seed_never_overrides_a_better_source(void) {
+    TEST_ASSERT_FALSE(otaClockSeed(1000, CLOCK_HTTP_DATE));
+    otaClockSynced();
+    TEST_ASSERT_EQUAL(CLOCK_NTP, otaClockSource());
+    TEST_ASSERT_FALSE(otaClockSeed(1700000000, CLOCK_RTC));
+    TEST_ASSERT_FALSE(otaClockSeed(1700000000, CLOCK_HTTP_DATE));
+    TEST_ASSERT_EQUAL(CLOCK_NTP, otaClockSource());
+    TEST_ASSERT_EQUAL_STRING("ntp", otaClockSourceName(otaClockSource()));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_http_date_is_parsed);
+    RUN_TEST(test_bad_http_date_is_rejected);
+    RUN_TEST(test_seed_never_overrides_a_better_source);
+    return UNITY_END();
+}
@@ -0,0 +1,94 @@
+// Host tests for the per-chunk download statistics: pio test -e native
+
+#include <unity.h>
+#include <string.h>
+#include "ota_download_stats.h"
+
+static OTADownloadStats* stats;
+
+static uint32_t field(const OTAStageRecord& record, const char* key) {
+    for (uint8_t i = 0; i < record.fieldCount; i++) {
+        if (strcmp(record.field(i).key, key) == 0) return record.field(i).value;
+    }
+    return UINT32_MAX;  // missing, fails any assert
+}
+
+void setUp(void) {
+    stats = new OTADownloadStats();
+}
+
+void tearDown(void) {
+    delete stats;
+}
+
+void test_chunks_land_in_their_buckets(void) {
+    OTAMetricsRing ring;
+    stats->chunk(100, 0);       // first chunk only starts the clock
+    stats->chunk(512, 500);     // 0.5 ms
+    stats->chunk(1460, 5500);   // 5 ms
+    stats->chunk(8192, 55500);  // 50 ms
+    
+    OTAStageRecord& record = ring.push("stream_chunks", 0);
+    stats->addTo(record, -70);
+    TEST_ASSERT_EQUAL(4, field(record, "chunks"));
+    TEST_ASSERT_EQUAL(1, field(record, "chunk_le_128"));
+    TEST_ASSERT_EQUAL(1, field(record, "chunk_le_512"));
+    TEST_ASSERT_EQUAL(1, field(record, "chunk_le_mss"));
+    TEST_ASSERT_EQUAL(1, field(record, "chunk_gt_4k"));
+    TEST_ASSERT_EQUAL(1, field(record, "gap_lt_1ms"));
+    TEST_ASSERT_EQUAL(1, field(record, "gap_lt_10ms"));
+    TEST_ASSERT_EQUAL(1, field(record, "gap_lt_100ms"));
+    TEST_ASSERT_EQUAL(0, field(record, "stalls"));
+    TEST_ASSERT_EQUAL(-70, (int32_t)field(record, "rssi"));
+}
+
+void test_long_gaps_count_as_stalls(void) {
+    stats->chunk(512, 0);
+    stats->chunk(512, OTA_STALL_THRESHOLD * 1000UL);
+    stats->chunk(512, OTA_STALL_THRESHOLD * 1000UL + 2000000);
+    TEST_ASSERT_EQUAL(2, stats->stalls());
+}
+
+void test_reconnect_gap_is_not_a_stall(void) {
+    stats->chunk(512, 0);
+    stats->resume();
+    stats->chunk(512, 5000000);
+    TEST_ASSERT_EQUAL(0, stats->stalls());
+}
+
+void test_rate_over_window_and_peak(void) {
+    // 10 KB/s for one window, then 20 KB/s for the next
+    unsigned long t = 0;
+    stats->chunk(0, t);
+    for (int i = 0; i < 10; i++) {
+        t += OTA_THROUGHPUT_WINDOW * 100UL;
+        stats->chunk(OTA_THROUGHPUT_WINDOW, t);
+    }
+    TEST_ASSERT_EQUAL(10000, stats->bytesPerSec(t));
+    for (int i = 0; i < 10; i++) {
+        t += OTA_THROUGHPUT_WINDOW * 100UL;
+        stats->chunk(OTA_THROUGHPUT_WINDOW * 2, t);
+    }
+    TEST_ASSERT_EQUAL(20000, stats->bytesPerSec(t));
+    TEST_ASSERT_EQUAL(20000, stats->peakBytesPerSec());
+    
+    // With no data the current window runs long and the rate falls
+    TEST_ASSERT_EQUAL(0, stats->bytesPerSec(t + OTA_THROUGHPUT_WINDOW * 2000UL));
+    TEST_ASSERT_EQUAL(20000, stats->peakBytesPerSec());
+}
+
+void test_short_download_reports_partial_window(void) {
+    stats->chunk(512, 0);
+    stats->chunk(512, 100000);
+    TEST_ASSERT_EQUAL(5120, stats->peakBytesPerSec());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_chunks_land_in_their_buckets);
+    RUN_TEST(test_long_gaps_count_as_stalls);
+    RUN_TEST(test_reconnect_gap_is_not_a_stall);
+    RUN_TEST(test_rate_over_window_and_peak);
+    RUN_TEST(test_short_download_reports_partial_window);
+    return UNITY_END();
+}
@@ -0,0 +1,213 @@
+// Host tests for the streaming manifest parser: pio test -e native
+
+#include <unity.h>
+#include <string.h>
+#include <string>
+#include "manifest_parser.h"
+
+static const char* HASH_HEX = "9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08";
+static const char* SIG_HEX =
+    "0102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f20"
+    "2122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f40";
+
+static FirmwareManifest manifest;
+
+// Same layout json.dump(indent=2) produces in the CI workflow
+static std::string ciManifest() {
+    return std::string("{\n") +
+           "  \"version\": \"a1b2c3d-20260301T1200-build42\",\n" +
+           "  \"hash\": \"" + HASH_HEX + "\",\n" +
+           "  \"size\": 412480,\n" +
+           "  \"url\": \"firmware-otaq.bin\",\n" +
+           "  \"signature\": \"" + SIG_HEX + "\",\n" +
+           "  \"manifest_signature\": \"" + SIG_HEX + "\",\n" +
+           "  \"base_hash\": \"" + HASH_HEX + "\",\n" +
+           "  \"base_size\": 401232,\n" +
+           "  \"patch_url\": \"firmware-otaq.patch\",\n" +
+           "  \"patch_size\": 18231,\n" +
+           "  \"compression\": \"lzss\",\n" +
+           "  \"compressed_url\": \"firmware-otaq.lzs\",\n" +
+           "  \"compressed_size\": 283311\n" +
+           "}\n";
+}
+
+static std::string requiredFields(const std::string& hash = HASH_HEX, const std::string& signature = SIG_HEX) {
+    return "\"version\":\"a1b2c3d-20260301T1200-build42\",\"hash\":\"" + hash +
+           "\",\"size\":412480,\"url\":\"firmware-otaq.bin\",\"manifest_signature\":\"" + signature + "\"";
+}
+
+static std::string minimalManifest(const std::string& extra = "") {
+    return "{" + requiredFields() + extra + "}";
+}
+
+// Feeds `json` in pieces of `chunk` bytes, the way it comes off the socket
+static bool parse(const std::string& json, size_t chunk = 7) {
+    ManifestParser parser(manifest);
+    for (size_t pos = 0; pos < json.size(); pos += chunk) {
+        size_t n = json.size() - pos < chunk ? json.size() - pos : chunk;
+        if (!parser.feed((const uint8_t*)json.data() + pos, n)) {
+            return false;
+        }
+    }
+    return parser.finish();
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_parses_ci_manifest(void) {
+    uint8_t hash[32];
+    uint8_t signature[64];
+    ManifestParser::hexToBytes(HASH_HEX, hash, sizeof(hash));
+    ManifestParser::hexToBytes(SIG_HEX, signature, sizeof(signature));
+    
+    TEST_ASSERT_TRUE(parse(ciManifest()));
+    TEST_ASSERT_EQUAL_STRING("a1b2c3d-20260301T1200-build42", manifest.version);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(hash, manifest.hash, 32);
+    TEST_ASSERT_EQUAL_UINT32(412480, manifest.size);
+    TEST_ASSERT_EQUAL_STRING("firmware-otaq.bin", manifest.url);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(signature, manifest.signature, 64);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(hash, manifest.baseHash, 32);
+    TEST_ASSERT_EQUAL_UINT32(401232, manifest.baseSize);
+    TEST_ASSERT_EQUAL_STRING("firmware-otaq.patch", manifest.patchUrl);
+    TEST_ASSERT_EQUAL_STRING("lzss", manifest.compression);
+    TEST_ASSERT_EQUAL_STRING("firmware-otaq.lzs", manifest.compressedUrl);
+}
+
+void test_chunk_size_does_not_matter(void) {
+    std::string json = ciManifest();
+    for (size_t chunk = 1; chunk <= json.size(); chunk *= 3) {
+        TEST_ASSERT_TRUE(parse(json, chunk));
+        TEST_ASSERT_EQUAL_UINT32(401232, manifest.baseSize);
+    }
+}
+
+void test_skips_unknown_values(void) {
+    TEST_ASSERT_TRUE(parse(minimalManifest(
+        ",\"notes\":{\"a\":[1,2,{\"b\":\"}]\\\"\"}]},\"beta\":true,\"signing_ms\":-1.5e3,\"x\":null")));
+    TEST_ASSERT_EQUAL_STRING("a1b2c3d-20260301T1200-build42", manifest.version);
+}
+
+void test_decodes_escapes(void) {
+    TEST_ASSERT_TRUE(parse(minimalManifest(
+        ",\"compression\":\"lzss\",\"compressed_url\":\"https:\\/\\/ota.example.com\\/fw\\u002elzs\"")));
+    TEST_ASSERT_EQUAL_STRING("https://ota.example.com/fw.lzs", manifest.compressedUrl);
+}
+
+void test_incomplete_optional_groups_are_dropped(void) {
+    TEST_ASSERT_TRUE(parse(minimalManifest(",\"patch_url\":\"p.patch\",\"compression\":\"lzss\"")));
+    TEST_ASSERT_EQUAL_STRING("", manifest.patchUrl);
+    TEST_ASSERT_EQUAL_UINT32(0, manifest.baseSize);
+    TEST_ASSERT_EQUAL_STRING("", manifest.compression);
+}
+
+void test_rejects_missing_required_fields(void) {
+    // Every required key removed in turn, plus the legacy image-only signature
+    const char* keys[] = {"\"version\"", "\"hash\"", "\"size\"", "\"url\"", "\"manifest_signature\""};
+    for (const char* key : keys) {
+        std::string json = minimalManifest();
+        json.replace(json.find(key), strlen(key), "\"other\"");
+        TEST_ASSERT_FALSE(parse(json));
+    }
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"version\":\"\"")));
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"url\":\"\"")));
+    TEST_ASSERT_FALSE(parse(std::string("{\"version\":\"v\",\"hash\":\"") + HASH_HEX +
+                            "\",\"signature\":\"" + SIG_HEX + "\"}"));
+    TEST_ASSERT_FALSE(parse("{}"));
+}
+
+void test_rejects_malformed_json(void) {
+    std::string good = minimalManifest();
+    TEST_ASSERT_FALSE(parse(""));
+    TEST_ASSERT_FALSE(parse("[]"));
+    TEST_ASSERT_FALSE(parse(good.substr(0, good.size() - 1)));       // truncated
+    TEST_ASSERT_FALSE(parse(good + "x"));                            // trailing data
+    TEST_ASSERT_FALSE(parse("{\"version\" \"v\"}"));                 // missing colon
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"beta\":tru")));
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"a\":1,")));
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"a\":\"line\nbreak\"")));
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"a\":\"\\q\"")));
+}
+
+void test_rejects_wrong_types(void) {
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"base_size\":\"401232\"")));
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"size\":\"412480\"")));
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"url\":true")));
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"base_size\":-1")));
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"base_size\":1.5")));
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"base_size\":4294967296")));
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"patch_url\":42")));
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"compression\":{\"name\":\"lzss\"}")));
+}
+
+void test_rejects_bad_hex(void) {
+    std::string shortHash = std::string(HASH_HEX).substr(0, 62);
+    std::string longHash = std::string(HASH_HEX) + "00";
+    std::string badHash = std::string(HASH_HEX);
+    badHash[10] = 'g';
+    
+    TEST_ASSERT_FALSE(parse("{" + requiredFields(shortHash) + "}"));
+    TEST_ASSERT_FALSE(parse("{" + requiredFields(longHash) + "}"));
+    TEST_ASSERT_FALSE(parse("{" + requiredFields(badHash) + "}"));
+    TEST_ASSERT_FALSE(parse("{" + requiredFields(HASH_HEX, "00") + "}"));
+}
+
+void test_rejects_oversized_values(void) {
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"version\":\"" + std::string(MANIFEST_VERSION_LEN, 'v') + "\"")));
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"patch_url\":\"" + std::string(MANIFEST_URL_LEN, 'u') + "\"")));
+    TEST_ASSERT_FALSE(parse(minimalManifest(",\"compression\":\"" + std::string(MANIFEST_COMPRESSION_LEN, 'c') + "\"")));
+    
+    // One byte short of the limit still fits
+    TEST_ASSERT_TRUE(parse(minimalManifest(",\"patch_url\":\"" + std::string(MANIFEST_URL_LEN - 1, 'u') + "\"")));
+}
+
+void test_rejects_oversized_document(void) {
+    std::string padding = ",\"notes\":\"" + std::string(MANIFEST_MAX_SIZE, ' ') + "\"";
+    TEST_ASSERT_FALSE(parse(minimalManifest(padding)));
+    
+    std::string deep = ",\"notes\":" + std::string(16, '[') + std::string(16, ']');
+    TEST_ASSERT_FALSE(parse(minimalManifest(deep)));
+}
+
+void test_canonical_encoding(void) {
+    TEST_ASSERT_TRUE(parse(minimalManifest()));
+    
+    uint8_t out[MANIFEST_CANONICAL_MAX];
+    size_t len = ManifestParser::canonicalize(manifest, out, sizeof(out));
+    
+    // Must match the bytes the CI workflow signs
+    std::string version = "a1b2c3d-20260301T1200-build42";
+    std::string url = "firmware-otaq.bin";
+    TEST_ASSERT_EQUAL_UINT32(5 + 1 + version.size() + 32 + 4 + 1 + url.size(), len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY("OTAM1", out, 5);
+    TEST_ASSERT_EQUAL_UINT32(version.size(), out[5]);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(version.data(), out + 6, version.size());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(manifest.hash, out + 6 + version.size(), 32);
+    
+    const uint8_t size[4] = {0x40, 0x4b, 0x06, 0x00};  // 412480 LE
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(size, out + 38 + version.size(), 4);
+    TEST_ASSERT_EQUAL_UINT32(url.size(), out[42 + version.size()]);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(url.data(), out + 43 + version.size(), url.size());
+    
+    TEST_ASSERT_EQUAL_UINT32(0, ManifestParser::canonicalize(manifest, out, len - 1));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_parses_ci_manifest);
+    RUN_TEST(test_chunk_size_does_not_matter);
+    RUN_TEST(test_skips_unknown_values);
+    RUN_TEST(test_decodes_escapes);
+    RUN_TEST(test_incomplete_optional_groups_are_dropped);
+    RUN_TEST(test_rejects_missing_required_fields);
+    RUN_TEST(test_rejects_malformed_json);
+    RUN_TEST(test_rejects_wrong_types);
+    RUN_TEST(test_rejects_bad_hex);
+    RUN_TEST(test_rejects_oversized_values);
+    RUN_TEST(test_rejects_oversized_document);
+    RUN_TEST(test_canonical_encoding);
+    return UNITY_END();
+}
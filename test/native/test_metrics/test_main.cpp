@@ -0,0 +1,172 @@
+// Host tests for the batched ota/metrics encoding: pio test -e native
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "ota_metrics.h"
+
+static OTAMetricsRing* ring;
+
+// Keeps the last batch; refuses everything while `full` is set
+class FakePublisher : public OTAPublisher {
+public:
+    bool full = false;
+    std::string last;
+    
+    void loop() {}
+    bool publish(const char* topic, const char* payload) {
+        if (full) return false;
+        last = payload;
+        return true;
+    }
+    bool publish(const char* topic, const uint8_t* payload, size_t len) {
+        if (full) return false;
+        last.assign((const char*)payload, len);
+        return true;
+    }
+};
+
+static std::string encodeAll(size_t bufferSize, uint8_t& encoded) {
+    uint8_t buffer[2048];
+    size_t len = 0;
+    encoded = ring->encode(0, ring->count(), buffer, bufferSize, len);
+    return std::string((const char*)buffer, len);
+}
+
+void setUp(void) {
+    ring = new OTAMetricsRing();
+}
+
+void tearDown(void) {
+    delete ring;
+}
+
+void test_batch_holds_stages_in_order(void) {
+    ring->push("download_manifest", 12000).add("handshake", "full").add("connect_ms", 340);
+    ring->push("verify_manifest", 4500);
+    
+    uint8_t encoded = 0;
+    std::string json = encodeAll(OTA_METRICS_BATCH_SIZE, encoded);
+    TEST_ASSERT_EQUAL(2, encoded);
+    TEST_ASSERT_TRUE(json.rfind("{\"algorithm\":\"" FIRMWARE_ALGORITHM "\",\"version\":\"" FIRMWARE_VERSION "\",\"dropped\":0,\"stages\":[{", 0) == 0);
+    TEST_ASSERT_TRUE(json.find("\"stage\":\"download_manifest\",\"elapsed_ms\":12,") != std::string::npos);
+    TEST_ASSERT_TRUE(json.find("\"handshake\":\"full\",\"connect_ms\":340,\"timestamp\":") != std::string::npos);
+    TEST_ASSERT_TRUE(json.find("download_manifest") < json.find("verify_manifest"));
+    TEST_ASSERT_EQUAL_STRING("]}", json.substr(json.size() - 2).c_str());
+}
+
+void test_full_ring_drops_oldest(void) {
+    for (int i = 0; i < OTA_METRICS_RING + 2; i++) {
+        ring->push(i < 2 ? "old" : "new", i);
+    }
+    TEST_ASSERT_EQUAL(OTA_METRICS_RING, ring->count());
+    TEST_ASSERT_EQUAL(2, ring->dropped());
+    
+    uint8_t encoded = 0;
+    std::string json = encodeAll(2048, encoded);
+    TEST_ASSERT_TRUE(json.find("\"old\"") == std::string::npos);
+    TEST_ASSERT_TRUE(json.find("\"dropped\":2,") != std::string::npos);
+}
+
+void test_small_buffer_splits_batch(void) {
+    ring->push("stream_firmware", 1000).add("mode", "zero_copy").add("bytes_per_sec", 41000);
+    ring->push("verify_hash", 1000);
+    ring->push("flash_commit", 1000);
+    
+    // Room for the envelope and one record only
+    uint8_t encoded = 0;
+    std::string json = encodeAll(300, encoded);
+    TEST_ASSERT_EQUAL(1, encoded);
+    TEST_ASSERT_LESS_OR_EQUAL(300, json.size() + 1);
+    TEST_ASSERT_EQUAL_STRING("}]}", json.substr(json.size() - 3).c_str());
+    
+    // flush() carries on from the first record that did not fit
+    uint8_t buffer[300];
+    uint8_t first = encoded;
+    int messages = 1;
+    while (first < ring->count()) {
+        size_t len = 0;
+        uint8_t n = ring->encode(first, ring->count() - first, buffer, sizeof(buffer), len);
+        TEST_ASSERT_GREATER_THAN(0, n);
+        first += n;
+        messages++;
+    }
+    TEST_ASSERT_EQUAL(3, first);
+    TEST_ASSERT_GREATER_THAN(1, messages);
+}
+
+void test_fields_past_limit_are_dropped(void) {
+    OTAStageRecord& record = ring->push("stage", 0);
+    for (int i = 0; i < OTA_METRICS_FIELDS + 3; i++) {
+        record.add("k", i);
+    }
+    TEST_ASSERT_EQUAL(OTA_METRICS_FIELDS, record.fieldCount);
+}
+
+void test_field_pool_drops_oldest_records(void) {
+    // Full records until the pool is short of room for the next one
+    int records = OTA_METRICS_FIELD_POOL / OTA_METRICS_FIELDS + 1;
+    for (int r = 0; r < records; r++) {
+        OTAStageRecord& record = ring->push(r == 0 ? "old" : "new", 0);
+        for (int i = 0; i < OTA_METRICS_FIELDS; i++) {
+            record.add("k", r * 100 + i);
+        }
+        TEST_ASSERT_EQUAL(OTA_METRICS_FIELDS, record.fieldCount);
+        TEST_ASSERT_EQUAL(r * 100 + OTA_METRICS_FIELDS - 1, record.field(OTA_METRICS_FIELDS - 1).value);
+    }
+    TEST_ASSERT_EQUAL(1, ring->dropped());
+    
+    uint8_t encoded = 0;
+    std::string json = encodeAll(2048, encoded);
+    TEST_ASSERT_TRUE(json.find("\"old\"") == std::string::npos);
+    
+    // An older record takes no more fields
+    OTAStageRecord& first = ring->push("first", 0);
+    ring->push("second", 0);
+    first.add("late", 1);
+    TEST_ASSERT_EQUAL(0, first.fieldCount);
+}
+
+void test_signed_fields_keep_their_sign(void) {
+    ring->push("stream_chunks", 0).add("stalls", 2).addSigned("rssi", -67);
+    
+    uint8_t encoded = 0;
+    std::string json = encodeAll(OTA_METRICS_BATCH_SIZE, encoded);
+    TEST_ASSERT_TRUE(json.find("\"stalls\":2,\"rssi\":-67,") != std::string::npos);
+}
+
+void test_refused_batch_is_counted_as_dropped(void) {
+    FakePublisher publisher;
+    for (int i = 0; i < OTA_METRICS_RING + 1; i++) {
+        ring->push("stage", i);
+    }
+    TEST_ASSERT_EQUAL(1, ring->dropped());
+    
+    // Nothing reported the overwritten record yet, and the refused batch
+    // adds its own records
+    publisher.full = true;
+    ring->flush(&publisher, MQTT_TOPIC_METRICS);
+    TEST_ASSERT_EQUAL(0, ring->count());
+    TEST_ASSERT_EQUAL(OTA_METRICS_RING + 1, ring->dropped());
+    
+    publisher.full = false;
+    ring->push("next", 0);
+    ring->flush(&publisher, MQTT_TOPIC_METRICS);
+    char expected[24];
+    snprintf(expected, sizeof(expected), "\"dropped\":%d,", OTA_METRICS_RING + 1);
+    TEST_ASSERT_TRUE(publisher.last.find(expected) != std::string::npos);
+    TEST_ASSERT_EQUAL(0, ring->dropped());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_batch_holds_stages_in_order);
+    RUN_TEST(test_full_ring_drops_oldest);
+    RUN_TEST(test_small_buffer_splits_batch);
+    RUN_TEST(test_fields_past_limit_are_dropped);
+    RUN_TEST(test_field_pool_drops_oldest_records);
+    RUN_TEST(test_signed_fields_keep_their_sign);
+    RUN_TEST(test_refused_batch_is_counted_as_dropped);
+    return UNITY_END();
+}
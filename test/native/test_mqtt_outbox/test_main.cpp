@@ -0,0 +1,213 @@
+// Host tests for the MQTT outbox: pio test -e native
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include "mqtt_outbox.h"
+#include "ota_platform.h"
+
+#define SPILL_PATH "/test.outbox"
+
+static MQTTOutbox* outbox;
+
+// What the "client" took, in order
+static char sentTopics[64][32];
+static uint8_t sentPayloads[64][64];
+static size_t sentLengths[64];
+static int sentCount;
+static bool clientBusy;
+
+static bool capture(void* ctx, const char* topic, const uint8_t* payload, size_t len) {
+    if (clientBusy || sentCount == 64) return false;
+    snprintf(sentTopics[sentCount], sizeof(sentTopics[0]), "%s", topic);
+    memcpy(sentPayloads[sentCount], payload, min(len, sizeof(sentPayloads[0])));
+    sentLengths[sentCount] = len;
+    sentCount++;
+    return true;
+}
+
+static void push(const char* topic, const char* payload,
+                 MQTTOutbox::Priority priority = MQTTOutbox::PRIORITY_NORMAL, bool coalesce = false) {
+    outbox->push(topic, (const uint8_t*)payload, strlen(payload), priority, coalesce);
+}
+
+static bool sentEquals(int i, const char* topic, const char* payload) {
+    return strcmp(sentTopics[i], topic) == 0 && sentLengths[i] == strlen(payload) &&
+           memcmp(sentPayloads[i], payload, sentLengths[i]) == 0;
+}
+
+void setUp(void) {
+    setenv("OTA_NATIVE_DIR", "/tmp/ota-outbox-test", 1);
+    otaStorageRemove(SPILL_PATH);
+    outbox = new MQTTOutbox();
+    sentCount = 0;
+    clientBusy = false;
+}
+
+void tearDown(void) {
+    delete outbox;
+    otaStorageRemove(SPILL_PATH);
+}
+
+void test_messages_go_out_in_order(void) {
+    push("ota/metrics", "one");
+    push("ota/metrics", "two");
+    push("ota/cpu", "three");
+    TEST_ASSERT_EQUAL(3, outbox->depth());
+    
+    TEST_ASSERT_EQUAL(2, outbox->drain(capture, nullptr, 2));
+    TEST_ASSERT_EQUAL(1, outbox->drain(capture, nullptr, 8));
+    TEST_ASSERT_TRUE(sentEquals(0, "ota/metrics", "one"));
+    TEST_ASSERT_TRUE(sentEquals(1, "ota/metrics", "two"));
+    TEST_ASSERT_TRUE(sentEquals(2, "ota/cpu", "three"));
+    TEST_ASSERT_TRUE(outbox->empty());
+    TEST_ASSERT_EQUAL(3, outbox->sent());
+}
+
+void test_high_priority_goes_first(void) {
+    push("ota/metrics", "batch");
+    push("fw/ack", "4096", MQTTOutbox::PRIORITY_HIGH);
+    outbox->drain(capture, nullptr, 8);
+    TEST_ASSERT_TRUE(sentEquals(0, "fw/ack", "4096"));
+    TEST_ASSERT_TRUE(sentEquals(1, "ota/metrics", "batch"));
+}
+
+void test_busy_client_keeps_the_message(void) {
+    push("ota/metrics", "kept");
+    clientBusy = true;
+    TEST_ASSERT_EQUAL(0, outbox->drain(capture, nullptr, 8));
+    TEST_ASSERT_EQUAL(1, outbox->depth());
+    clientBusy = false;
+    TEST_ASSERT_EQUAL(1, outbox->drain(capture, nullptr, 8));
+    TEST_ASSERT_TRUE(sentEquals(0, "ota/metrics", "kept"));
+}
+
+void test_coalescing_keeps_only_the_latest(void) {
+    push("ota/progress", "10", MQTTOutbox::PRIORITY_NORMAL, true);
+    push("ota/metrics", "batch");
+    push("ota/progress", "20", MQTTOutbox::PRIORITY_NORMAL, true);
+    push("ota/progress", "30", MQTTOutbox::PRIORITY_NORMAL, true);
+    TEST_ASSERT_EQUAL(2, outbox->depth());
+    TEST_ASSERT_EQUAL(2, outbox->coalesced());
+    
+    TEST_ASSERT_EQUAL(2, outbox->drain(capture, nullptr, 8));
+    TEST_ASSERT_TRUE(sentEquals(0, "ota/metrics", "batch"));
+    TEST_ASSERT_TRUE(sentEquals(1, "ota/progress", "30"));
+    
+    // Once sent, the next one is queued normally
+    push("ota/progress", "40", MQTTOutbox::PRIORITY_NORMAL, true);
+    TEST_ASSERT_EQUAL(1, outbox->depth());
+    TEST_ASSERT_EQUAL(2, outbox->coalesced());
+}
+
+void test_full_ring_drops_the_oldest(void) {
+    char payload[48];
+    int pushed = 0;
+    while (outbox->dropped() == 0) {
+        snprintf(payload, sizeof(payload), "message %04d ........................", pushed++);
+        push("ota/metrics", payload);
+    }
+    
+    // The first one made room for the last
+    int queued = outbox->depth();
+    TEST_ASSERT_EQUAL(pushed - 1, queued);
+    outbox->drain(capture, nullptr, 64);
+    TEST_ASSERT_EQUAL(queued, sentCount);
+    snprintf(payload, sizeof(payload), "message %04d ........................", 1);
+    TEST_ASSERT_TRUE(sentEquals(0, "ota/metrics", payload));
+    snprintf(payload, sizeof(payload), "message %04d ........................", pushed - 1);
+    TEST_ASSERT_TRUE(sentEquals(queued - 1, "ota/metrics", payload));
+}
+
+void test_records_survive_wrapping(void) {
+    // Sizes that do not divide the ring, so records keep landing at the end
+    char payload[64];
+    for (int round = 0; round < 200; round++) {
+        int len = 5 + (round * 13) % 50;
+        memset(payload, 'a' + round % 26, len);
+        payload[len] = '\0';
+        push("ota/metrics", payload);
+        if (round % 3 == 2) {
+            sentCount = 0;
+            outbox->drain(capture, nullptr, 3);
+            TEST_ASSERT_EQUAL(3, sentCount);
+            TEST_ASSERT_EQUAL('a' + (round - 2) % 26, sentPayloads[0][0]);
+            TEST_ASSERT_EQUAL('a' + round % 26, sentPayloads[2][sentLengths[2] - 1]);
+        }
+    }
+    TEST_ASSERT_EQUAL(0, outbox->dropped());
+}
+
+void test_oversized_message_is_dropped(void) {
+    static uint8_t big[MQTT_OUTBOX_SIZE];
+    memset(big, 'x', sizeof(big));
+    TEST_ASSERT_FALSE(outbox->push("ota/metrics", big, sizeof(big)));
+    TEST_ASSERT_EQUAL(1, outbox->dropped());
+    TEST_ASSERT_TRUE(outbox->empty());
+}
+
+void test_reserved_room_is_trimmed_on_commit(void) {
+    // A large reservation of which only a part is used, around the ring
+    // a few times, between ordinary messages
+    for (int round = 0; round < 40; round++) {
+        uint8_t* room = outbox->reserve("ota/metrics", 1024);
+        TEST_ASSERT_TRUE(room != nullptr);
+        int len = 10 + (round * 7) % 40;
+        memset(room, 'a' + round % 26, len);
+        TEST_ASSERT_TRUE(outbox->commit(len));
+        push("ota/cpu", "x");
+        
+        sentCount = 0;
+        TEST_ASSERT_EQUAL(2, outbox->drain(capture, nullptr, 8));
+        TEST_ASSERT_EQUAL(len, sentLengths[0]);
+        TEST_ASSERT_EQUAL('a' + round % 26, sentPayloads[0][len - 1]);
+        TEST_ASSERT_TRUE(sentEquals(1, "ota/cpu", "x"));
+    }
+    TEST_ASSERT_EQUAL(0, outbox->dropped());
+    
+    // Given back: nothing is sent
+    TEST_ASSERT_TRUE(outbox->reserve("ota/metrics", 1024) != nullptr);
+    TEST_ASSERT_FALSE(outbox->commit(0));
+    sentCount = 0;
+    TEST_ASSERT_EQUAL(0, outbox->drain(capture, nullptr, 8));
+    TEST_ASSERT_TRUE(outbox->empty());
+}
+
+void test_spill_keeps_what_ram_cannot(void) {
+    outbox->enableSpill(SPILL_PATH, 65536);
+    
+    static uint8_t batch[1500];
+    for (int i = 0; i < 6; i++) {
+        memset(batch, '0' + i, sizeof(batch));
+        outbox->push("ota/metrics", batch, sizeof(batch));
+    }
+    TEST_ASSERT_EQUAL(0, outbox->dropped());
+    TEST_ASSERT_TRUE(outbox->spilled() > 0);
+    TEST_ASSERT_TRUE(outbox->spillBacklog() > 0);
+    
+    // RAM first, then the log; nothing is lost
+    outbox->drain(capture, nullptr, 64);
+    TEST_ASSERT_EQUAL(6, sentCount);
+    int seen = 0;
+    for (int i = 0; i < 6; i++) {
+        TEST_ASSERT_EQUAL(sizeof(batch), sentLengths[i]);
+        seen |= 1 << (sentPayloads[i][0] - '0');
+    }
+    TEST_ASSERT_EQUAL(0x3F, seen);
+    TEST_ASSERT_TRUE(outbox->empty());
+    TEST_ASSERT_EQUAL(0, otaStorageSize(SPILL_PATH));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_messages_go_out_in_order);
+    RUN_TEST(test_high_priority_goes_first);
+    RUN_TEST(test_busy_client_keeps_the_message);
+    RUN_TEST(test_coalescing_keeps_only_the_latest);
+    RUN_TEST(test_full_ring_drops_the_oldest);
+    RUN_TEST(test_records_survive_wrapping);
+    RUN_TEST(test_oversized_message_is_dropped);
+    RUN_TEST(test_reserved_room_is_trimmed_on_commit);
+    RUN_TEST(test_spill_keeps_what_ram_cannot);
+    return UNITY_END();
+}
@@ -0,0 +1,113 @@
+// Host tests for the MQTT topic router: pio test -e native
+
+#include <unity.h>
+#include <string.h>
+#include "mqtt_router.h"
+
+static MQTTRouter* router;
+static int calls[3];
+static const uint8_t* lastPayload;
+static size_t lastLength;
+
+static void first(const char* topic, const uint8_t* payload, size_t length) {
+    calls[0]++;
+    lastPayload = payload;
+    lastLength = length;
+}
+
+static void second(const char* topic, const uint8_t* payload, size_t length) {
+    calls[1]++;
+}
+
+static void third(const char* topic, const uint8_t* payload, size_t length) {
+    calls[2]++;
+}
+
+void setUp(void) {
+    router = new MQTTRouter();
+    memset(calls, 0, sizeof(calls));
+    lastPayload = nullptr;
+    lastLength = 0;
+}
+
+void tearDown(void) {
+    delete router;
+}
+
+void test_exact_topics(void) {
+    TEST_ASSERT_TRUE(MQTTRouter::matches("device/002/ota/update", "device/002/ota/update"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("device/002/ota/update", "device/002/ota/updates"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("device/002/ota/update", "device/002/ota"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("device/002/ota", "device/002/ota/update"));
+}
+
+void test_single_level_wildcard(void) {
+    TEST_ASSERT_TRUE(MQTTRouter::matches("device/+/cmd/status", "device/002/cmd/status"));
+    TEST_ASSERT_TRUE(MQTTRouter::matches("device/002/cmd/+", "device/002/cmd/reboot"));
+    TEST_ASSERT_TRUE(MQTTRouter::matches("device/002/cmd/+", "device/002/cmd/"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("device/002/cmd/+", "device/002/cmd/a/b"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("device/002/cmd/+", "device/002/cmd"));
+    TEST_ASSERT_TRUE(MQTTRouter::matches("+/+", "/finance"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("+", "/finance"));
+}
+
+void test_multi_level_wildcard(void) {
+    TEST_ASSERT_TRUE(MQTTRouter::matches("device/002/#", "device/002/ota/fw/chunk"));
+    TEST_ASSERT_TRUE(MQTTRouter::matches("device/002/#", "device/002"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("device/002/#", "device/0021"));
+    TEST_ASSERT_TRUE(MQTTRouter::matches("#", "ota/metrics"));
+    TEST_ASSERT_TRUE(MQTTRouter::matches("+/002/#", "device/002/cmd/status"));
+}
+
+void test_wildcards_skip_dollar_topics(void) {
+    TEST_ASSERT_FALSE(MQTTRouter::matches("#", "$SYS/broker/uptime"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("+/broker/uptime", "$SYS/broker/uptime"));
+    TEST_ASSERT_TRUE(MQTTRouter::matches("$SYS/#", "$SYS/broker/uptime"));
+}
+
+void test_malformed_filters_are_rejected(void) {
+    TEST_ASSERT_FALSE(router->add("", first));
+    TEST_ASSERT_FALSE(router->add("device/#/cmd", first));
+    TEST_ASSERT_FALSE(router->add("device/00+/cmd", first));
+    TEST_ASSERT_FALSE(router->add("device/002#", first));
+    TEST_ASSERT_FALSE(router->add("device/002/cmd", nullptr));
+    TEST_ASSERT_EQUAL(0, router->count());
+}
+
+void test_dispatch_calls_every_match_in_place(void) {
+    router->add("device/002/cmd/status", first);
+    router->add("device/002/cmd/+", second, 0);
+    router->add("device/002/ota/update", third);
+    
+    const uint8_t payload[] = {'x', 'y'};
+    TEST_ASSERT_EQUAL(2, router->dispatch("device/002/cmd/status", payload, sizeof(payload)));
+    TEST_ASSERT_EQUAL(1, calls[0]);
+    TEST_ASSERT_EQUAL(1, calls[1]);
+    TEST_ASSERT_EQUAL(0, calls[2]);
+    TEST_ASSERT_TRUE(lastPayload == payload);
+    TEST_ASSERT_EQUAL(2, lastLength);
+    
+    TEST_ASSERT_EQUAL(0, router->dispatch("device/003/cmd/status", payload, 0));
+    TEST_ASSERT_EQUAL(0, router->qos(1));
+    TEST_ASSERT_EQUAL_STRING("device/002/ota/update", router->filter(2));
+}
+
+void test_table_is_bounded(void) {
+    for (int i = 0; i < MQTT_ROUTES_MAX; i++) {
+        TEST_ASSERT_TRUE(router->add("device/002/cmd/+", first));
+    }
+    TEST_ASSERT_FALSE(router->add("device/002/cmd/+", first));
+    TEST_ASSERT_EQUAL(MQTT_ROUTES_MAX, router->count());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_exact_topics);
+    RUN_TEST(test_single_level_wildcard);
+    RUN_TEST(test_multi_level_wildcard);
+    RUN_TEST(test_wildcards_skip_dollar_topics);
+    RUN_TEST(test_malformed_filters_are_rejected);
+    RUN_TEST(test_dispatch_calls_every_match_in_place);
+    RUN_TEST(test_table_is_bounded);
+    return UNITY_END();
+}
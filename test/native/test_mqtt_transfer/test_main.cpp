@@ -0,0 +1,160 @@
+// Host tests for the firmware transfer over MQTT: pio test -e native
+
+#include <unity.h>
+#include <string.h>
+#include "ota_mqtt_transfer.h"
+
+#define FILE_SIZE 5000
+
+static uint8_t file[FILE_SIZE];
+
+// Plays the server: answers requests from `file`, one chunk per loop()
+class FakeBroker : public OTAPublisher {
+public:
+    OTAMqttTransfer* transfer;
+    uint32_t offset;
+    uint32_t limit;
+    uint32_t total;
+    int requests;
+    int acks;
+    int dropNext;     // chunk index (from the last request) to lose, -1 for none
+    int sentSinceRequest;
+    
+    void loop() {
+        if (offset >= limit || offset >= total) return;
+        uint8_t payload[OTA_MQTT_CHUNK_HEADER + OTA_MQTT_CHUNK];
+        size_t len = total - offset < OTA_MQTT_CHUNK ? total - offset : OTA_MQTT_CHUNK;
+        header(payload, offset, total);
+        memcpy(payload + OTA_MQTT_CHUNK_HEADER, file + offset, len);
+        offset += len;
+        if (sentSinceRequest++ == dropNext) {
+            dropNext = -1;
+            return;
+        }
+        transfer->onChunk(payload, OTA_MQTT_CHUNK_HEADER + len);
+    }
+    
+    bool publish(const char* topic, const char* payload) {
+        if (strcmp(topic, MQTT_TOPIC_FW_ACK) == 0) {
+            limit = strtoul(payload, nullptr, 10);
+            acks++;
+            return true;
+        }
+        requests++;
+        offset = strtoul(strstr(payload, "\"offset\":") + 9, nullptr, 10);
+        limit = strtoul(strstr(payload, "\"limit\":") + 8, nullptr, 10);
+        sentSinceRequest = 0;
+        if (total == 0) {
+            uint8_t missing[OTA_MQTT_CHUNK_HEADER];
+            header(missing, 0, 0);
+            transfer->onChunk(missing, sizeof(missing));
+        }
+        return true;
+    }
+    
+    bool publish(const char* topic, const uint8_t* payload, size_t len) { return true; }
+    
+    static void header(uint8_t* out, uint32_t offset, uint32_t total) {
+        for (int i = 0; i < 4; i++) {
+            out[i] = offset >> (8 * i);
+            out[4 + i] = total >> (8 * i);
+        }
+    }
+};
+
+static OTAMqttTransfer* transfer;
+static FakeBroker broker;
+
+void setUp(void) {
+    for (int i = 0; i < FILE_SIZE; i++) {
+        file[i] = i * 7 + (i >> 8);
+    }
+    transfer = new OTAMqttTransfer();
+    transfer->setPublisher(&broker);
+    broker = FakeBroker();
+    broker.transfer = transfer;
+    broker.total = FILE_SIZE;
+    broker.dropNext = -1;
+}
+
+void tearDown(void) {
+    delete transfer;
+}
+
+// Reads everything through the zero-copy calls, like OTAUpdater::readFirmware()
+static size_t drain(uint8_t* out, size_t outLen, int maxPolls) {
+    size_t n = 0;
+    for (int i = 0; i < maxPolls && transfer->connected() && n < outLen; i++) {
+        const uint8_t* data;
+        size_t len = transfer->peek(data);
+        if (len > outLen - n) len = outLen - n;
+        memcpy(out + n, data, len);
+        transfer->consume(len);
+        n += len;
+    }
+    return n;
+}
+
+void test_file_arrives_in_order(void) {
+    static uint8_t out[FILE_SIZE];
+    TEST_ASSERT_EQUAL(200, transfer->request("firmware.bin", 0));
+    TEST_ASSERT_EQUAL(FILE_SIZE, transfer->contentLength());
+    TEST_ASSERT_EQUAL(FILE_SIZE, drain(out, sizeof(out), 1000));
+    TEST_ASSERT_EQUAL_MEMORY(file, out, FILE_SIZE);
+    TEST_ASSERT_EQUAL(1, broker.requests);
+    TEST_ASSERT_TRUE(broker.acks > 0);
+    TEST_ASSERT_FALSE(transfer->connected());
+}
+
+void test_resume_starts_at_offset(void) {
+    static uint8_t out[FILE_SIZE];
+    TEST_ASSERT_EQUAL(206, transfer->request("firmware.bin", 3000));
+    TEST_ASSERT_EQUAL(FILE_SIZE - 3000, drain(out, sizeof(out), 1000));
+    TEST_ASSERT_EQUAL_MEMORY(file + 3000, out, FILE_SIZE - 3000);
+}
+
+void test_lost_chunk_is_rerequested(void) {
+    static uint8_t out[FILE_SIZE];
+    broker.dropNext = 1;
+    TEST_ASSERT_EQUAL(200, transfer->request("firmware.bin", 0));
+    TEST_ASSERT_EQUAL(FILE_SIZE, drain(out, sizeof(out), 1000));
+    TEST_ASSERT_EQUAL_MEMORY(file, out, FILE_SIZE);
+    TEST_ASSERT_EQUAL(1, transfer->gaps());
+    TEST_ASSERT_EQUAL(1, transfer->rerequests());
+    TEST_ASSERT_EQUAL(2, broker.requests);
+}
+
+void test_duplicate_bytes_are_skipped(void) {
+    static uint8_t out[FILE_SIZE];
+    TEST_ASSERT_EQUAL(200, transfer->request("firmware.bin", 0));
+    
+    // The first chunk again, then one overlapping what is already held
+    uint8_t payload[OTA_MQTT_CHUNK_HEADER + 200];
+    FakeBroker::header(payload, 0, FILE_SIZE);
+    memcpy(payload + OTA_MQTT_CHUNK_HEADER, file, 200);
+    transfer->onChunk(payload, sizeof(payload));
+    FakeBroker::header(payload, OTA_MQTT_CHUNK - 100, FILE_SIZE);
+    memcpy(payload + OTA_MQTT_CHUNK_HEADER, file + OTA_MQTT_CHUNK - 100, 200);
+    transfer->onChunk(payload, sizeof(payload));
+    broker.offset = OTA_MQTT_CHUNK + 100;
+    
+    TEST_ASSERT_EQUAL(FILE_SIZE, drain(out, sizeof(out), 1000));
+    TEST_ASSERT_EQUAL_MEMORY(file, out, FILE_SIZE);
+    TEST_ASSERT_EQUAL(0, transfer->gaps());
+}
+
+void test_missing_file_is_404(void) {
+    broker.total = 0;
+    TEST_ASSERT_EQUAL(404, transfer->request("nothing.bin", 0));
+    TEST_ASSERT_FALSE(transfer->connected());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_file_arrives_in_order);
+    RUN_TEST(test_resume_starts_at_offset);
+    RUN_TEST(test_lost_chunk_is_rerequested);
+    RUN_TEST(test_duplicate_bytes_are_skipped);
+    RUN_TEST(test_missing_file_is_404);
+    return UNITY_END();
+}
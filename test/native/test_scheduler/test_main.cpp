@@ -0,0 +1,121 @@
+// Host tests for the cooperative scheduler behind loop(): pio test -e native
+
+#include <unity.h>
+#include "task_scheduler.h"
+#include "ota_platform.h"
+
+static TaskScheduler* scheduler;
+static int runsA;
+static int runsB;
+static int runsEvent;
+static bool readyFlag;
+static int wakeTarget;
+
+static void taskA() { runsA++; }
+static void taskB() { runsB++; }
+static void taskEvent() { runsEvent++; readyFlag = false; }
+static bool eventReady() { return readyFlag; }
+
+// Wakes another task from inside a task, like an MQTT route handler does
+static void taskWaker() { scheduler->wake(wakeTarget); }
+
+void setUp(void) {
+    scheduler = new TaskScheduler();
+    runsA = runsB = runsEvent = 0;
+    readyFlag = false;
+    wakeTarget = -1;
+}
+
+void tearDown(void) {
+    delete scheduler;
+}
+
+static void runFor(uint32_t ms) {
+    uint32_t start = otaMillis();
+    while (otaMillis() - start < ms) {
+        scheduler->run();
+    }
+}
+
+void test_periodic_tasks_run_on_their_period(void) {
+    scheduler->add("a", taskA, 10);
+    scheduler->add("b", taskB, 40);
+    runFor(205);
+    // The first pass runs both, then every period
+    TEST_ASSERT_TRUE(runsA >= 19 && runsA <= 22);
+    TEST_ASSERT_TRUE(runsB >= 5 && runsB <= 7);
+    // Most of the time is spent sleeping, not spinning
+    TEST_ASSERT_TRUE(scheduler->sleptMs() > 150);
+}
+
+void test_event_task_runs_only_when_woken(void) {
+    int id = scheduler->add("event", taskEvent, 0);
+    scheduler->add("a", taskA, 20);
+    runFor(50);
+    TEST_ASSERT_EQUAL(0, runsEvent);
+    
+    scheduler->wake(id);
+    scheduler->wake(id);  // one run for both
+    scheduler->run();
+    TEST_ASSERT_EQUAL(1, runsEvent);
+    TEST_ASSERT_EQUAL(1, scheduler->stats(id).lateRuns);
+    TEST_ASSERT_TRUE(scheduler->stats(id).lateMaxUs < 5000);
+}
+
+void test_wake_cuts_the_sleep_short(void) {
+    scheduler->add("slow", taskA, 300);
+    wakeTarget = scheduler->add("event", taskEvent, 0);
+    scheduler->add("waker", taskWaker, 0, []() { return runsEvent == 0; });
+    
+    // Slow and waker run; the wake ends the sleep long before slow is due
+    uint32_t start = otaMillis();
+    scheduler->run();
+    TEST_ASSERT_TRUE(otaMillis() - start < 100);
+    TEST_ASSERT_EQUAL(0, runsEvent);
+    scheduler->run();
+    TEST_ASSERT_EQUAL(1, runsEvent);
+}
+
+void test_ready_task_runs_without_a_deadline(void) {
+    scheduler->add("ready", taskEvent, 0, eventReady);
+    scheduler->add("slow", taskA, 50);
+    scheduler->run();
+    TEST_ASSERT_EQUAL(0, runsEvent);
+    
+    readyFlag = true;
+    scheduler->run();
+    TEST_ASSERT_EQUAL(1, runsEvent);
+    TEST_ASSERT_EQUAL(0, scheduler->stats(0).lateRuns);
+}
+
+void test_run_time_is_recorded(void) {
+    int id = scheduler->add("busy", []() { otaDelay(3); }, 5);
+    runFor(30);
+    const TaskStats& stats = scheduler->stats(id);
+    TEST_ASSERT_TRUE(stats.runs > 2);
+    TEST_ASSERT_TRUE(stats.runMaxUs >= 3000);
+    TEST_ASSERT_TRUE(stats.runTotalUs >= stats.runs * 3000);
+    
+    scheduler->resetStats();
+    TEST_ASSERT_EQUAL(0, scheduler->stats(id).runs);
+}
+
+void test_table_is_bounded(void) {
+    for (int i = 0; i < SCHEDULER_TASKS_MAX; i++) {
+        TEST_ASSERT_EQUAL(i, scheduler->add("t", taskA, 10));
+    }
+    TEST_ASSERT_EQUAL(-1, scheduler->add("full", taskA, 10));
+    TaskScheduler other;
+    TEST_ASSERT_EQUAL(-1, other.add("none", nullptr, 10));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_periodic_tasks_run_on_their_period);
+    RUN_TEST(test_event_task_runs_only_when_woken);
+    RUN_TEST(test_wake_cuts_the_sleep_short);
+    RUN_TEST(test_ready_task_runs_without_a_deadline);
+    RUN_TEST(test_run_time_is_recorded);
+    RUN_TEST(test_table_is_bounded);
+    return UNITY_END();
+}
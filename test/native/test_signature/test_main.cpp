@@ -0,0 +1,153 @@
+// Host tests for the signature backends: pio test -e native
+// Signatures come from OpenSSL with the development keys noted in config.h.
+
+#include <unity.h>
+#include <string.h>
+#include <stdlib.h>
+#include "ota_signature.h"
+#include "manifest_parser.h"
+
+#ifndef OPENSSL_SUPPRESS_DEPRECATED
+#define OPENSSL_SUPPRESS_DEPRECATED
+#endif
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
+#include <openssl/evp.h>
+#include <openssl/obj_mac.h>
+
+static const char* ED25519_SEED_HEX = "ba89c973ffb9836d7c3c9f0b6bc869455cdb6db33aa299c297fd1726f567abd9";
+static const char* ECDSA_PRIVATE_HEX = "984b7acf121ce406c80dcba44baa866a5a35f14c3cc9162edc49cd176f35a078";
+
+static void signEd25519(const uint8_t* digest, uint8_t* signature) {
+    uint8_t seed[32];
+    ManifestParser::hexToBytes(ED25519_SEED_HEX, seed, sizeof(seed));
+    EVP_PKEY* key = EVP_PKEY_new_raw_private_key(EVP_PKEY_ED25519, nullptr, seed, sizeof(seed));
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    size_t len = 64;
+    TEST_ASSERT_EQUAL(1, EVP_DigestSignInit(ctx, nullptr, nullptr, nullptr, key));
+    TEST_ASSERT_EQUAL(1, EVP_DigestSign(ctx, signature, &len, digest, 32));
+    EVP_MD_CTX_free(ctx);
+    EVP_PKEY_free(key);
+}
+
+static void signEcdsa(const uint8_t* digest, uint8_t* signature) {
+    EC_KEY* key = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+    BIGNUM* priv = nullptr;
+    BN_hex2bn(&priv, ECDSA_PRIVATE_HEX);
+    EC_KEY_set_private_key(key, priv);
+    ECDSA_SIG* sig = ECDSA_do_sign(digest, 32, key);
+    TEST_ASSERT_NOT_NULL(sig);
+    BN_bn2binpad(ECDSA_SIG_get0_r(sig), signature, 32);
+    BN_bn2binpad(ECDSA_SIG_get0_s(sig), signature + 32, 32);
+    ECDSA_SIG_free(sig);
+    BN_free(priv);
+    EC_KEY_free(key);
+}
+
+static void randomDigest(uint8_t* digest) {
+    for (int i = 0; i < 32; i++) {
+        digest[i] = (uint8_t)rand();
+    }
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_keys_decode_at_compile_time(void) {
+    static_assert(OTA_ED25519_KEY.bytes[0] == 0x0b && OTA_ED25519_KEY.bytes[31] == 0xd8, "PUBLIC_KEY_HEX");
+    static_assert(OTA_ECDSA_P256_KEY.bytes[0] == 0x04, "ECDSA_PUBLIC_KEY_HEX");
+    
+    uint8_t key[65];
+    TEST_ASSERT_EQUAL(32, ManifestParser::hexToBytes(PUBLIC_KEY_HEX, key, 32));
+    TEST_ASSERT_EQUAL_MEMORY(key, OTA_ED25519_KEY.bytes, 32);
+    TEST_ASSERT_EQUAL(65, ManifestParser::hexToBytes(ECDSA_PUBLIC_KEY_HEX, key, 65));
+    TEST_ASSERT_EQUAL_MEMORY(key, OTA_ECDSA_P256_KEY.bytes, 65);
+}
+
+void test_ed25519_backends_accept_valid_signatures(void) {
+    Ed25519Backend reference(OTA_ED25519_KEY.bytes);
+    Ed25519FastBackend fast;
+    uint8_t digest[32];
+    uint8_t signature[64];
+    
+    srand(1);
+    for (int i = 0; i < 64; i++) {
+        randomDigest(digest);
+        signEd25519(digest, signature);
+        TEST_ASSERT_TRUE(reference.verify(digest, sizeof(digest), signature));
+        TEST_ASSERT_TRUE(fast.verify(digest, sizeof(digest), signature));
+    }
+}
+
+void test_ed25519_fast_rejects_tampering(void) {
+    Ed25519FastBackend fast;
+    uint8_t digest[32];
+    uint8_t signature[64];
+    
+    srand(2);
+    for (int bit = 0; bit < 8 * 96; bit += 7) {
+        randomDigest(digest);
+        signEd25519(digest, signature);
+        if (bit < 8 * 64) {
+            signature[bit / 8] ^= 1 << (bit % 8);
+        } else {
+            digest[bit / 8 - 64] ^= 1 << (bit % 8);
+        }
+        TEST_ASSERT_FALSE(fast.verify(digest, sizeof(digest), signature));
+    }
+}
+
+void test_ed25519_fast_rejects_non_canonical_s(void) {
+    static const uint8_t L[32] = {
+        0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x10
+    };
+    Ed25519FastBackend fast;
+    uint8_t digest[32];
+    uint8_t signature[64];
+    randomDigest(digest);
+    signEd25519(digest, signature);
+    
+    // S + L is the same scalar mod L
+    unsigned carry = 0;
+    for (int i = 0; i < 32; i++) {
+        carry += signature[32 + i] + L[i];
+        signature[32 + i] = (uint8_t)carry;
+        carry >>= 8;
+    }
+    TEST_ASSERT_FALSE(fast.verify(digest, sizeof(digest), signature));
+}
+
+void test_ecdsa_p256(void) {
+    EcdsaP256Backend ecdsa(OTA_ECDSA_P256_KEY.bytes);
+    uint8_t digest[32];
+    uint8_t signature[64];
+    
+    srand(3);
+    for (int i = 0; i < 16; i++) {
+        randomDigest(digest);
+        signEcdsa(digest, signature);
+        TEST_ASSERT_TRUE(ecdsa.verify(digest, sizeof(digest), signature));
+        digest[i] ^= 0x01;
+        TEST_ASSERT_FALSE(ecdsa.verify(digest, sizeof(digest), signature));
+    }
+}
+
+void test_selected_backend_matches_algorithm(void) {
+    TEST_ASSERT_EQUAL_STRING(FIRMWARE_ALGORITHM, otaSignatureBackend().name());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_keys_decode_at_compile_time);
+    RUN_TEST(test_ed25519_backends_accept_valid_signatures);
+    RUN_TEST(test_ed25519_fast_rejects_tampering);
+    RUN_TEST(test_ed25519_fast_rejects_non_canonical_s);
+    RUN_TEST(test_ecdsa_p256);
+    RUN_TEST(test_selected_backend_matches_algorithm);
+    return UNITY_END();
+}
@@ -8,6 +8,7 @@ import os
 import sys
 import json
 import hashlib
+import struct
 import subprocess
 from datetime import datetime
 
@@ -78,6 +79,13 @@ def main():
     print("⚠️  NOTE: Actual signing requires ED25519_PRIVATE_KEY_HEX")
     print("⚠️  In GitHub Actions, this comes from GitHub Secrets")
     
+    # Canonical manifest fields signed for manifest_signature (src/manifest_parser.h)
+    image_url = "firmware-otaq.bin"
+    canonical = (b"OTAM1" + bytes([len(firmware_version)]) + firmware_version.encode() +
+                 bytes.fromhex(fw_hash) + struct.pack("<I", fw_size) +
+                 bytes([len(image_url)]) + image_url.encode())
+    canonical_digest = hashlib.sha256(canonical).digest()
+    
     # Check if pynacl is installed
     try:
         from nacl.signing import SigningKey
@@ -90,22 +98,28 @@ def main():
             seed = bytes.fromhex(private_key_hex)
             sk = SigningKey(seed)
             signature = sk.sign(bytes.fromhex(fw_hash)).signature.hex()
+            manifest_signature = sk.sign(canonical_digest).signature.hex()
             print(f"✅ Signature: {signature[:32]}...{signature[-32:]}")
         else:
             print("⚠️  ED25519_PRIVATE_KEY_HEX not set, generating test key")
             sk = SigningKey.generate()
             signature = sk.sign(bytes.fromhex(fw_hash)).signature.hex()
+            manifest_signature = sk.sign(canonical_digest).signature.hex()
             print(f"✅ Test Signature: {signature[:32]}...{signature[-32:]}")
             print(f"🔑 Test Public Key: {sk.verify_key.encode().hex()}")
     except ImportError:
         print("❌ pynacl not installed, using dummy signature")
         signature = "0" * 128
+        manifest_signature = "0" * 128
     
     # Step 7: Create manifest
     print("\n📄 Step 7: Create manifest.json")
     manifest = {
         "version": firmware_version,
         "hash": fw_hash,
+        "size": fw_size,
+        "url": image_url,
+        "manifest_signature": manifest_signature,
         "signature": signature
     }
     
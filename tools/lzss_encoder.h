@@ -0,0 +1,104 @@
+// LZSS encoder for the stream format in src/lzss_decoder.h (host only).
+
+#ifndef LZSS_ENCODER_H
+#define LZSS_ENCODER_H
+
+#include "lzss_decoder.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+class LzssEncoder {
+public:
+    LzssEncoder(uint8_t windowBits, uint8_t lookaheadBits, int maxChain = 256)
+        : _windowBits(windowBits), _lookaheadBits(lookaheadBits), _maxChain(maxChain) {}
+
+    std::vector<uint8_t> encode(const std::vector<uint8_t>& in) {
+        _out.assign(LZSS_MAGIC, LZSS_MAGIC + 4);
+        _out.push_back(_windowBits);
+        _out.push_back(_lookaheadBits);
+        _out.push_back(0);
+        _out.push_back(0);
+        for (int i = 0; i < 4; i++) _out.push_back((uint8_t)(in.size() >> (8 * i)));
+        _bitByte = 0;
+        _bitCount = 0;
+
+        const size_t window = (size_t)1 << _windowBits;
+        const size_t maxLen = (size_t)1 << _lookaheadBits;
+        // A back-reference only pays off once it beats the same bytes as literals
+        const size_t refBits = 1 + _windowBits + _lookaheadBits;
+        size_t minLen = refBits / 9 + 1;
+        if (minLen < 2) minLen = 2;
+
+        std::vector<int32_t> head(65536, -1);
+        std::vector<int32_t> prev(in.size(), -1);
+
+        size_t pos = 0;
+        while (pos < in.size()) {
+            size_t bestLen = 0, bestDist = 0;
+            if (pos + 1 < in.size()) {
+                int chain = _maxChain;
+                for (int32_t cand = head[key(in, pos)]; cand >= 0 && chain-- > 0; cand = prev[cand]) {
+                    size_t dist = pos - cand;
+                    if (dist > window) break;
+                    size_t len = 0;
+                    while (len < maxLen && pos + len < in.size() && in[cand + len] == in[pos + len]) len++;
+                    if (len > bestLen) {
+                        bestLen = len;
+                        bestDist = dist;
+                        if (len == maxLen) break;
+                    }
+                }
+            }
+
+            size_t advance;
+            if (bestLen >= minLen) {
+                putBits(0, 1);
+                putBits((uint32_t)(bestDist - 1), _windowBits);
+                putBits((uint32_t)(bestLen - 1), _lookaheadBits);
+                advance = bestLen;
+            } else {
+                putBits(1, 1);
+                putBits(in[pos], 8);
+                advance = 1;
+            }
+
+            for (size_t i = 0; i < advance; i++, pos++) {
+                if (pos + 1 < in.size()) {
+                    uint16_t k = key(in, pos);
+                    prev[pos] = head[k];
+                    head[k] = (int32_t)pos;
+                }
+            }
+        }
+
+        if (_bitCount > 0) _out.push_back((uint8_t)(_bitByte << (8 - _bitCount)));
+        return _out;
+    }
+
+private:
+    uint8_t _windowBits;
+    uint8_t _lookaheadBits;
+    int _maxChain;
+    std::vector<uint8_t> _out;
+    uint8_t _bitByte;
+    uint8_t _bitCount;
+
+    static uint16_t key(const std::vector<uint8_t>& in, size_t pos) {
+        return (uint16_t)(in[pos] << 8 | in[pos + 1]);
+    }
+
+    void putBits(uint32_t value, uint8_t count) {
+        while (count-- > 0) {
+            _bitByte = (uint8_t)((_bitByte << 1) | ((value >> count) & 1));
+            if (++_bitCount == 8) {
+                _out.push_back(_bitByte);
+                _bitByte = 0;
+                _bitCount = 0;
+            }
+        }
+    }
+};
+
+#endif // LZSS_ENCODER_H
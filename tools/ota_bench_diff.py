@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""
+Compare two OTA benchmark runs (src/bench/main.cpp output).
+
+Every line that parses as an ota/metrics JSON object counts, so raw serial
+monitor captures work as-is. Stages slower than the threshold, or with more
+heap in use, are flagged and the exit status is 1.
+
+Usage: python3 tools/ota_bench_diff.py baseline.jsonl candidate.jsonl [--threshold 10]
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    results = {}
+    with open(path, errors="replace") as f:
+        for line in f:
+            line = line.strip()
+            start = line.find("{")
+            if start < 0:
+                continue
+            try:
+                metric = json.loads(line[start:])
+            except json.JSONDecodeError:
+                continue
+            if "stage" in metric and "elapsed_us" in metric:
+                results[metric["stage"]] = metric
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("candidate")
+    parser.add_argument("--threshold", type=float, default=10.0, help="allowed slowdown in percent")
+    args = parser.parse_args()
+
+    base = load(args.baseline)
+    cand = load(args.candidate)
+    if not base or not cand:
+        print("✗ No benchmark results found")
+        sys.exit(1)
+
+    print(f"{'stage':24s} {'base us':>10s} {'new us':>10s} {'change':>8s} {'heap delta':>11s}")
+    regressions = 0
+    for stage in sorted(set(base) | set(cand)):
+        if stage not in base or stage not in cand:
+            print(f"{stage:24s} {'only in ' + ('baseline' if stage in base else 'candidate'):>41s}")
+            continue
+        b, c = base[stage], cand[stage]
+        change = (c["elapsed_us"] - b["elapsed_us"]) * 100.0 / max(b["elapsed_us"], 1)
+        # free_heap drops when a kernel holds more memory
+        heap_delta = b["free_heap"] - c["free_heap"]
+        slower = change > args.threshold
+        regressions += slower or heap_delta > 0
+        mark = "✗" if slower or heap_delta > 0 else " "
+        print(f"{stage:24s} {b['elapsed_us']:10d} {c['elapsed_us']:10d} {change:+7.1f}% {heap_delta:+11d} {mark}")
+
+    print(f"{b.get('version', '?')} -> {c.get('version', '?')}")
+    if regressions:
+        print(f"✗ {regressions} stage(s) regressed (>{args.threshold:.0f}% slower or more heap)")
+        sys.exit(1)
+    print("✓ No regressions")
+
+
+if __name__ == "__main__":
+    main()
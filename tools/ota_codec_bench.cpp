@@ -0,0 +1,203 @@
+// Host benchmark for firmware compression codecs.
+//
+// Build:  g++ -O2 -std=c++17 -Isrc -Itools -o ota_codec_bench tools/ota_codec_bench.cpp src/lzss_decoder.cpp -lz
+// Usage:  ota_codec_bench <firmware.bin> [iterations]
+//
+// Every codec is decoded the way the device does it: input in
+// OTA_DOWNLOAD_BUFFER sized pieces, output consumed in place. Peak heap is the
+// largest amount of decoder memory live at once (window + state for LZSS,
+// everything zlib allocates through zalloc for gzip).
+
+#include "lzss_encoder.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+typedef std::vector<uint8_t> Bytes;
+
+static const size_t CHUNK = 512;  // OTA_DOWNLOAD_BUFFER
+
+struct Result {
+    size_t packedSize;
+    double mbPerSec;
+    size_t peakHeap;
+};
+
+static double elapsedSeconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// --- identity -----------------------------------------------------------------
+
+static Result benchNone(const Bytes& image, int iterations) {
+    uint8_t sink[CHUNK];
+    volatile uint8_t guard = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t pos = 0; pos < image.size(); pos += CHUNK) {
+            size_t n = image.size() - pos < CHUNK ? image.size() - pos : CHUNK;
+            memcpy(sink, &image[pos], n);
+            guard ^= sink[0];
+        }
+    }
+    double secs = elapsedSeconds(start);
+    return {image.size(), image.size() * (double)iterations / secs / 1e6, 0};
+}
+
+// --- LZSS -----------------------------------------------------------------------
+
+struct CountingSink {
+    size_t bytes;
+    uint32_t mix;
+};
+
+static bool countOutput(void* ctx, const uint8_t* data, size_t len) {
+    CountingSink* sink = (CountingSink*)ctx;
+    sink->bytes += len;
+    sink->mix += data[0] + data[len - 1];
+    return true;
+}
+
+static Result benchLzss(const Bytes& image, int windowBits, int lookaheadBits, int iterations) {
+    Bytes packed = LzssEncoder((uint8_t)windowBits, (uint8_t)lookaheadBits).encode(image);
+
+    CountingSink sink = {0, 0};
+    LzssDecoder decoder(countOutput, &sink);
+    size_t peakHeap = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; it++) {
+        decoder.reset();
+        sink.bytes = 0;
+        for (size_t pos = 0; pos < packed.size(); pos += CHUNK) {
+            size_t n = packed.size() - pos < CHUNK ? packed.size() - pos : CHUNK;
+            if (!decoder.feed(&packed[pos], n)) {
+                fprintf(stderr, "lzss decode failed: %s\n", decoder.error());
+                exit(1);
+            }
+        }
+        if (!decoder.finished() || sink.bytes != image.size()) {
+            fprintf(stderr, "lzss decode incomplete\n");
+            exit(1);
+        }
+        peakHeap = decoder.windowSize() + sizeof(LzssDecoder);
+    }
+    double secs = elapsedSeconds(start);
+    return {packed.size(), image.size() * (double)iterations / secs / 1e6, peakHeap};
+}
+
+// --- gzip (zlib inflate) ------------------------------------------------------
+
+struct HeapTracker {
+    size_t live;
+    size_t peak;
+};
+
+static voidpf trackedAlloc(voidpf opaque, uInt items, uInt size) {
+    HeapTracker* heap = (HeapTracker*)opaque;
+    size_t bytes = (size_t)items * size;
+    size_t* block = (size_t*)malloc(bytes + sizeof(size_t));
+    if (!block) return Z_NULL;
+    *block = bytes;
+    heap->live += bytes;
+    if (heap->live > heap->peak) heap->peak = heap->live;
+    return block + 1;
+}
+
+static void trackedFree(voidpf opaque, voidpf address) {
+    HeapTracker* heap = (HeapTracker*)opaque;
+    size_t* block = (size_t*)address - 1;
+    heap->live -= *block;
+    free(block);
+}
+
+static Result benchGzip(const Bytes& image, int windowBits, int iterations) {
+    // windowBits + 16 selects the gzip wrapper
+    z_stream def;
+    memset(&def, 0, sizeof(def));
+    deflateInit2(&def, 9, Z_DEFLATED, windowBits + 16, 8, Z_DEFAULT_STRATEGY);
+    Bytes packed(deflateBound(&def, image.size()));
+    def.next_in = (Bytef*)image.data();
+    def.avail_in = image.size();
+    def.next_out = packed.data();
+    def.avail_out = packed.size();
+    deflate(&def, Z_FINISH);
+    packed.resize(def.total_out);
+    deflateEnd(&def);
+
+    HeapTracker heap = {0, 0};
+    uint8_t out[CHUNK];
+    uint32_t mix = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; it++) {
+        z_stream inf;
+        memset(&inf, 0, sizeof(inf));
+        inf.zalloc = trackedAlloc;
+        inf.zfree = trackedFree;
+        inf.opaque = &heap;
+        inflateInit2(&inf, windowBits + 16);
+
+        int rc = Z_OK;
+        for (size_t pos = 0; pos < packed.size() && rc != Z_STREAM_END; pos += CHUNK) {
+            inf.next_in = &packed[pos];
+            inf.avail_in = packed.size() - pos < CHUNK ? packed.size() - pos : CHUNK;
+            while (inf.avail_in > 0 && rc != Z_STREAM_END) {
+                inf.next_out = out;
+                inf.avail_out = sizeof(out);
+                rc = inflate(&inf, Z_NO_FLUSH);
+                if (rc != Z_OK && rc != Z_STREAM_END) {
+                    fprintf(stderr, "inflate failed: %d\n", rc);
+                    exit(1);
+                }
+                mix += out[0];
+            }
+        }
+        if (inf.total_out != image.size()) {
+            fprintf(stderr, "inflate incomplete\n");
+            exit(1);
+        }
+        inflateEnd(&inf);
+    }
+    double secs = elapsedSeconds(start);
+    return {packed.size(), image.size() * (double)iterations / secs / 1e6, heap.peak + sizeof(z_stream)};
+}
+
+static void report(const char* codec, int window, const Result& r, size_t imageSize) {
+    printf("%-6s %7d %10zu %7.1f%% %10.1f %10zu\n",
+           codec, window, r.packedSize, 100.0 * r.packedSize / imageSize, r.mbPerSec, r.peakHeap);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <firmware.bin> [iterations]\n", argv[0]);
+        return 2;
+    }
+    int iterations = argc > 2 ? atoi(argv[2]) : 20;
+
+    FILE* f = fopen(argv[1], "rb");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return 1;
+    }
+    Bytes image;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) image.insert(image.end(), chunk, chunk + n);
+    fclose(f);
+
+    printf("image=%zu bytes, %d iterations, %zu byte input chunks\n\n", image.size(), iterations, CHUNK);
+    printf("%-6s %7s %10s %8s %10s %10s\n", "codec", "window", "bytes", "ratio", "MB/s", "peak_heap");
+
+    report("none", 0, benchNone(image, iterations), image.size());
+    for (int w = 8; w <= LZSS_MAX_WINDOW_BITS; w++) {
+        report("lzss", 1 << w, benchLzss(image, w, 4, iterations), image.size());
+    }
+    for (int w = 9; w <= 15; w++) {
+        report("gzip", 1 << w, benchGzip(image, w, iterations), image.size());
+    }
+    return 0;
+}
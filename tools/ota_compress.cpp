@@ -0,0 +1,74 @@
+// Compresses a firmware image into the LZSS stream the device decodes inline.
+//
+// Build:  g++ -O2 -std=c++17 -Isrc -o ota_compress tools/ota_compress.cpp src/lzss_decoder.cpp
+// Usage:  ota_compress [-w window_bits] [-l lookahead_bits] <in.bin> <out.lzs>
+//
+// Defaults (-w 10 -l 4) keep the device-side window at 1 KB. Every output is
+// decoded again with LzssDecoder before it is written.
+
+#include "lzss_encoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef std::vector<uint8_t> Bytes;
+
+static bool appendOut(void* ctx, const uint8_t* data, size_t len) {
+    Bytes* out = (Bytes*)ctx;
+    out->insert(out->end(), data, data + len);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int windowBits = 10;
+    int lookaheadBits = 4;
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-w") == 0) windowBits = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "-l") == 0) lookaheadBits = atoi(argv[arg + 1]);
+        else break;
+        arg += 2;
+    }
+    if (argc - arg != 2) {
+        fprintf(stderr, "usage: %s [-w window_bits] [-l lookahead_bits] <in.bin> <out.lzs>\n", argv[0]);
+        return 2;
+    }
+    if (windowBits < LZSS_MIN_WINDOW_BITS || windowBits > LZSS_MAX_WINDOW_BITS ||
+        lookaheadBits < 1 || lookaheadBits > LZSS_MAX_LOOKAHEAD_BITS || lookaheadBits >= windowBits) {
+        fprintf(stderr, "window bits must be %d..%d and lookahead bits 1..%d, below the window\n",
+                LZSS_MIN_WINDOW_BITS, LZSS_MAX_WINDOW_BITS, LZSS_MAX_LOOKAHEAD_BITS);
+        return 2;
+    }
+
+    FILE* f = fopen(argv[arg], "rb");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", argv[arg]);
+        return 1;
+    }
+    Bytes in;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) in.insert(in.end(), chunk, chunk + n);
+    fclose(f);
+
+    Bytes packed = LzssEncoder((uint8_t)windowBits, (uint8_t)lookaheadBits).encode(in);
+
+    Bytes check;
+    LzssDecoder decoder(appendOut, &check);
+    if (!decoder.feed(packed.data(), packed.size()) || !decoder.finished() || check != in) {
+        fprintf(stderr, "self-check failed: %s\n", decoder.error() ? decoder.error() : "output differs");
+        return 1;
+    }
+
+    f = fopen(argv[arg + 1], "wb");
+    if (!f || fwrite(packed.data(), 1, packed.size(), f) != packed.size()) {
+        fprintf(stderr, "cannot write %s\n", argv[arg + 1]);
+        return 1;
+    }
+    fclose(f);
+
+    printf("in=%zu out=%zu (%.1f%%) window=%d lookahead=%d\n",
+           in.size(), packed.size(), 100.0 * packed.size() / in.size(), windowBits, lookaheadBits);
+    return 0;
+}
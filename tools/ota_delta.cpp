@@ -0,0 +1,239 @@
+// Host-side delta generator for OTA firmware images.
+//
+// Build:  g++ -O2 -std=c++17 -Isrc -o ota_delta tools/ota_delta.cpp src/delta_patch.cpp
+// Usage:  ota_delta diff  <base.bin> <target.bin> <out.patch>
+//         ota_delta apply <base.bin> <in.patch>   <out.bin>
+//
+// The patch format is documented in src/delta_patch.h. Every generated patch
+// is applied again with the device-side DeltaPatch before it is written, so
+// CI never publishes a patch the firmware cannot rebuild.
+
+#include "delta_patch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+// Shortest run worth a COPY op (op + two varints is at most 11 bytes)
+static const size_t MIN_MATCH = 12;
+// Bytes hashed to find match candidates in the base image
+static const size_t KEY_LEN = 8;
+// Candidates remembered per key; firmware has many repeated byte runs
+static const size_t MAX_CANDIDATES = 32;
+
+static bool readFile(const char* path, Bytes& out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    out.resize(size);
+    bool ok = fread(out.data(), 1, size, f) == (size_t)size;
+    fclose(f);
+    return ok;
+}
+
+static bool writeFile(const char* path, const Bytes& data) {
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "cannot create %s\n", path);
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    fclose(f);
+    return ok;
+}
+
+static void putVarint(Bytes& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static void putU32(Bytes& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+static uint64_t keyAt(const Bytes& data, size_t pos) {
+    uint64_t key;
+    memcpy(&key, &data[pos], KEY_LEN);
+    return key;
+}
+
+class DeltaEncoder {
+public:
+    DeltaEncoder(const Bytes& base, const Bytes& target) : _base(base), _target(target), _copyEnd(0) {
+        for (size_t pos = 0; pos + KEY_LEN <= base.size(); pos++) {
+            std::vector<uint32_t>& list = _index[keyAt(base, pos)];
+            if (list.size() < MAX_CANDIDATES) list.push_back((uint32_t)pos);
+        }
+    }
+
+    Bytes encode() {
+        Bytes patch(DELTA_MAGIC, DELTA_MAGIC + 4);
+        putU32(patch, (uint32_t)_base.size());
+        putU32(patch, (uint32_t)_target.size());
+
+        size_t literalStart = 0;
+        size_t pos = 0;
+        while (pos < _target.size()) {
+            size_t src = 0;
+            size_t len = longestMatch(pos, src);
+            if (len < MIN_MATCH) {
+                pos++;
+                continue;
+            }
+
+            // Grow the match backwards into bytes that would otherwise be literals
+            while (pos > literalStart && src > 0 && _target[pos - 1] == _base[src - 1]) {
+                pos--;
+                src--;
+                len++;
+            }
+
+            emitInsert(patch, literalStart, pos);
+            emitCopy(patch, src, len);
+            pos += len;
+            literalStart = pos;
+        }
+        emitInsert(patch, literalStart, _target.size());
+        patch.push_back(DELTA_OP_END);
+        return patch;
+    }
+
+private:
+    const Bytes& _base;
+    const Bytes& _target;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> _index;
+    size_t _copyEnd;
+
+    size_t matchLength(size_t pos, size_t src) const {
+        size_t len = 0;
+        while (pos + len < _target.size() && src + len < _base.size() && _target[pos + len] == _base[src + len]) {
+            len++;
+        }
+        return len;
+    }
+
+    size_t longestMatch(size_t pos, size_t& bestSrc) const {
+        size_t bestLen = 0;
+
+        // Continuing right after the previous copy keeps the offset varint at one byte
+        if (_copyEnd < _base.size()) {
+            bestLen = matchLength(pos, _copyEnd);
+            bestSrc = _copyEnd;
+        }
+
+        if (pos + KEY_LEN > _target.size()) return bestLen;
+        auto it = _index.find(keyAt(_target, pos));
+        if (it == _index.end()) return bestLen;
+
+        for (uint32_t src : it->second) {
+            size_t len = matchLength(pos, src);
+            if (len > bestLen) {
+                bestLen = len;
+                bestSrc = src;
+            }
+        }
+        return bestLen;
+    }
+
+    void emitInsert(Bytes& patch, size_t from, size_t to) {
+        if (to <= from) return;
+        patch.push_back(DELTA_OP_INSERT);
+        putVarint(patch, (uint32_t)(to - from));
+        patch.insert(patch.end(), _target.begin() + from, _target.begin() + to);
+    }
+
+    void emitCopy(Bytes& patch, size_t src, size_t len) {
+        int32_t delta = (int32_t)src - (int32_t)_copyEnd;
+        patch.push_back(DELTA_OP_COPY);
+        putVarint(patch, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+        putVarint(patch, (uint32_t)len);
+        _copyEnd = src + len;
+    }
+};
+
+struct ApplyContext {
+    const Bytes* base;
+    Bytes* out;
+};
+
+static bool readBase(void* ctx, uint32_t offset, uint8_t* out, size_t len) {
+    const Bytes& base = *((ApplyContext*)ctx)->base;
+    if (offset + len > base.size()) return false;
+    memcpy(out, &base[offset], len);
+    return true;
+}
+
+static bool writeOut(void* ctx, const uint8_t* data, size_t len) {
+    Bytes& out = *((ApplyContext*)ctx)->out;
+    out.insert(out.end(), data, data + len);
+    return true;
+}
+
+static bool applyPatch(const Bytes& base, const Bytes& patch, Bytes& out) {
+    ApplyContext ctx = {&base, &out};
+    DeltaPatch applier(readBase, writeOut, &ctx);
+
+    // Feed in small pieces, the way the device receives it from the socket
+    for (size_t pos = 0; pos < patch.size(); pos += 512) {
+        size_t n = patch.size() - pos < 512 ? patch.size() - pos : 512;
+        if (!applier.feed(&patch[pos], n)) {
+            fprintf(stderr, "patch rejected: %s\n", applier.error());
+            return false;
+        }
+    }
+    if (!applier.finished()) {
+        fprintf(stderr, "patch truncated\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 5) {
+        fprintf(stderr, "usage: %s diff <base> <target> <patch>\n", argv[0]);
+        fprintf(stderr, "       %s apply <base> <patch> <target>\n", argv[0]);
+        return 2;
+    }
+
+    std::string cmd = argv[1];
+    Bytes base, input;
+    if (!readFile(argv[2], base) || !readFile(argv[3], input)) return 1;
+
+    if (cmd == "diff") {
+        Bytes patch = DeltaEncoder(base, input).encode();
+
+        Bytes rebuilt;
+        if (!applyPatch(base, patch, rebuilt) || rebuilt != input) {
+            fprintf(stderr, "self-check failed: patch does not rebuild target\n");
+            return 1;
+        }
+        if (!writeFile(argv[4], patch)) return 1;
+
+        printf("base=%zu target=%zu patch=%zu (%.1f%% of full image)\n",
+               base.size(), input.size(), patch.size(), 100.0 * patch.size() / input.size());
+        return 0;
+    }
+
+    if (cmd == "apply") {
+        Bytes out;
+        if (!applyPatch(base, input, out) || !writeFile(argv[4], out)) return 1;
+        printf("rebuilt %zu bytes\n", out.size());
+        return 0;
+    }
+
+    fprintf(stderr, "unknown command %s\n", cmd.c_str());
+    return 2;
+}
@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+"""
+Serve release files to devices over MQTT ("mqtt:<file>" manifest URLs).
+
+Answers MQTT_TOPIC_FW_REQUEST with chunk messages on MQTT_TOPIC_FW_CHUNK
+(offset u32 LE | total u32 LE | data), never past the limit the device grants
+in the request or on MQTT_TOPIC_FW_ACK. A new request restarts the stream at
+its offset, which is how the device recovers lost chunks.
+
+With --bench, signed manifests are published one after the other as MQTT
+triggers (give them ascending versions, alternating http and mqtt URLs). The
+stream_firmware records on ota/metrics are tabulated per transport, so the
+transfer over the MQTT connection can be compared with a second TLS
+connection to the OTA server for throughput and heap low point.
+
+Needs paho-mqtt (pip install paho-mqtt).
+
+Usage: python3 tools/ota_mqtt_server.py --dir build/ [--host broker] [--port 1883]
+                                        [-u user -P pass] [--tls]
+                                        [--bench m1.json m2.json ...] [--device 002]
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+REQUEST_TOPIC = "device/+/ota/fw/request"
+ACK_TOPIC = "device/+/ota/fw/ack"
+METRICS_TOPIC = "ota/metrics"
+
+
+class Stream:
+    def __init__(self, data, offset, limit, chunk):
+        self.data = data
+        self.offset = offset
+        self.limit = limit
+        self.chunk = chunk
+
+
+class FirmwareServer:
+    def __init__(self, client, directory):
+        self.client = client
+        self.directory = directory
+        self.streams = {}
+        self.lock = threading.Condition()
+
+    def on_request(self, device_topic, payload):
+        request = json.loads(payload)
+        name = os.path.basename(request["file"])
+        path = os.path.join(self.directory, name)
+        chunk_topic = device_topic + "/chunk"
+        print(f"[SERVER] {device_topic}: {name} from {request['offset']}")
+        if not os.path.isfile(path):
+            self.client.publish(chunk_topic, struct.pack("<II", 0, 0))
+            return
+        with open(path, "rb") as f:
+            data = f.read()
+        with self.lock:
+            self.streams[chunk_topic] = Stream(data, request["offset"], request["limit"], request["chunk"])
+            self.lock.notify()
+
+    def on_ack(self, device_topic, payload):
+        with self.lock:
+            stream = self.streams.get(device_topic + "/chunk")
+            if stream:
+                stream.limit = max(stream.limit, int(payload))
+                self.lock.notify()
+
+    def run(self):
+        while True:
+            with self.lock:
+                ready = [(t, s) for t, s in self.streams.items()
+                         if s.offset < min(s.limit, len(s.data))]
+                if not ready:
+                    self.lock.wait(1.0)
+                    continue
+                sends = []
+                for topic, s in ready:
+                    end = min(s.offset + s.chunk, s.limit, len(s.data))
+                    sends.append((topic, struct.pack("<II", s.offset, len(s.data)) + s.data[s.offset:end]))
+                    s.offset = end
+            for topic, payload in sends:
+                self.client.publish(topic, payload, qos=0)
+
+
+class Bench:
+    def __init__(self, client, device, manifests):
+        self.client = client
+        self.trigger_topic = f"device/{device}/ota/update"
+        self.manifests = manifests
+        self.results = []
+        self.event = threading.Event()
+        self.pending = None
+
+    def on_metrics(self, payload):
+        try:
+            batch = json.loads(payload)
+        except (json.JSONDecodeError, UnicodeDecodeError):
+            return
+        for stage in batch.get("stages", []):
+            if stage.get("stage") == "stream_firmware" and self.pending:
+                self.results.append((self.pending, stage))
+                self.pending = None
+            elif stage.get("stage") == "update_timeline":
+                self.event.set()
+
+    def run(self, timeout):
+        for path in self.manifests:
+            with open(path, "rb") as f:
+                manifest = f.read()
+            self.pending = json.loads(manifest)["url"]
+            self.event.clear()
+            print(f"[BENCH] Triggering {path} ({self.pending})")
+            self.client.publish(self.trigger_topic, manifest, qos=1)
+            # The device reports update_timeline once it is back on the new image
+            if not self.event.wait(timeout):
+                print(f"[BENCH] No update_timeline within {timeout} s, skipping")
+        self.report()
+
+    def report(self):
+        print(f"{'url':32s} {'transport':9s} {'bytes/s':>10s} {'min heap':>9s} {'elapsed ms':>11s} {'gaps':>5s}")
+        for url, stage in self.results:
+            print(f"{url:32s} {stage.get('transport', '?'):9s} {stage.get('bytes_per_sec', 0):10d} "
+                  f"{stage.get('min_free_heap', 0):9d} {stage.get('elapsed_ms', 0):11d} "
+                  f"{stage.get('mqtt_gaps', 0):5d}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--dir", default=".", help="directory with the release files")
+    parser.add_argument("--host", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("-u", "--user")
+    parser.add_argument("-P", "--password")
+    parser.add_argument("--tls", action="store_true")
+    parser.add_argument("--bench", nargs="+", metavar="MANIFEST", help="signed manifests to trigger in turn")
+    parser.add_argument("--device", default="002")
+    parser.add_argument("--timeout", type=float, default=300, help="seconds to wait for each update")
+    args = parser.parse_args()
+
+    try:
+        client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION2)
+    except AttributeError:
+        client = mqtt.Client()  # paho-mqtt 1.x
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    if args.tls:
+        client.tls_set()
+
+    server = FirmwareServer(client, args.dir)
+    bench = Bench(client, args.device, args.bench) if args.bench else None
+
+    def on_connect(client, userdata, *rest):
+        client.subscribe([(REQUEST_TOPIC, 1), (ACK_TOPIC, 1), (METRICS_TOPIC, 0)])
+        print(f"[SERVER] Connected to {args.host}:{args.port}, serving {os.path.abspath(args.dir)}")
+
+    def on_message(client, userdata, msg):
+        if msg.topic.endswith("/fw/request"):
+            server.on_request(msg.topic.rsplit("/", 1)[0], msg.payload)
+        elif msg.topic.endswith("/fw/ack"):
+            server.on_ack(msg.topic.rsplit("/", 1)[0], msg.payload)
+        elif msg.topic == METRICS_TOPIC and bench:
+            bench.on_metrics(msg.payload)
+
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    client.loop_start()
+    threading.Thread(target=server.run, daemon=True).start()
+
+    try:
+        if bench:
+            time.sleep(1)
+            bench.run(args.timeout)
+        else:
+            while True:
+                time.sleep(1)
+    except KeyboardInterrupt:
+        pass
+    client.loop_stop()
+    sys.exit(0)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,6 +1,7 @@
 Import("env")
 import subprocess
 import os
+import sys
 from datetime import datetime
 
 # ==== Handle firmware version from CI/CD ====
@@ -38,7 +39,17 @@ if not firmware_algorithm:
 
 print(f"Using firmware algorithm: {firmware_algorithm}")
 
+# Signature backend per algorithm, see OTA_SIG_* in src/ota_signature.h
+algorithm_ids = {
+    "ed25519": 1,
+    "ed25519-fast": 2,
+    "ecdsa-p256": 3,
+}
+if firmware_algorithm not in algorithm_ids:
+    sys.exit(f"Unknown FIRMWARE_ALGORITHM '{firmware_algorithm}', expected one of {', '.join(algorithm_ids)}")
+
 # Add algorithm to compile definitions
 env.Append(CPPDEFINES=[
-    ("FIRMWARE_ALGORITHM", f'\\"{firmware_algorithm}\\"')
+    ("FIRMWARE_ALGORITHM", f'\\"{firmware_algorithm}\\"'),
+    ("FIRMWARE_ALGORITHM_ID", algorithm_ids[firmware_algorithm])
 ])